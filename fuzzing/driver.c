@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/* Standalone driver for the fuzz targets, used when they are not
+ * linked against libFuzzer. It runs LLVMFuzzerTestOneInput() over
+ * each file given on the command line (directories are expanded one
+ * level) and fails if any single input takes longer than the time
+ * budget, so slow inputs found while fuzzing can be kept in the
+ * corpus as regression tests.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fuzz.h"
+
+static gint timeout_ms = 1000;
+static const gchar *current_input = NULL;
+
+static GOptionEntry entries[] = {
+	{ "timeout-ms", 't', 0, G_OPTION_ARG_INT, &timeout_ms,
+	  "Maximum time a single input may take, in milliseconds", "MS" },
+	{ NULL }
+};
+
+static void
+alarm_handler (int signum)
+{
+	const gchar *msg = "Input exceeded the hard time limit: ";
+
+	/* Only async-signal-safe calls in here */
+	if (write (STDERR_FILENO, msg, strlen (msg)) < 0 ||
+	    (current_input &&
+	     write (STDERR_FILENO, current_input, strlen (current_input)) < 0) ||
+	    write (STDERR_FILENO, "\n", 1) < 0) {
+		_exit (EXIT_FAILURE);
+	}
+
+	_exit (EXIT_FAILURE);
+}
+
+static gboolean
+run_input (const gchar *path,
+           gint64      *elapsed_us)
+{
+	GError *error = NULL;
+	gchar *contents;
+	gsize length;
+	gint64 start;
+
+	if (!g_file_get_contents (path, &contents, &length, &error)) {
+		g_printerr ("Could not read '%s': %s\n", path, error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	current_input = path;
+
+	/* Anything ten times over budget is treated as a hang */
+	alarm ((timeout_ms * 10) / 1000 + 1);
+
+	start = g_get_monotonic_time ();
+	LLVMFuzzerTestOneInput ((const unsigned char *) contents, length);
+	*elapsed_us = g_get_monotonic_time () - start;
+
+	alarm (0);
+	current_input = NULL;
+
+	g_free (contents);
+
+	return TRUE;
+}
+
+static void
+collect_inputs (const gchar *path,
+                GPtrArray   *inputs)
+{
+	GDir *dir;
+	const gchar *name;
+
+	if (!g_file_test (path, G_FILE_TEST_IS_DIR)) {
+		g_ptr_array_add (inputs, g_strdup (path));
+		return;
+	}
+
+	dir = g_dir_open (path, 0, NULL);
+	if (!dir) {
+		return;
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		g_ptr_array_add (inputs, g_build_filename (path, name, NULL));
+	}
+
+	g_dir_close (dir);
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GPtrArray *inputs;
+	gint64 total_us = 0;
+	guint n_slow = 0;
+	gboolean success = TRUE;
+	gint i;
+	guint j;
+
+	context = g_option_context_new ("FILE|DIRECTORY... - run fuzz target over inputs");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	signal (SIGALRM, alarm_handler);
+
+	inputs = g_ptr_array_new_with_free_func (g_free);
+
+	for (i = 1; i < argc; i++) {
+		collect_inputs (argv[i], inputs);
+	}
+
+	for (j = 0; j < inputs->len; j++) {
+		const gchar *path = g_ptr_array_index (inputs, j);
+		gint64 elapsed_us = 0;
+
+		if (!run_input (path, &elapsed_us)) {
+			success = FALSE;
+			continue;
+		}
+
+		total_us += elapsed_us;
+
+		if (elapsed_us > (gint64) timeout_ms * 1000) {
+			g_printerr ("Slow input '%s': %" G_GINT64_FORMAT " ms (budget %d ms)\n",
+			            path, elapsed_us / 1000, timeout_ms);
+			n_slow++;
+			success = FALSE;
+		}
+	}
+
+	g_print ("Ran %u inputs in %" G_GINT64_FORMAT " ms (%.1f execs/s), %u over budget\n",
+	         inputs->len,
+	         total_us / 1000,
+	         total_us > 0 ? inputs->len / (total_us / (gdouble) G_USEC_PER_SEC) : 0.0,
+	         n_slow);
+
+	g_ptr_array_unref (inputs);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MEDIAART_FUZZ_H__
+#define __MEDIAART_FUZZ_H__
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <libmediaart/mediaart.h>
+
+int LLVMFuzzerTestOneInput (const unsigned char *data,
+                            size_t               size);
+
+static void
+empty_logging_func (const gchar    *log_domain,
+                    GLogLevelFlags  log_level,
+                    const gchar    *message,
+                    gpointer        user_data)
+{
+}
+
+/* Logging isn't going to make a fuzz test fail, so it's just noise
+ * which slows the fuzzers down.
+ */
+static void
+fuzz_set_logging_func (void)
+{
+	static gsize once_init_value = 0;
+
+	if (g_once_init_enter (&once_init_value)) {
+		g_log_set_default_handler (empty_logging_func, NULL);
+		g_once_init_leave (&once_init_value, 1);
+	}
+}
+
+#endif /* __MEDIAART_FUZZ_H__ */
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "fuzz.h"
+
+/* The first byte selects the MIME type given to the backend, the
+ * rest of the input is the image data.
+ */
+static const gchar *mime_types[] = {
+	NULL,
+	"image/jpeg",
+	"image/png",
+	"JPG",
+};
+
+int
+LLVMFuzzerTestOneInput (const unsigned char *data,
+                        size_t               size)
+{
+	static gchar *target = NULL;
+	GError *error = NULL;
+	const gchar *mime;
+
+	fuzz_set_logging_func ();
+
+	if (!target) {
+		gchar *basename;
+
+		media_art_plugin_init (0);
+
+		basename = g_strdup_printf ("libmediaart-fuzz-%d.jpeg", (gint) getpid ());
+		target = g_build_filename (g_get_tmp_dir (), basename, NULL);
+		g_free (basename);
+	}
+
+	if (size < 1) {
+		return 0;
+	}
+
+	mime = mime_types[data[0] % G_N_ELEMENTS (mime_types)];
+
+	media_art_buffer_to_jpeg (data + 1, size - 1, mime, target, &error);
+	g_clear_error (&error);
+	g_unlink (target);
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "fuzz.h"
+
+#include "libmediaart/embedded.h"
+
+/* The input is the start of a media file, as if read from disk */
+int
+LLVMFuzzerTestOneInput (const unsigned char *data,
+                        size_t               size)
+{
+	GInputStream *stream;
+	GBytes *picture = NULL;
+	gchar *mime = NULL;
+
+	fuzz_set_logging_func ();
+
+	stream = g_memory_input_stream_new_from_data (data, size, NULL);
+
+	if (media_art_embedded_read_stream (stream, &picture, &mime, NULL, NULL)) {
+		g_bytes_unref (picture);
+		g_free (mime);
+	}
+
+	g_object_unref (stream);
+
+	return 0;
+}
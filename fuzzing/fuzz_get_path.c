@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "fuzz.h"
+
+/* The input is "artist\0title". Without a NUL byte the whole input
+ * is used as the title and the artist is %NULL.
+ */
+int
+LLVMFuzzerTestOneInput (const unsigned char *data,
+                        size_t               size)
+{
+	const unsigned char *separator;
+	gchar *artist = NULL;
+	gchar *title = NULL;
+	gchar *path = NULL;
+
+	fuzz_set_logging_func ();
+
+	separator = memchr (data, '\0', size);
+
+	if (separator) {
+		artist = g_strndup ((const gchar *) data, separator - data);
+		title = g_strndup ((const gchar *) separator + 1, size - (separator - data) - 1);
+	} else {
+		title = g_strndup ((const gchar *) data, size);
+	}
+
+	if (g_utf8_validate (title, -1, NULL) &&
+	    (!artist || g_utf8_validate (artist, -1, NULL))) {
+		media_art_get_path (artist, title, "album", &path);
+		g_free (path);
+	}
+
+	g_free (artist);
+	g_free (title);
+
+	return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "arena.h"
+
+/* A bump allocator for the temporaries of a single processing job.
+ *
+ * Everything a job allocates from its arena is released in one go
+ * by media_art_arena_release(), and the arena itself (with its first
+ * chunk) is kept on a small per-thread freelist so the next job on
+ * that thread does not go back to malloc() at all. Memory allocated
+ * elsewhere (by GLib, for example) can be handed over with
+ * media_art_arena_take() so it shares the arena's lifetime.
+ */
+
+#define ARENA_CHUNK_SIZE    4096
+#define ARENA_FREELIST_MAX  4
+#define ARENA_ALIGNMENT     (2 * sizeof (gpointer))
+#define ARENA_ALIGN(size)   (((size) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+typedef struct _ArenaChunk ArenaChunk;
+typedef struct _ArenaOwned ArenaOwned;
+
+struct _ArenaChunk {
+	ArenaChunk *next;
+	gsize size;
+	gsize used;
+	/* Padding so chunk data following the header is aligned */
+	gpointer padding;
+};
+
+struct _ArenaOwned {
+	ArenaOwned *next;
+	gpointer mem;
+	GDestroyNotify destroy;
+};
+
+struct _MediaArtArena {
+	MediaArtArena *next_free;
+	ArenaChunk *current;
+	ArenaChunk *large;
+	ArenaOwned *owned;
+
+	/* Must be last, its data follows the arena in memory */
+	ArenaChunk first;
+};
+
+typedef struct {
+	MediaArtArena *head;
+	guint length;
+} ArenaFreelist;
+
+static void arena_freelist_free (gpointer data);
+
+static GPrivate arena_freelist = G_PRIVATE_INIT (arena_freelist_free);
+
+static inline guchar *
+chunk_data (ArenaChunk *chunk)
+{
+	return (guchar *) (chunk + 1);
+}
+
+static void
+arena_reset (MediaArtArena *arena)
+{
+	ArenaChunk *chunk;
+	ArenaOwned *owned;
+
+	/* Owned memory is recorded inside the chunks, so run the
+	 * destroy notifies before the chunks go away.
+	 */
+	for (owned = arena->owned; owned; owned = owned->next) {
+		owned->destroy (owned->mem);
+	}
+
+	arena->owned = NULL;
+
+	while (arena->large) {
+		chunk = arena->large;
+		arena->large = chunk->next;
+		g_free (chunk);
+	}
+
+	/* The first chunk is always at the end of the list */
+	chunk = arena->current;
+	while (chunk != &arena->first) {
+		ArenaChunk *next = chunk->next;
+
+		g_free (chunk);
+		chunk = next;
+	}
+
+	arena->first.used = 0;
+	arena->current = &arena->first;
+}
+
+static void
+arena_free (MediaArtArena *arena)
+{
+	arena_reset (arena);
+	g_free (arena);
+}
+
+static void
+arena_freelist_free (gpointer data)
+{
+	ArenaFreelist *freelist = data;
+
+	while (freelist->head) {
+		MediaArtArena *arena = freelist->head;
+
+		freelist->head = arena->next_free;
+		arena_free (arena);
+	}
+
+	g_free (freelist);
+}
+
+/*
+ * media_art_arena_acquire:
+ *
+ * Returns: (transfer full): an empty arena, recycled from this
+ * thread's freelist when possible.
+ */
+MediaArtArena *
+media_art_arena_acquire (void)
+{
+	ArenaFreelist *freelist;
+	MediaArtArena *arena;
+
+	freelist = g_private_get (&arena_freelist);
+
+	if (freelist && freelist->head) {
+		arena = freelist->head;
+		freelist->head = arena->next_free;
+		freelist->length--;
+		arena->next_free = NULL;
+
+		return arena;
+	}
+
+	arena = g_malloc (sizeof (MediaArtArena) + ARENA_CHUNK_SIZE);
+	arena->next_free = NULL;
+	arena->large = NULL;
+	arena->owned = NULL;
+	arena->first.next = NULL;
+	arena->first.size = ARENA_CHUNK_SIZE;
+	arena->first.used = 0;
+	arena->current = &arena->first;
+
+	return arena;
+}
+
+/*
+ * media_art_arena_release:
+ * @arena: an arena
+ *
+ * Frees everything allocated from or handed over to @arena, and
+ * returns it to the calling thread's freelist.
+ */
+void
+media_art_arena_release (MediaArtArena *arena)
+{
+	ArenaFreelist *freelist;
+
+	if (!arena) {
+		return;
+	}
+
+	arena_reset (arena);
+
+	freelist = g_private_get (&arena_freelist);
+
+	if (!freelist) {
+		freelist = g_new0 (ArenaFreelist, 1);
+		g_private_set (&arena_freelist, freelist);
+	}
+
+	if (freelist->length >= ARENA_FREELIST_MAX) {
+		g_free (arena);
+		return;
+	}
+
+	arena->next_free = freelist->head;
+	freelist->head = arena;
+	freelist->length++;
+}
+
+gpointer
+media_art_arena_alloc (MediaArtArena *arena,
+                       gsize          size)
+{
+	ArenaChunk *chunk;
+	gpointer mem;
+
+	size = ARENA_ALIGN (MAX (size, 1));
+
+	if (size > ARENA_CHUNK_SIZE / 4) {
+		/* Large allocations (embedded image buffers, for
+		 * example) get a chunk of their own, so they don't
+		 * waste what is left of the current one.
+		 */
+		chunk = g_malloc (sizeof (ArenaChunk) + size);
+		chunk->size = chunk->used = size;
+		chunk->next = arena->large;
+		arena->large = chunk;
+
+		return chunk_data (chunk);
+	}
+
+	chunk = arena->current;
+
+	if (chunk->size - chunk->used < size) {
+		chunk = g_malloc (sizeof (ArenaChunk) + ARENA_CHUNK_SIZE);
+		chunk->size = ARENA_CHUNK_SIZE;
+		chunk->used = 0;
+		chunk->next = arena->current;
+		arena->current = chunk;
+	}
+
+	mem = chunk_data (chunk) + chunk->used;
+	chunk->used += size;
+
+	return mem;
+}
+
+gpointer
+media_art_arena_alloc0 (MediaArtArena *arena,
+                        gsize          size)
+{
+	return memset (media_art_arena_alloc (arena, size), 0, size);
+}
+
+gchar *
+media_art_arena_strdup (MediaArtArena *arena,
+                        const gchar   *str)
+{
+	if (!str) {
+		return NULL;
+	}
+
+	return media_art_arena_memdup (arena, str, strlen (str) + 1);
+}
+
+gpointer
+media_art_arena_memdup (MediaArtArena *arena,
+                        gconstpointer  mem,
+                        gsize          size)
+{
+	if (!mem) {
+		return NULL;
+	}
+
+	return memcpy (media_art_arena_alloc (arena, size), mem, size);
+}
+
+/*
+ * media_art_arena_take:
+ * @arena: an arena
+ * @mem: (transfer full) (nullable): memory to hand over
+ * @destroy: function to free @mem with
+ *
+ * Makes @arena responsible for freeing @mem when it is released.
+ *
+ * Returns: @mem
+ */
+gpointer
+media_art_arena_take (MediaArtArena  *arena,
+                      gpointer        mem,
+                      GDestroyNotify  destroy)
+{
+	ArenaOwned *owned;
+
+	if (!mem) {
+		return NULL;
+	}
+
+	owned = media_art_arena_alloc (arena, sizeof (ArenaOwned));
+	owned->mem = mem;
+	owned->destroy = destroy;
+	owned->next = arena->owned;
+	arena->owned = owned;
+
+	return mem;
+}
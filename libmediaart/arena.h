@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LIBMEDIAART_ARENA_H__
+#define __LIBMEDIAART_ARENA_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MediaArtArena MediaArtArena;
+
+MediaArtArena *media_art_arena_acquire (void);
+void           media_art_arena_release (MediaArtArena  *arena);
+
+gpointer       media_art_arena_alloc   (MediaArtArena  *arena,
+                                        gsize           size);
+gpointer       media_art_arena_alloc0  (MediaArtArena  *arena,
+                                        gsize           size);
+gchar *        media_art_arena_strdup  (MediaArtArena  *arena,
+                                        const gchar    *str);
+gpointer       media_art_arena_memdup  (MediaArtArena  *arena,
+                                        gconstpointer   mem,
+                                        gsize           size);
+gpointer       media_art_arena_take    (MediaArtArena  *arena,
+                                        gpointer        mem,
+                                        GDestroyNotify  destroy);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_ARENA_H__ */
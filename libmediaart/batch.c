@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include "batch.h"
+
+/* Delivers the results of asynchronous requests to the main context
+ * they were made from in batches, rather than with one GTask (and
+ * one main loop dispatch) each.
+ *
+ * Workers push results onto a lock-free stack. The first result
+ * pushed into an empty stack arms a GSource for max_delay, the
+ * max_results'th makes it ready at once; either way the dispatch
+ * takes the whole stack in one go. Each pending result keeps the
+ * process alive, like a GTask would, so the batch (which the process
+ * owns) is never freed with results in it.
+ */
+
+typedef struct _BatchNode BatchNode;
+
+struct _BatchNode {
+	BatchNode *next;
+	MediaArtResult result;
+};
+
+typedef struct {
+	GSource source;
+	MediaArtBatch *batch;
+} BatchSource;
+
+struct _MediaArtBatch {
+	/* Not a reference, the process owns us */
+	MediaArtProcess *process;
+	GSource *source;
+
+	/* Newest first */
+	BatchNode *head;
+	gint pending;
+
+	guint max_results;
+	gint64 max_delay;
+
+	MediaArtBatchFunc func;
+	gpointer user_data;
+	GDestroyNotify notify;
+};
+
+static void
+batch_flush (MediaArtBatch *batch)
+{
+	MediaArtProcess *process = batch->process;
+	MediaArtResult *results;
+	BatchNode *head, *node, *next;
+	guint n_results = 0, i;
+	gint remaining;
+
+	do {
+		head = g_atomic_pointer_get (&batch->head);
+	} while (!g_atomic_pointer_compare_and_exchange (&batch->head, head, NULL));
+
+	if (!head) {
+		return;
+	}
+
+	for (node = head; node; node = node->next) {
+		n_results++;
+	}
+
+	/* Back to the order they completed in */
+	results = g_new (MediaArtResult, n_results);
+	i = n_results;
+
+	for (node = head; node; node = next) {
+		next = node->next;
+		results[--i] = node->result;
+		g_slice_free (BatchNode, node);
+	}
+
+	/* Whatever was pushed since the stack was taken didn't arm the
+	 * source, as the count wasn't back to zero yet.
+	 */
+	remaining = g_atomic_int_add (&batch->pending, - (gint) n_results) - (gint) n_results;
+
+	if (remaining >= (gint) batch->max_results) {
+		g_source_set_ready_time (batch->source, 0);
+	} else if (remaining > 0 && g_source_get_ready_time (batch->source) == -1) {
+		g_source_set_ready_time (batch->source, g_get_monotonic_time () + batch->max_delay);
+	}
+
+	batch->func (process, results, n_results, batch->user_data);
+
+	for (i = 0; i < n_results; i++) {
+		g_clear_error (&results[i].error);
+	}
+
+	g_free (results);
+
+	/* The last of these may free the batch */
+	for (i = 0; i < n_results; i++) {
+		g_object_unref (process);
+	}
+}
+
+static gboolean
+batch_source_dispatch (GSource     *source,
+                       GSourceFunc  callback,
+                       gpointer     user_data)
+{
+	g_source_set_ready_time (source, -1);
+	batch_flush (((BatchSource *) source)->batch);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs batch_source_funcs = {
+	NULL,
+	NULL,
+	batch_source_dispatch,
+	NULL,
+};
+
+/* Results are delivered in the thread-default main context of the
+ * caller.
+ */
+MediaArtBatch *
+media_art_batch_new (MediaArtProcess   *process,
+                     guint              max_results,
+                     guint              max_delay,
+                     MediaArtBatchFunc  func,
+                     gpointer           user_data,
+                     GDestroyNotify     notify)
+{
+	MediaArtBatch *batch;
+	GMainContext *context;
+
+	batch = g_slice_new0 (MediaArtBatch);
+	batch->process = process;
+	batch->max_results = MAX (max_results, 1);
+	batch->max_delay = (gint64) max_delay * G_TIME_SPAN_MILLISECOND;
+	batch->func = func;
+	batch->user_data = user_data;
+	batch->notify = notify;
+
+	batch->source = g_source_new (&batch_source_funcs, sizeof (BatchSource));
+	((BatchSource *) batch->source)->batch = batch;
+	g_source_set_name (batch->source, "[libmediaart] batched results");
+
+	context = g_main_context_ref_thread_default ();
+	g_source_attach (batch->source, context);
+	g_main_context_unref (context);
+
+	return batch;
+}
+
+void
+media_art_batch_free (MediaArtBatch *batch)
+{
+	g_source_destroy (batch->source);
+	g_source_unref (batch->source);
+
+	if (batch->notify) {
+		batch->notify (batch->user_data);
+	}
+
+	g_slice_free (MediaArtBatch, batch);
+}
+
+/* Called from any thread, takes @error */
+void
+media_art_batch_push (MediaArtBatch *batch,
+                      gpointer       user_data,
+                      gboolean       success,
+                      GError        *error)
+{
+	BatchNode *node;
+	gint n_pending;
+
+	node = g_slice_new (BatchNode);
+	node->result.user_data = user_data;
+	node->result.success = success;
+	node->result.error = error;
+
+	g_object_ref (batch->process);
+
+	do {
+		node->next = g_atomic_pointer_get (&batch->head);
+	} while (!g_atomic_pointer_compare_and_exchange (&batch->head, node->next, node));
+
+	n_pending = g_atomic_int_add (&batch->pending, 1) + 1;
+
+	if (n_pending == (gint) batch->max_results) {
+		g_source_set_ready_time (batch->source, 0);
+	} else if (n_pending == 1) {
+		g_source_set_ready_time (batch->source, g_get_monotonic_time () + batch->max_delay);
+	}
+}
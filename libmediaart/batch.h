@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __LIBMEDIAART_BATCH_H__
+#define __LIBMEDIAART_BATCH_H__
+
+#include <gio/gio.h>
+
+#include "extract.h"
+
+G_BEGIN_DECLS
+
+typedef struct _MediaArtBatch MediaArtBatch;
+
+MediaArtBatch *media_art_batch_new  (MediaArtProcess    *process,
+                                     guint               max_results,
+                                     guint               max_delay,
+                                     MediaArtBatchFunc   func,
+                                     gpointer            user_data,
+                                     GDestroyNotify      notify);
+void           media_art_batch_free (MediaArtBatch      *batch);
+void           media_art_batch_push (MediaArtBatch      *batch,
+                                     gpointer            user_data,
+                                     gboolean            success,
+                                     GError             *error);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_BATCH_H__ */
@@ -0,0 +1,702 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#include <glib/gstdio.h>
+
+#include "bloom.h"
+#include "index.h"
+
+/* A Bloom filter of the names in the media art cache, kept in
+ * $XDG_CACHE_HOME/media-art/.index/bloom and mapped shared by every
+ * process using the cache, so that asking whether media art exists
+ * for something which has none needs no system call at all. Only
+ * probable hits have to be confirmed with a stat().
+ *
+ * Names are only ever added to the filter, by
+ * media_art_bloom_update() as libmediaart writes the cache, and while
+ * holding an exclusive flock() of .index/bloom.lock. Rebuilding the
+ * filter from the directory takes the same lock, renames the new
+ * filter into place and then marks the old one stale for whoever
+ * still maps it, so no addition is ever lost in between. A stale
+ * filter is never used again. Removed entries leave their bits
+ * behind until media_art_cache_gc() rebuilds the filter.
+ *
+ * Changes made without libmediaart are noticed by comparing the
+ * modification time of the cache directory with the one recorded in
+ * the filter, at most once per BLOOM_CHECK_INTERVAL. An update only
+ * records the time after its write if the directory had not changed
+ * past the recorded time before the write started, otherwise the
+ * change was made elsewhere and the filter is marked stale instead.
+ * Writers which overlap keep the filter current, as each of them
+ * started from a time already recorded or older.
+ *
+ * Only lookups build filters, writers just skip updating a missing
+ * or stale one.
+ */
+
+#define BLOOM_MAGIC   0x4642414d /* "MABF" */
+#define BLOOM_VERSION 1
+
+#define BLOOM_N_HASHES      7
+#define BLOOM_BITS_PER_ITEM 16
+#define BLOOM_MIN_ITEMS     4096
+
+#define BLOOM_MIN_BITS_LOG2 10
+#define BLOOM_MAX_BITS_LOG2 36
+
+#define BLOOM_CHECK_INTERVAL G_USEC_PER_SEC
+
+/* Seconds our own writers get to record a change to the cache
+ * directory before it is taken for somebody else's.
+ */
+#define BLOOM_SETTLE_TIME 2
+
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 n_hashes;
+	guint32 bits_log2;
+	gint stale;
+	gint n_items;
+	gint64 dir_mtime;
+	gint64 dir_mtime_nsec;
+	guint32 padding[6];
+} BloomHeader;
+
+typedef struct {
+	BloomHeader *header;
+	guint *bits;
+	gsize size;
+} BloomMap;
+
+static GMutex bloom_lock;
+static BloomMap bloom_map;
+static gint bloom_lock_fd = -1;
+static gint64 bloom_last_build;
+static gint64 bloom_last_check;
+
+static const gchar *
+bloom_get_name (const gchar *path)
+{
+	const gchar *name;
+
+	name = strrchr (path, G_DIR_SEPARATOR);
+
+	return name ? name + 1 : path;
+}
+
+static void
+bloom_hash (const gchar *name,
+            guint64     *h1,
+            guint64     *h2)
+{
+	const guchar *p;
+	guint64 h;
+
+	/* FNV-1a */
+	h = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+
+	for (p = (const guchar *) name; *p; p++) {
+		h ^= *p;
+		h *= G_GUINT64_CONSTANT (0x100000001b3);
+	}
+
+	*h1 = h;
+
+	/* And the splitmix64 finalizer of it for the probe stride */
+	h ^= h >> 30;
+	h *= G_GUINT64_CONSTANT (0xbf58476d1ce4e5b9);
+	h ^= h >> 27;
+	h *= G_GUINT64_CONSTANT (0x94d049bb133111eb);
+	h ^= h >> 31;
+
+	*h2 = h | 1;
+}
+
+static void
+bloom_add_name (BloomMap    *map,
+                const gchar *name)
+{
+	guint64 h1, h2, mask, bit;
+	guint i;
+
+	bloom_hash (name, &h1, &h2);
+	mask = (G_GUINT64_CONSTANT (1) << map->header->bits_log2) - 1;
+
+	for (i = 0; i < map->header->n_hashes; i++) {
+		bit = (h1 + i * h2) & mask;
+		g_atomic_int_or (&map->bits[bit / 32], 1U << (bit % 32));
+	}
+}
+
+static gboolean
+bloom_test_name (BloomMap    *map,
+                 const gchar *name)
+{
+	guint64 h1, h2, mask, bit;
+	guint i;
+
+	bloom_hash (name, &h1, &h2);
+	mask = (G_GUINT64_CONSTANT (1) << map->header->bits_log2) - 1;
+
+	for (i = 0; i < map->header->n_hashes; i++) {
+		bit = (h1 + i * h2) & mask;
+
+		if ((map->bits[bit / 32] & (1U << (bit % 32))) == 0) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gsize
+bloom_get_size (guint bits_log2)
+{
+	return sizeof (BloomHeader) + ((gsize) 1 << bits_log2) / 8;
+}
+
+static gboolean
+bloom_stat_dir (gint64 *mtime,
+                gint64 *mtime_nsec)
+{
+	GStatBuf st;
+	gchar *dirname;
+	gint result;
+
+	dirname = g_build_filename (g_get_user_cache_dir (), "media-art", NULL);
+	result = g_stat (dirname, &st);
+	g_free (dirname);
+
+	if (result != 0) {
+		return FALSE;
+	}
+
+	*mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	*mtime_nsec = st.st_mtim.tv_nsec;
+#else
+	*mtime_nsec = 0;
+#endif
+
+	return TRUE;
+}
+
+static gint
+bloom_stamp_compare (gint64 mtime1,
+                     gint64 mtime_nsec1,
+                     gint64 mtime2,
+                     gint64 mtime_nsec2)
+{
+	if (mtime1 != mtime2) {
+		return mtime1 < mtime2 ? -1 : 1;
+	}
+
+	if (mtime_nsec1 != mtime_nsec2) {
+		return mtime_nsec1 < mtime_nsec2 ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static void
+bloom_unmap (BloomMap *map)
+{
+	if (map->header) {
+		munmap (map->header, map->size);
+	}
+
+	memset (map, 0, sizeof (BloomMap));
+}
+
+static gboolean
+bloom_map_fd (gint      fd,
+              BloomMap *map)
+{
+	BloomHeader *header;
+	GStatBuf st;
+
+	if (fstat (fd, &st) != 0 || st.st_size < (goffset) sizeof (BloomHeader)) {
+		return FALSE;
+	}
+
+	header = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (header == MAP_FAILED) {
+		return FALSE;
+	}
+
+	if (header->magic != BLOOM_MAGIC ||
+	    header->version != BLOOM_VERSION ||
+	    g_atomic_int_get (&header->stale) ||
+	    header->n_hashes == 0 ||
+	    header->bits_log2 < BLOOM_MIN_BITS_LOG2 ||
+	    header->bits_log2 > BLOOM_MAX_BITS_LOG2 ||
+	    (goffset) bloom_get_size (header->bits_log2) != st.st_size) {
+		munmap (header, st.st_size);
+		return FALSE;
+	}
+
+	map->header = header;
+	map->bits = (guint *) (header + 1);
+	map->size = st.st_size;
+
+	return TRUE;
+}
+
+static gboolean
+bloom_open (BloomMap *map)
+{
+	gchar *path;
+	gboolean retval;
+	gint fd;
+
+	path = media_art_index_get_dir ("bloom");
+	fd = g_open (path, O_RDWR | O_CLOEXEC, 0);
+	g_free (path);
+
+	if (fd < 0) {
+		return FALSE;
+	}
+
+	/* The mapping outlives the descriptor */
+	retval = bloom_map_fd (fd, map);
+	close (fd);
+
+	return retval;
+}
+
+static void
+bloom_mark_stale (gint fd)
+{
+	BloomHeader *header;
+	GStatBuf st;
+
+	if (fstat (fd, &st) != 0 || st.st_size < (goffset) sizeof (BloomHeader)) {
+		return;
+	}
+
+	header = mmap (NULL, sizeof (BloomHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (header == MAP_FAILED) {
+		return;
+	}
+
+	g_atomic_int_set (&header->stale, 1);
+	munmap (header, sizeof (BloomHeader));
+}
+
+static gboolean
+bloom_flock (gint operation)
+{
+	if (bloom_lock_fd < 0) {
+		gchar *path;
+
+		/* Not a table, but index_get_dir() gives us the right path */
+		path = media_art_index_get_dir ("bloom.lock");
+		bloom_lock_fd = g_open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+		g_free (path);
+
+		if (bloom_lock_fd < 0) {
+			return FALSE;
+		}
+	}
+
+	while (flock (bloom_lock_fd, operation) != 0) {
+		if (errno != EINTR) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Replaces the filter with one listing the cache directory as it is
+ * now, or with @force unset, only if no valid filter exists. Called
+ * with bloom_lock held.
+ */
+static gboolean
+bloom_build (gboolean force)
+{
+	BloomMap map = { 0, };
+	GPtrArray *names;
+	const gchar *name;
+	gchar *dirname, *path, *tmp_path = NULL;
+	gint64 mtime, mtime_nsec;
+	guint bits_log2;
+	gboolean retval = FALSE;
+	GDir *dir;
+	gint fd = -1, old_fd;
+	guint i;
+
+	/* No cache, nothing to index, and nothing to create either */
+	if (!bloom_stat_dir (&mtime, &mtime_nsec)) {
+		return FALSE;
+	}
+
+	dirname = media_art_index_get_dir (NULL);
+	g_mkdir_with_parents (dirname, 0770);
+	g_free (dirname);
+
+	if (!bloom_flock (LOCK_EX)) {
+		return FALSE;
+	}
+
+	if (!force) {
+		/* Somebody else may have just done it */
+		bloom_unmap (&bloom_map);
+
+		if (bloom_open (&bloom_map)) {
+			flock (bloom_lock_fd, LOCK_UN);
+			return TRUE;
+		}
+	}
+
+	/* Anything changing the directory after this is newer than
+	 * what the filter records, and gets noticed.
+	 */
+	if (!bloom_stat_dir (&mtime, &mtime_nsec)) {
+		flock (bloom_lock_fd, LOCK_UN);
+		return FALSE;
+	}
+
+	dirname = g_build_filename (g_get_user_cache_dir (), "media-art", NULL);
+	dir = g_dir_open (dirname, 0, NULL);
+	g_free (dirname);
+
+	if (!dir) {
+		flock (bloom_lock_fd, LOCK_UN);
+		return FALSE;
+	}
+
+	names = g_ptr_array_new_with_free_func (g_free);
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		/* Not media art, see index.c */
+		if (name[0] != '.') {
+			g_ptr_array_add (names, g_strdup (name));
+		}
+	}
+
+	g_dir_close (dir);
+
+	/* Leave room for the cache to double before rebuilding again */
+	for (bits_log2 = BLOOM_MIN_BITS_LOG2; bits_log2 < BLOOM_MAX_BITS_LOG2; bits_log2++) {
+		if (((guint64) 1 << bits_log2) >=
+		    (guint64) MAX (names->len * 2, BLOOM_MIN_ITEMS) * BLOOM_BITS_PER_ITEM) {
+			break;
+		}
+	}
+
+	path = media_art_index_get_dir ("bloom");
+	tmp_path = g_strdup_printf ("%s.%08x", path, g_random_int ());
+
+	fd = g_open (tmp_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+
+	if (fd < 0 || ftruncate (fd, bloom_get_size (bits_log2)) != 0) {
+		g_debug ("Could not create media art bloom filter '%s': %s",
+		         tmp_path, g_strerror (errno));
+		goto out;
+	}
+
+	map.size = bloom_get_size (bits_log2);
+	map.header = mmap (NULL, map.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (map.header == MAP_FAILED) {
+		map.header = NULL;
+		goto out;
+	}
+
+	map.bits = (guint *) (map.header + 1);
+	map.header->magic = BLOOM_MAGIC;
+	map.header->version = BLOOM_VERSION;
+	map.header->n_hashes = BLOOM_N_HASHES;
+	map.header->bits_log2 = bits_log2;
+	map.header->n_items = names->len;
+	map.header->dir_mtime = mtime;
+	map.header->dir_mtime_nsec = mtime_nsec;
+
+	for (i = 0; i < names->len; i++) {
+		bloom_add_name (&map, g_ptr_array_index (names, i));
+	}
+
+	old_fd = g_open (path, O_RDWR | O_CLOEXEC, 0);
+
+	if (g_rename (tmp_path, path) != 0) {
+		g_debug ("Could not rename media art bloom filter '%s' to '%s': %s",
+		         tmp_path, path, g_strerror (errno));
+
+		if (old_fd >= 0) {
+			close (old_fd);
+		}
+
+		goto out;
+	}
+
+	if (old_fd >= 0) {
+		bloom_mark_stale (old_fd);
+		close (old_fd);
+	}
+
+	bloom_unmap (&bloom_map);
+	bloom_map = map;
+	map.header = NULL;
+	retval = TRUE;
+
+out:
+	if (!retval) {
+		bloom_unmap (&map);
+
+		if (fd >= 0) {
+			g_unlink (tmp_path);
+		}
+	}
+
+	if (fd >= 0) {
+		close (fd);
+	}
+
+	flock (bloom_lock_fd, LOCK_UN);
+
+	g_ptr_array_unref (names);
+	g_free (tmp_path);
+	g_free (path);
+
+	return retval;
+}
+
+static gboolean
+bloom_changed_elsewhere (BloomMap *map)
+{
+	gint64 mtime, mtime_nsec;
+
+	if (!bloom_stat_dir (&mtime, &mtime_nsec)) {
+		return FALSE;
+	}
+
+	if (mtime == map->header->dir_mtime &&
+	    mtime_nsec == map->header->dir_mtime_nsec) {
+		return FALSE;
+	}
+
+	/* Our own writers record their changes right after making them */
+	return mtime < g_get_real_time () / G_USEC_PER_SEC - BLOOM_SETTLE_TIME;
+}
+
+/* Returns the filter, up to date as far as anybody can tell, or NULL
+ * if there is none. Called with bloom_lock held.
+ */
+static BloomMap *
+bloom_get_map (void)
+{
+	gint64 now;
+
+	now = g_get_monotonic_time ();
+
+	if (bloom_map.header && g_atomic_int_get (&bloom_map.header->stale)) {
+		bloom_unmap (&bloom_map);
+	}
+
+	if (!bloom_map.header && !bloom_open (&bloom_map)) {
+		/* Don't list a missing or unwritable cache on every lookup */
+		if (bloom_last_build != 0 && now - bloom_last_build < BLOOM_CHECK_INTERVAL) {
+			return NULL;
+		}
+
+		bloom_last_build = now;
+
+		if (!bloom_build (FALSE)) {
+			return NULL;
+		}
+
+		bloom_last_check = now;
+	}
+
+	if (now - bloom_last_check >= BLOOM_CHECK_INTERVAL) {
+		bloom_last_check = now;
+
+		if (bloom_changed_elsewhere (&bloom_map)) {
+			g_debug ("Media art cache changed, rebuilding bloom filter");
+			bloom_build (TRUE);
+		}
+	}
+
+	return bloom_map.header ? &bloom_map : NULL;
+}
+
+/*
+ * media_art_bloom_lookup:
+ * @path: a path in the media art cache
+ *
+ * Returns FALSE if @path is certainly not in the cache, and TRUE if
+ * it may be, including when there is no filter to tell.
+ */
+gboolean
+media_art_bloom_lookup (const gchar *path)
+{
+	BloomMap *map;
+	gboolean found;
+
+	g_mutex_lock (&bloom_lock);
+
+	map = bloom_get_map ();
+	found = !map || bloom_test_name (map, bloom_get_name (path));
+
+	g_mutex_unlock (&bloom_lock);
+
+	return found;
+}
+
+/*
+ * media_art_bloom_stamp:
+ * @stamp: where to store the time
+ *
+ * Takes the modification time of the cache directory before writing
+ * it, for media_art_bloom_update().
+ */
+void
+media_art_bloom_stamp (MediaArtBloomStamp *stamp)
+{
+	if (!bloom_stat_dir (&stamp->mtime, &stamp->mtime_nsec)) {
+		stamp->mtime = -1;
+		stamp->mtime_nsec = -1;
+	}
+}
+
+/*
+ * media_art_bloom_update:
+ * @paths: paths in the media art cache
+ * @exists: whether each of @paths now exists
+ * @n_paths: the number of @paths
+ * @before: the time taken with media_art_bloom_stamp() before they
+ * were written
+ *
+ * Records a change made to the cache at @paths.
+ */
+void
+media_art_bloom_update (const gchar * const      *paths,
+                        const gboolean           *exists,
+                        guint                     n_paths,
+                        const MediaArtBloomStamp *before)
+{
+	MediaArtBloomStamp after;
+	gboolean stale = FALSE;
+	guint64 capacity;
+	guint i;
+
+	g_mutex_lock (&bloom_lock);
+
+	/* Without a filter there is nothing to keep up to date, the
+	 * next lookup builds one which includes @paths. Writers never
+	 * build or check the filter themselves, that is left to
+	 * lookups.
+	 */
+	if (bloom_map.header && g_atomic_int_get (&bloom_map.header->stale)) {
+		bloom_unmap (&bloom_map);
+	}
+
+	if ((!bloom_map.header && !bloom_open (&bloom_map)) ||
+	    !bloom_flock (LOCK_EX)) {
+		g_mutex_unlock (&bloom_lock);
+		return;
+	}
+
+	/* Replaced while we waited for the lock, rebuilds can't happen
+	 * while we hold it though.
+	 */
+	if (g_atomic_int_get (&bloom_map.header->stale)) {
+		bloom_unmap (&bloom_map);
+
+		if (!bloom_open (&bloom_map)) {
+			flock (bloom_lock_fd, LOCK_UN);
+			g_mutex_unlock (&bloom_lock);
+			return;
+		}
+	}
+
+	capacity = ((guint64) 1 << bloom_map.header->bits_log2) / BLOOM_BITS_PER_ITEM;
+
+	for (i = 0; i < n_paths; i++) {
+		if (exists[i]) {
+			bloom_add_name (&bloom_map, bloom_get_name (paths[i]));
+
+			if ((guint64) g_atomic_int_add (&bloom_map.header->n_items, 1) >= capacity) {
+				/* False positives pile up past this */
+				stale = TRUE;
+			}
+		}
+	}
+
+	/* Whatever changed the directory up to the time recorded is
+	 * in the filter, or about to be added by the libmediaart
+	 * writer which made the change. If @before is no later than
+	 * that, the changes since are ours or those of writers which
+	 * overlapped with us, so the time after our write can be
+	 * recorded. If it is later, somebody else changed the
+	 * directory before we started.
+	 */
+	if (before->mtime >= 0 &&
+	    bloom_stamp_compare (before->mtime, before->mtime_nsec,
+	                         bloom_map.header->dir_mtime,
+	                         bloom_map.header->dir_mtime_nsec) <= 0 &&
+	    bloom_stat_dir (&after.mtime, &after.mtime_nsec)) {
+		if (bloom_stamp_compare (after.mtime, after.mtime_nsec,
+		                         bloom_map.header->dir_mtime,
+		                         bloom_map.header->dir_mtime_nsec) > 0) {
+			bloom_map.header->dir_mtime = after.mtime;
+			bloom_map.header->dir_mtime_nsec = after.mtime_nsec;
+		}
+	} else {
+		g_debug ("Media art cache changed elsewhere, bloom filter is stale");
+		stale = TRUE;
+	}
+
+	/* The next lookup starts over */
+	if (stale) {
+		g_atomic_int_set (&bloom_map.header->stale, 1);
+	}
+
+	flock (bloom_lock_fd, LOCK_UN);
+
+	g_mutex_unlock (&bloom_lock);
+}
+
+/*
+ * media_art_bloom_rebuild:
+ *
+ * Rebuilds the filter from the cache directory, which forgets the
+ * entries removed since it was last built.
+ */
+void
+media_art_bloom_rebuild (void)
+{
+	g_mutex_lock (&bloom_lock);
+	bloom_build (TRUE);
+	g_mutex_unlock (&bloom_lock);
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __LIBMEDIAART_BLOOM_H__
+#define __LIBMEDIAART_BLOOM_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Modification time of the cache directory */
+typedef struct {
+	gint64 mtime;
+	gint64 mtime_nsec;
+} MediaArtBloomStamp;
+
+gboolean media_art_bloom_lookup  (const gchar               *path);
+void     media_art_bloom_stamp   (MediaArtBloomStamp        *stamp);
+void     media_art_bloom_update  (const gchar * const       *paths,
+                                  const gboolean            *exists,
+                                  guint                      n_paths,
+                                  const MediaArtBloomStamp  *before);
+void     media_art_bloom_rebuild (void);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_BLOOM_H__ */
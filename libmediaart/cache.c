@@ -26,7 +26,12 @@
 #include <glib/gstdio.h>
 #include <gio/gio.h>
 
+#include "bloom.h"
 #include "cache.h"
+#include "index.h"
+#include "placeholder.h"
+#include "readahead.h"
+#include "stats.h"
 
 /**
  * SECTION:cache
@@ -416,6 +421,260 @@ media_art_get_path (const gchar  *artist,
 	return TRUE;
 }
 
+/**
+ * media_art_get_path_for_uri:
+ * @uri: the URI of a media file
+ * @cache_path: (out) (transfer full) (allow-none): a string
+ * representing the path to the cache for this media art, or %NULL
+ *
+ * Looks up the media art stored for @uri by an earlier call to
+ * media_art_process_uri(), media_art_process_file() or
+ * media_art_process_buffer(), without having to know the artist and
+ * title it was processed with.
+ *
+ * Newly allocated data returned in @cache_path must be freed with
+ * g_free(). If there is no media art for @uri, or it has been removed
+ * since, @cache_path is set to %NULL.
+ *
+ * Returns: %TRUE if media art was found for @uri, otherwise %FALSE.
+ *
+ * Since: 1.10
+ */
+gboolean
+media_art_get_path_for_uri (const gchar  *uri,
+                            gchar       **cache_path)
+{
+	gchar *path;
+
+	g_return_val_if_fail (uri != NULL, FALSE);
+
+	path = media_art_index_lookup_uri (uri);
+
+	if (cache_path) {
+		*cache_path = path;
+	} else {
+		g_free (path);
+	}
+
+	return path != NULL;
+}
+
+/**
+ * media_art_exists:
+ * @artist: (allow-none): the artist
+ * @title: (allow-none): the title
+ * @prefix: (allow-none): the prefix, for example "album"
+ *
+ * Checks whether the cache has media art for @artist and @title,
+ * where media_art_get_path() says it would be.
+ *
+ * This is meant for views asking about many items at once, for
+ * example to decide which ones need a placeholder. An index of the
+ * cache shared between processes answers most misses without any
+ * i/o, and only likely hits are checked on disk.
+ *
+ * All string inputs must be valid UTF8. Use g_utf8_validate() if the
+ * input has not already been validated.
+ *
+ * Returns: %TRUE if media art exists, otherwise %FALSE.
+ *
+ * Since: 1.10
+ */
+gboolean
+media_art_exists (const gchar *artist,
+                  const gchar *title,
+                  const gchar *prefix)
+{
+	gchar *path = NULL;
+	gboolean exists;
+
+	g_return_val_if_fail (artist != NULL || title != NULL, FALSE);
+
+	media_art_get_path (artist, title, prefix, &path);
+
+	if (!path) {
+		return FALSE;
+	}
+
+	exists = media_art_bloom_lookup (path) &&
+	         g_file_test (path, G_FILE_TEST_EXISTS);
+	g_free (path);
+
+	return exists;
+}
+
+/**
+ * media_art_get_placeholder:
+ * @artist: (allow-none): the artist
+ * @title: (allow-none): the title
+ * @prefix: (allow-none): the prefix, for example "album"
+ * @blurhash: (out) (transfer full) (allow-none): a
+ * BlurHash (https://blurha.sh) of the media art, or
+ * %NULL
+ * @color: (out) (allow-none): the average colour of the media art, as
+ * 0xRRGGBB
+ *
+ * Gets a placeholder for the media art of @artist and @title, for
+ * views to show while the image itself loads. It is computed when
+ * the media art is processed, so this only reads a small index entry
+ * and never decodes the image.
+ *
+ * Newly allocated data returned in @blurhash must be freed with
+ * g_free().
+ *
+ * All string inputs must be valid UTF8. Use g_utf8_validate() if the
+ * input has not already been validated.
+ *
+ * Returns: %TRUE if a placeholder was found for the media art as it
+ * is now, otherwise %FALSE.
+ *
+ * Since: 1.10
+ */
+gboolean
+media_art_get_placeholder (const gchar  *artist,
+                           const gchar  *title,
+                           const gchar  *prefix,
+                           gchar       **blurhash,
+                           guint32      *color)
+{
+	gchar *path = NULL;
+	gboolean found;
+
+	g_return_val_if_fail (artist != NULL || title != NULL, FALSE);
+
+	if (blurhash) {
+		*blurhash = NULL;
+	}
+
+	media_art_get_path (artist, title, prefix, &path);
+
+	if (!path) {
+		return FALSE;
+	}
+
+	found = media_art_placeholder_lookup (path, blurhash, color);
+	g_free (path);
+
+	return found;
+}
+
+/**
+ * media_art_prefetch:
+ * @prefix: (allow-none): the prefix shared by all entries, for
+ * example "album"
+ * @artists: (array length=n_items) (allow-none): the artists, or
+ * %NULL
+ * @titles: (array length=n_items) (allow-none): the titles, or %NULL
+ * @n_items: the number of entries in @artists and @titles
+ *
+ * Asks for the cached media art of @n_items entries to be read into
+ * memory ahead of time, without returning any data. This is meant
+ * for views which are about to display media art, for example the
+ * next screenful of an album grid while the user scrolls.
+ *
+ * Entry @i is looked up the same way media_art_get_path() would
+ * look up @artists[@i] and @titles[@i]; either array can be %NULL or
+ * hold %NULL elements, but not both for the same entry. Duplicate
+ * entries, and those prefetched in the last few seconds, are
+ * skipped, and the reading happens in the background, so this
+ * function returns quickly.
+ * Entries without cached media art are ignored.
+ *
+ * All string inputs must be valid UTF8.
+ *
+ * Since: 1.10
+ */
+void
+media_art_prefetch (const gchar         *prefix,
+                    const gchar * const *artists,
+                    const gchar * const *titles,
+                    gsize                n_items)
+{
+	GHashTable *seen;
+	GPtrArray *paths;
+	gsize i;
+
+	g_return_if_fail (artists != NULL || titles != NULL || n_items == 0);
+
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+	paths = g_ptr_array_new_with_free_func (g_free);
+
+	for (i = 0; i < n_items; i++) {
+		const gchar *artist = artists ? artists[i] : NULL;
+		const gchar *title = titles ? titles[i] : NULL;
+		gchar *path = NULL;
+
+		if (!artist && !title) {
+			continue;
+		}
+
+		media_art_get_path (artist, title, prefix, &path);
+
+		if (!path || g_hash_table_contains (seen, path)) {
+			g_free (path);
+			continue;
+		}
+
+		g_hash_table_add (seen, path);
+		g_ptr_array_add (paths, path);
+	}
+
+	media_art_readahead_queue_files ((const gchar * const *) paths->pdata, paths->len);
+
+	g_hash_table_unref (seen);
+	g_ptr_array_unref (paths);
+}
+
+/**
+ * media_art_cache_get_stats:
+ * @stats: (out caller-allocates): return location for the statistics
+ * @error: location to store the error occurring, or %NULL to ignore
+ *
+ * Fills in @stats with the size and make-up of the media art cache.
+ *
+ * The figures are kept up to date as media art is processed and
+ * removed, so this is cheap however big the cache is, unlike listing
+ * it. The first call on an existing cache has to count it once, and
+ * changes made to the cache without libmediaart are only picked up
+ * by media_art_cache_gc().
+ *
+ * Returns: %TRUE on success, otherwise %FALSE where @error will be set.
+ *
+ * Since: 1.10
+ */
+gboolean
+media_art_cache_get_stats (MediaArtCacheStats  *stats,
+                           GError             **error)
+{
+	g_return_val_if_fail (stats != NULL, FALSE);
+
+	return media_art_stats_get (stats, error);
+}
+
+/**
+ * media_art_cache_gc:
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore.
+ * @error: location to store the error occurring, or %NULL to ignore
+ *
+ * Removes symlinks left dangling by media_art_remove() and temporary
+ * files left behind by interrupted processing from the media art
+ * cache, then recounts the statistics returned by
+ * media_art_cache_get_stats().
+ *
+ * This lists the whole cache, so it is meant to be run occasionally
+ * and from a thread where blocking is acceptable.
+ *
+ * Returns: #TRUE on success, otherwise #FALSE where @error will be set.
+ *
+ * Since: 1.10
+ */
+gboolean
+media_art_cache_gc (GCancellable  *cancellable,
+                    GError       **error)
+{
+	return media_art_stats_gc (cancellable, error);
+}
+
 /**
  * media_art_remove:
  * @artist: artist the media art belongs to
@@ -483,7 +742,7 @@ media_art_remove (const gchar   *artist,
 		media_art_get_path (artist, album, "album", &target);
 
 		if (target) {
-			if (g_unlink (target) != 0) {
+			if (media_art_stats_unlink (target) != 0) {
 				g_debug ("Could not delete file '%s'", target);
 			} else {
 				g_message ("Removed media-art for artist:'%s', album:'%s': deleting file '%s'",
@@ -498,7 +757,7 @@ media_art_remove (const gchar   *artist,
 		if (album) {
 			media_art_get_path (NULL, album, "album", &target);
 			if (target) {
-				if (g_unlink (target) != 0) {
+				if (media_art_stats_unlink (target) != 0) {
 					g_debug ("Could not delete file '%s'", target);
 				} else {
 					g_message ("Removed media-art for album:'%s': deleting file '%s'",
@@ -517,9 +776,14 @@ media_art_remove (const gchar   *artist,
 		     name = g_dir_read_name (dir)) {
 			gchar *target;
 
+			/* Not media art, see index.c */
+			if (name[0] == '.') {
+				continue;
+			}
+
 			target = g_build_filename (dirname, name, NULL);
 
-			if (g_unlink (target) != 0) {
+			if (media_art_stats_unlink (target) != 0) {
 				g_warning ("Could not delete file '%s'", target);
 				success = FALSE;
 			} else {
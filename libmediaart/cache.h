@@ -31,6 +31,33 @@
 
 G_BEGIN_DECLS
 
+/**
+ * MediaArtCacheStats:
+ * @entries: the number of media art files in the cache
+ * @bytes: the total size of those files, in bytes
+ * @links: the number of symlinks in the cache, each sharing the
+ * media art of another entry
+ * @orphans: the number of those symlinks whose target has been
+ * removed
+ * @last_gc_time: when media_art_cache_gc() last completed, in seconds
+ * since the Epoch, or 0 if it never did
+ *
+ * Statistics about the media art cache, see
+ * media_art_cache_get_stats().
+ *
+ * Since: 1.10
+ */
+typedef struct {
+	guint64 entries;
+	guint64 bytes;
+	guint64 links;
+	guint64 orphans;
+	gint64 last_gc_time;
+
+	/*< private >*/
+	gpointer padding[4];
+} MediaArtCacheStats;
+
 _LIBMEDIAART_EXTERN
 gchar *  media_art_strip_invalid_entities (const gchar          *original);
 
@@ -45,6 +72,32 @@ gboolean media_art_get_file               (const gchar          *artist,
                                            const gchar          *prefix,
                                            GFile               **cache_file);
 
+_LIBMEDIAART_EXTERN
+gboolean media_art_get_path_for_uri       (const gchar          *uri,
+                                           gchar               **cache_path);
+_LIBMEDIAART_EXTERN
+gboolean media_art_exists                 (const gchar          *artist,
+                                           const gchar          *title,
+                                           const gchar          *prefix);
+_LIBMEDIAART_EXTERN
+gboolean media_art_get_placeholder        (const gchar          *artist,
+                                           const gchar          *title,
+                                           const gchar          *prefix,
+                                           gchar               **blurhash,
+                                           guint32              *color);
+_LIBMEDIAART_EXTERN
+void     media_art_prefetch               (const gchar          *prefix,
+                                           const gchar * const  *artists,
+                                           const gchar * const  *titles,
+                                           gsize                 n_items);
+
+_LIBMEDIAART_EXTERN
+gboolean media_art_cache_get_stats        (MediaArtCacheStats   *stats,
+                                           GError              **error);
+_LIBMEDIAART_EXTERN
+gboolean media_art_cache_gc               (GCancellable         *cancellable,
+                                           GError              **error);
+
 _LIBMEDIAART_EXTERN
 gboolean media_art_remove                 (const gchar          *artist,
                                            const gchar          *album,
@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "embedded.h"
+
+/* Finds the picture embedded in the tags of a media file, for the
+ * folders media_art_process_tree() finds no image files in. Only the
+ * two tag formats which keep pictures at the start of the file are
+ * read, ID3v2 (MP3, mostly) and FLAC metadata blocks, so this never
+ * reads more than the tags themselves.
+ */
+
+/* Larger tags are not worth reading for a cover */
+#define EMBEDDED_MAX_SIZE (16 * 1024 * 1024)
+
+/* As in ID3v2 APIC frames and FLAC PICTURE blocks */
+#define EMBEDDED_FRONT_COVER 3
+
+#define ID3_HEADER_SIZE       10
+#define ID3_FLAG_UNSYNC       0x80
+#define ID3_FLAG_EXTENDED     0x40
+#define FLAC_BLOCK_LAST       0x80
+#define FLAC_BLOCK_PICTURE    6
+
+typedef struct {
+	GBytes *picture;
+	gchar *mime;
+	gboolean is_front_cover;
+} EmbeddedPicture;
+
+static guint32
+read_uint32_be (const guchar *data)
+{
+	return ((guint32) data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static guint32
+read_syncsafe (const guchar *data)
+{
+	return ((data[0] & 0x7f) << 21) | ((data[1] & 0x7f) << 14) |
+	       ((data[2] & 0x7f) << 7) | (data[3] & 0x7f);
+}
+
+/* Keeps the front cover, or else the first picture found */
+static void
+embedded_picture_offer (EmbeddedPicture *best,
+                        GBytes          *tag,
+                        gsize            offset,
+                        gsize            len,
+                        const gchar     *mime,
+                        gsize            mime_len,
+                        guint            picture_type)
+{
+	if (len == 0 || best->is_front_cover ||
+	    (best->picture && picture_type != EMBEDDED_FRONT_COVER)) {
+		return;
+	}
+
+	g_clear_pointer (&best->picture, g_bytes_unref);
+	g_free (best->mime);
+
+	best->picture = g_bytes_new_from_bytes (tag, offset, len);
+	best->is_front_cover = picture_type == EMBEDDED_FRONT_COVER;
+
+	/* A common misspelling, which the image backends don't know */
+	if (mime_len == 9 && g_ascii_strncasecmp (mime, "image/jpg", 9) == 0) {
+		best->mime = g_strdup ("image/jpeg");
+	} else {
+		best->mime = mime_len > 0 ? g_strndup (mime, mime_len) : NULL;
+	}
+}
+
+static GBytes *
+embedded_read_bytes (GInputStream  *stream,
+                     gsize          len,
+                     GCancellable  *cancellable,
+                     GError       **error)
+{
+	guchar *data;
+	gsize n_read;
+
+	data = g_malloc (len);
+
+	if (!g_input_stream_read_all (stream, data, len, &n_read, cancellable, error)) {
+		g_free (data);
+		return NULL;
+	}
+
+	if (n_read != len) {
+		/* Cut short, no point in reading on */
+		g_free (data);
+		return g_bytes_new (NULL, 0);
+	}
+
+	return g_bytes_new_take (data, len);
+}
+
+/* Parses one APIC frame: text encoding, MIME type, picture type,
+ * description, then the picture.
+ */
+static void
+id3_parse_apic (EmbeddedPicture *best,
+                GBytes          *tag,
+                gsize            offset,
+                gsize            len)
+{
+	const guchar *data, *frame, *end, *p;
+	const gchar *mime;
+	guint encoding, picture_type;
+
+	data = g_bytes_get_data (tag, NULL);
+	frame = data + offset;
+	end = frame + len;
+
+	if (len < 4) {
+		return;
+	}
+
+	encoding = frame[0];
+	mime = (const gchar *) frame + 1;
+	p = memchr (mime, '\0', end - (const guchar *) mime);
+
+	if (!p || p + 2 > end) {
+		return;
+	}
+
+	/* "-->" means the picture is only linked to */
+	if (strcmp (mime, "-->") == 0) {
+		return;
+	}
+
+	picture_type = p[1];
+	p += 2;
+
+	/* The description ends with a NUL in its own encoding */
+	if (encoding == 1 || encoding == 2) {
+		while (p + 1 < end && (p[0] != '\0' || p[1] != '\0')) {
+			p += 2;
+		}
+
+		p += 2;
+	} else {
+		while (p < end && *p != '\0') {
+			p++;
+		}
+
+		p++;
+	}
+
+	if (p >= end) {
+		return;
+	}
+
+	embedded_picture_offer (best,
+	                        tag,
+	                        p - data,
+	                        end - p,
+	                        mime,
+	                        strlen (mime),
+	                        picture_type);
+}
+
+static gboolean
+id3_read (GInputStream     *stream,
+          const guchar     *header,
+          EmbeddedPicture  *best,
+          GCancellable     *cancellable,
+          GError          **error)
+{
+	const guchar *data;
+	GBytes *tag;
+	guint version, flags;
+	gsize size, offset = 0;
+
+	version = header[3];
+	flags = header[5];
+	size = read_syncsafe (header + 6);
+
+	/* ID3v2.2 has its own frame layout, and tags which need
+	 * unsynchronising are rare enough not to bother.
+	 */
+	if (version < 3 || version > 4 ||
+	    (flags & ID3_FLAG_UNSYNC) != 0 ||
+	    size > EMBEDDED_MAX_SIZE) {
+		return TRUE;
+	}
+
+	tag = embedded_read_bytes (stream, size, cancellable, error);
+
+	if (!tag) {
+		return FALSE;
+	}
+
+	size = g_bytes_get_size (tag);
+	data = g_bytes_get_data (tag, NULL);
+
+	if ((flags & ID3_FLAG_EXTENDED) != 0 && size >= 4) {
+		/* ID3v2.3 leaves the size field out of the size */
+		offset = version == 3 ? 4 + read_uint32_be (data) : read_syncsafe (data);
+	}
+
+	while (offset + ID3_HEADER_SIZE <= size && data[offset] != '\0') {
+		const guchar *frame = data + offset;
+		gsize frame_size;
+
+		frame_size = version == 4 ? read_syncsafe (frame + 4) : read_uint32_be (frame + 4);
+
+		if (frame_size > size - offset - ID3_HEADER_SIZE) {
+			break;
+		}
+
+		/* Frames which are compressed, encrypted or otherwise
+		 * transformed are skipped.
+		 */
+		if (memcmp (frame, "APIC", 4) == 0 && frame[9] == 0) {
+			id3_parse_apic (best, tag, offset + ID3_HEADER_SIZE, frame_size);
+		}
+
+		offset += ID3_HEADER_SIZE + frame_size;
+	}
+
+	g_bytes_unref (tag);
+
+	return TRUE;
+}
+
+/* Parses one PICTURE block: picture type, MIME type, description,
+ * dimensions, then the picture.
+ */
+static void
+flac_parse_picture (EmbeddedPicture *best,
+                    GBytes          *block)
+{
+	const guchar *data;
+	gsize size, offset;
+	guint32 picture_type, mime_len, description_len, picture_len;
+
+	data = g_bytes_get_data (block, &size);
+
+	/* Each length is checked against what is left of the block
+	 * before anything after it is read.
+	 */
+	if (size < 8 + 4) {
+		return;
+	}
+
+	picture_type = read_uint32_be (data);
+	mime_len = read_uint32_be (data + 4);
+	offset = 8;
+
+	if (mime_len > size - offset - 4) {
+		return;
+	}
+
+	offset += mime_len;
+	description_len = read_uint32_be (data + offset);
+	offset += 4;
+
+	/* Then width, height, depth and number of colours */
+	if (description_len > size - offset ||
+	    size - offset - description_len < 16 + 4) {
+		return;
+	}
+
+	offset += description_len + 16;
+	picture_len = read_uint32_be (data + offset);
+	offset += 4;
+
+	if (picture_len > size - offset) {
+		return;
+	}
+
+	embedded_picture_offer (best,
+	                        block,
+	                        offset,
+	                        picture_len,
+	                        (const gchar *) data + 8,
+	                        mime_len,
+	                        picture_type);
+}
+
+static gboolean
+flac_read (GInputStream     *stream,
+           EmbeddedPicture  *best,
+           GCancellable     *cancellable,
+           GError          **error)
+{
+	guchar header[4];
+	gsize n_read;
+
+	do {
+		gsize len;
+
+		if (!g_input_stream_read_all (stream, header, sizeof (header), &n_read, cancellable, error)) {
+			return FALSE;
+		}
+
+		if (n_read != sizeof (header)) {
+			break;
+		}
+
+		len = (header[1] << 16) | (header[2] << 8) | header[3];
+
+		if ((header[0] & ~FLAC_BLOCK_LAST) == FLAC_BLOCK_PICTURE &&
+		    len <= EMBEDDED_MAX_SIZE) {
+			GBytes *block;
+
+			block = embedded_read_bytes (stream, len, cancellable, error);
+
+			if (!block) {
+				return FALSE;
+			}
+
+			flac_parse_picture (best, block);
+			g_bytes_unref (block);
+		} else if (g_input_stream_skip (stream, len, cancellable, error) < 0) {
+			return FALSE;
+		}
+	} while ((header[0] & FLAC_BLOCK_LAST) == 0 && !best->is_front_cover);
+
+	return TRUE;
+}
+
+/*
+ * media_art_embedded_read_stream:
+ * @stream: the contents of a media file, from its start
+ * @picture: (out): return location for the picture
+ * @mime: (out): return location for its MIME type, which may be %NULL
+ * @cancellable: (allow-none): optional #GCancellable object
+ * @error: a #GError location, or %NULL
+ *
+ * Like media_art_embedded_read(), FLAC is only read from seekable
+ * streams.
+ */
+gboolean
+media_art_embedded_read_stream (GInputStream  *stream,
+                                GBytes       **picture,
+                                gchar        **mime,
+                                GCancellable  *cancellable,
+                                GError       **error)
+{
+	EmbeddedPicture best = { NULL, NULL, FALSE };
+	guchar header[ID3_HEADER_SIZE];
+	gboolean retval = TRUE;
+	gsize n_read;
+
+	*picture = NULL;
+	*mime = NULL;
+
+	if (!g_input_stream_read_all (stream,
+	                              header,
+	                              sizeof (header),
+	                              &n_read,
+	                              cancellable,
+	                              error)) {
+		retval = FALSE;
+	} else if (n_read == sizeof (header) && memcmp (header, "ID3", 3) == 0) {
+		retval = id3_read (stream, header, &best, cancellable, error);
+	} else if (n_read == sizeof (header) && memcmp (header, "fLaC", 4) == 0) {
+		/* The first block header is already in @header */
+		if (!G_IS_SEEKABLE (stream) || !g_seekable_can_seek (G_SEEKABLE (stream))) {
+			g_debug ("Not looking for pictures in FLAC stream which can't seek");
+		} else if (g_seekable_seek (G_SEEKABLE (stream), 4, G_SEEK_SET, cancellable, error)) {
+			retval = flac_read (stream, &best, cancellable, error);
+		} else {
+			retval = FALSE;
+		}
+	}
+
+	if (!retval || !best.picture) {
+		g_clear_pointer (&best.picture, g_bytes_unref);
+		g_free (best.mime);
+
+		return FALSE;
+	}
+
+	*picture = best.picture;
+	*mime = best.mime;
+
+	return TRUE;
+}
+
+/*
+ * media_art_embedded_read:
+ * @file: a media file
+ * @picture: (out): return location for the picture
+ * @mime: (out): return location for its MIME type, which may be %NULL
+ * @cancellable: (allow-none): optional #GCancellable object
+ * @error: a #GError location, or %NULL
+ *
+ * Reads the picture embedded in the tags of @file, preferring the
+ * front cover if there are several.
+ *
+ * Returns: %TRUE if a picture was found. %FALSE if not, in which case
+ * @error is only set if @file could not be read.
+ */
+gboolean
+media_art_embedded_read (GFile         *file,
+                         GBytes       **picture,
+                         gchar        **mime,
+                         GCancellable  *cancellable,
+                         GError       **error)
+{
+	GFileInputStream *stream;
+	gboolean retval;
+
+	*picture = NULL;
+	*mime = NULL;
+
+	stream = g_file_read (file, cancellable, error);
+
+	if (!stream) {
+		return FALSE;
+	}
+
+	retval = media_art_embedded_read_stream (G_INPUT_STREAM (stream),
+	                                         picture,
+	                                         mime,
+	                                         cancellable,
+	                                         error);
+	g_object_unref (stream);
+
+	return retval;
+}
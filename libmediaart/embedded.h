@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LIBMEDIAART_EMBEDDED_H__
+#define __LIBMEDIAART_EMBEDDED_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+gboolean media_art_embedded_read        (GFile         *file,
+                                         GBytes       **picture,
+                                         gchar        **mime,
+                                         GCancellable  *cancellable,
+                                         GError       **error);
+gboolean media_art_embedded_read_stream (GInputStream  *stream,
+                                         GBytes       **picture,
+                                         gchar        **mime,
+                                         GCancellable  *cancellable,
+                                         GError       **error);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_EMBEDDED_H__ */
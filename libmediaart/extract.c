@@ -19,16 +19,30 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <utime.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 
+#include "embedded.h"
 #include "extractgeneric.h"
-
+#include "extractprivate.h"
+#include "index.h"
+#include "keycache.h"
+#include "placeholder.h"
+#include "pool.h"
+#include "quarantine.h"
+#include "readahead.h"
+#include "scheduler.h"
+#include "stats.h"
+
+#include "arena.h"
+#include "batch.h"
 #include "extract.h"
 #include "cache.h"
 
@@ -66,10 +80,50 @@
 
 typedef struct {
 	gboolean disable_requests;
+	guint job_timeout;
+	gboolean shared_cache;
+
+	/* Jobs run in worker threads, and cache hits are checked
+	 * on the caller's thread too, the cache has its own lock.
+	 */
+	MediaArtKeyCache *media_art_cache;
 
-	GHashTable *media_art_cache;
+	/* Set once, see media_art_process_set_batch_func() */
+	MediaArtBatch *batch;
 } MediaArtProcessPrivate;
 
+typedef struct {
+	/* Jobs nest (process_uri() calls process_file(), for
+	 * example), only the outermost one sets the deadline.
+	 */
+	guint depth;
+	gint64 deadline;
+} JobDeadline;
+
+enum {
+	PROP_0,
+	PROP_JOB_TIMEOUT,
+	PROP_SHARED_CACHE
+};
+
+static GPrivate job_deadline = G_PRIVATE_INIT (g_free);
+
+/* Directory entries read between deadline checks */
+#define DIR_CHECKPOINT_INTERVAL 64
+
+/* Non-native directories: how long a listing is reused, how many are
+ * kept, and the largest media art we copy over before using it.
+ */
+#define REMOTE_LISTING_TTL      (60 * G_TIME_SPAN_SECOND)
+#define REMOTE_LISTING_MAX      64
+#define REMOTE_ART_MAX_SIZE     (16 * 1024 * 1024)
+#define REMOTE_READ_CHUNK_SIZE  (64 * 1024)
+
+/* Difference hash of covers, see media_art_file_get_dhash() */
+#define DHASH_WIDTH        9
+#define DHASH_HEIGHT       8
+#define DHASH_MAX_DISTANCE 6
+
 static const gchar *media_art_type_name[MEDIA_ART_TYPE_COUNT] = {
 	"invalid",
 	"album",
@@ -77,12 +131,19 @@ static const gchar *media_art_type_name[MEDIA_ART_TYPE_COUNT] = {
 };
 
 typedef struct {
-	gchar *uri;
+	const gchar *uri;
 	MediaArtType type;
-	gchar *artist_strdown;
-	gchar *title_strdown;
+	const gchar *artist_strdown;
+	const gchar *title_strdown;
 } MediaArtSearch;
 
+typedef struct _ImageCandidate ImageCandidate;
+
+struct _ImageCandidate {
+	ImageCandidate *next;
+	const gchar *name;
+};
+
 typedef enum {
 	IMAGE_MATCH_EXACT = 0,
 	IMAGE_MATCH_EXACT_SMALL = 1,
@@ -91,6 +152,35 @@ typedef enum {
 } ImageMatchType;
 
 typedef struct {
+	ImageCandidate *list[IMAGE_MATCH_TYPE_COUNT];
+	guint count[IMAGE_MATCH_TYPE_COUNT];
+} ImageCandidates;
+
+/* Directory listings of non-native locations (GVfs mounts, for
+ * example), shared by the tracks of an album.
+ */
+typedef struct {
+	GPtrArray *names;
+	gint64 time;
+} RemoteListing;
+
+static GMutex remote_listings_lock;
+static GHashTable *remote_listings;
+
+/* What a queued job processes; buffer jobs carry their related file
+ * in ProcessData.file too, so it can't be told from the fields alone.
+ */
+typedef enum {
+	PROCESS_KIND_FILE,
+	PROCESS_KIND_URI,
+	PROCESS_KIND_BUFFER
+} ProcessKind;
+
+typedef struct {
+	/* Owns everything below, except file */
+	MediaArtArena *arena;
+
+	ProcessKind kind;
 	MediaArtType type;
 	MediaArtProcessFlags flags;
 
@@ -103,6 +193,9 @@ typedef struct {
 
 	gchar *artist;
 	gchar *title;
+
+	/* For batched results, which have no GTask to carry it */
+	gpointer user_data;
 } ProcessData;
 
 static void media_art_process_initable_iface_init (GInitableIface *iface);
@@ -122,10 +215,14 @@ media_art_process_finalize (GObject *object)
 	private = media_art_process_get_instance_private (process);
 
 	if (private->media_art_cache) {
-		g_hash_table_unref (private->media_art_cache);
+		media_art_key_cache_unref (private->media_art_cache);
 	}
 
-	media_art_plugin_shutdown ();
+	if (private->batch) {
+		media_art_batch_free (private->batch);
+	}
+
+	media_art_pool_unref ();
 
 	G_OBJECT_CLASS (media_art_process_parent_class)->finalize (object);
 }
@@ -145,13 +242,16 @@ media_art_process_initable_init (GInitable     *initable,
 
 	g_debug ("Initializing media art processing requirements...");
 
-	media_art_plugin_init (0);
+	/* The image backend is set up on first use, see
+	 * media_art_backend_ensure().
+	 */
 
 	/* Cache to know if we have already handled uris */
-	private->media_art_cache = g_hash_table_new_full (g_str_hash,
-	                                                  g_str_equal,
-	                                                  (GDestroyNotify) g_free,
-	                                                  NULL);
+	if (private->shared_cache) {
+		private->media_art_cache = media_art_key_cache_get_shared ();
+	} else {
+		private->media_art_cache = media_art_key_cache_new (0);
+	}
 
 	/* Returns 0 if already exists, so we don't check if directory
 	 * existed before, it's an additional stat() call we just
@@ -180,17 +280,117 @@ media_art_process_initable_iface_init (GInitableIface *iface)
 	iface->init = media_art_process_initable_init;
 }
 
+static void
+media_art_process_set_property (GObject      *object,
+                                guint         prop_id,
+                                const GValue *value,
+                                GParamSpec   *pspec)
+{
+	MediaArtProcessPrivate *private;
+
+	private = media_art_process_get_instance_private (MEDIA_ART_PROCESS (object));
+
+	switch (prop_id) {
+	case PROP_JOB_TIMEOUT:
+		private->job_timeout = g_value_get_uint (value);
+		break;
+	case PROP_SHARED_CACHE:
+		private->shared_cache = g_value_get_boolean (value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+media_art_process_get_property (GObject    *object,
+                                guint       prop_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+	MediaArtProcessPrivate *private;
+
+	private = media_art_process_get_instance_private (MEDIA_ART_PROCESS (object));
+
+	switch (prop_id) {
+	case PROP_JOB_TIMEOUT:
+		g_value_set_uint (value, private->job_timeout);
+		break;
+	case PROP_SHARED_CACHE:
+		g_value_set_boolean (value, private->shared_cache);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
 static void
 media_art_process_class_init (MediaArtProcessClass *klass)
 {
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
 	object_class->finalize = media_art_process_finalize;
+	object_class->set_property = media_art_process_set_property;
+	object_class->get_property = media_art_process_get_property;
+
+	/**
+	 * MediaArtProcess:job-timeout:
+	 *
+	 * The time in milliseconds a single processing job (one call
+	 * to media_art_process_file() or similar, or one async request
+	 * once it starts running) may take, or 0 for no limit.
+	 *
+	 * The limit is enforced between the steps of a job and while
+	 * reading, hashing or converting images. A job that runs out of
+	 * time fails with %G_IO_ERROR_TIMED_OUT and leaves the cache as
+	 * it was, so it can be retried later, for example at a lower
+	 * priority.
+	 *
+	 * Since: 1.10
+	 */
+	g_object_class_install_property (object_class,
+	                                 PROP_JOB_TIMEOUT,
+	                                 g_param_spec_uint ("job-timeout",
+	                                                    "Job timeout",
+	                                                    "Time limit for a single job in milliseconds, 0 for none",
+	                                                    0, G_MAXUINT, 0,
+	                                                    G_PARAM_READWRITE |
+	                                                    G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MediaArtProcess:shared-cache:
+	 *
+	 * Whether to share what this instance learns about media art
+	 * found next to media files with every other #MediaArtProcess
+	 * in the process which has this property set, instead of
+	 * keeping it to itself.
+	 *
+	 * Applications creating several instances, for example one for
+	 * importing and one for refreshing what is on screen, should set
+	 * this so they don't look into the same folders over again. The
+	 * shared cache is freed along with the last instance using it,
+	 * and is limited in size, unlike the private one.
+	 *
+	 * Since: 1.10
+	 */
+	g_object_class_install_property (object_class,
+	                                 PROP_SHARED_CACHE,
+	                                 g_param_spec_boolean ("shared-cache",
+	                                                       "Shared cache",
+	                                                       "Whether to share the heuristic cache with other instances",
+	                                                       FALSE,
+	                                                       G_PARAM_READWRITE |
+	                                                       G_PARAM_CONSTRUCT_ONLY |
+	                                                       G_PARAM_STATIC_STRINGS));
 }
 
 static void
 media_art_process_init (MediaArtProcess *thumbnailer)
 {
+	/* Buffers are kept around for reuse while we exist */
+	media_art_pool_ref ();
 }
 
 /**
@@ -199,7 +399,9 @@ media_art_process_init (MediaArtProcess *thumbnailer)
  *
  * Initialize a GObject for processing and extracting media art.
  *
- * This function initializes cache hash tables and backend plugins,
+ * This function initializes cache hash tables. The image backend
+ * plugin is only initialized once media art is actually decoded or
+ * encoded, so looking up cached media art stays cheap.
  *
  * Returns: A new #MediaArtProcess object on success or %NULL if
  * @error is set. This object must be freed using g_object_unref().
@@ -212,10 +414,66 @@ media_art_process_new (GError **error)
 	return g_initable_new (MEDIA_ART_TYPE_PROCESS, NULL, error, NULL);
 }
 
+/**
+ * media_art_process_set_batch_func:
+ * @process: Media art process object
+ * @max_results: how many results to gather before delivering them
+ * @max_delay: the longest time in milliseconds a result waits for
+ * others to be delivered with
+ * @func: (scope notified): a #MediaArtBatchFunc to deliver results to
+ * @user_data: (closure): the data to pass to @func
+ * @notify: (allow-none): a #GDestroyNotify for @user_data, or %NULL
+ *
+ * Has the results of asynchronous requests made with @process from
+ * now on delivered to @func in batches, instead of completing each
+ * request with its own callback. This spares the caller's main loop
+ * a dispatch for every request, which adds up when importing a large
+ * collection.
+ *
+ * Results are delivered in the thread-default main context of the
+ * thread calling this function, as soon as @max_results of them are
+ * waiting, or @max_delay milliseconds after the first of them came
+ * in. Each result carries the user data given to
+ * media_art_process_file_async() (or any of the other asynchronous
+ * calls, or their submit variants), whose callback is not called.
+ * There is no #GAsyncResult to finish either.
+ *
+ * This can only be set once for a given @process, before making
+ * any asynchronous requests with it. @notify is called when
+ * @process is finalized.
+ *
+ * Since: 1.10
+ */
+void
+media_art_process_set_batch_func (MediaArtProcess   *process,
+                                  guint              max_results,
+                                  guint              max_delay,
+                                  MediaArtBatchFunc  func,
+                                  gpointer           user_data,
+                                  GDestroyNotify     notify)
+{
+	MediaArtProcessPrivate *private;
+
+	g_return_if_fail (MEDIA_ART_IS_PROCESS (process));
+	g_return_if_fail (func != NULL);
+
+	private = media_art_process_get_instance_private (process);
+
+	g_return_if_fail (private->batch == NULL);
+
+	private->batch = media_art_batch_new (process,
+	                                      max_results,
+	                                      max_delay,
+	                                      func,
+	                                      user_data,
+	                                      notify);
+}
+
 static GDir *
-get_parent_g_dir (const gchar  *uri,
-                  gchar       **dirname,
-                  GError      **error)
+get_parent_g_dir (MediaArtArena  *arena,
+                  const gchar    *uri,
+                  const gchar   **dirname,
+                  GError        **error)
 {
 	GFile *file, *dirf;
 	GDir *dir;
@@ -228,20 +486,31 @@ get_parent_g_dir (const gchar  *uri,
 	dirf = g_file_get_parent (file);
 
 	if (dirf) {
-		*dirname = g_file_get_path (dirf);
+		*dirname = media_art_arena_take (arena, g_file_get_path (dirf), g_free);
 		g_object_unref (dirf);
 	}
 
-	g_object_unref (file);
-
 	if (*dirname == NULL) {
-		*error = g_error_new (G_FILE_ERROR,
-		                      G_FILE_ERROR_EXIST,
-		                      "No parent directory found for '%s'",
-		                      uri);
+		if (!g_file_is_native (file)) {
+			/* See media_art_find_remote() */
+			*error = g_error_new (G_IO_ERROR,
+			                      G_IO_ERROR_NOT_SUPPORTED,
+			                      "Parent directory of '%s' is not local",
+			                      uri);
+		} else {
+			*error = g_error_new (G_FILE_ERROR,
+			                      G_FILE_ERROR_EXIST,
+			                      "No parent directory found for '%s'",
+			                      uri);
+		}
+
+		g_object_unref (file);
+
 		return NULL;
 	}
 
+	g_object_unref (file);
+
 	dir = g_dir_open (*dirname, 0, error);
 
 	return dir;
@@ -267,182 +536,695 @@ checksum_for_data (GChecksumType  checksum_type,
 	return retval;
 }
 
+/* Sets up the image backend the first time something is decoded or
+ * encoded. It is not cheap (the Qt backend creates a
+ * QCoreApplication), and clients which only look up cached media art
+ * never need it. It stays up until the process exits, both backends
+ * shut down to nothing anyway.
+ */
+static void
+media_art_backend_ensure (void)
+{
+	static gsize initialized = 0;
+
+	if (g_once_init_enter (&initialized)) {
+		g_debug ("Initializing media art image backend...");
+		media_art_plugin_init (0);
+		g_once_init_leave (&initialized, 1);
+	}
+}
+
+/* Computes a 64 bit difference hash ("dHash") of the image at @path:
+ * the image is shrunk to 9x8 grey pixels and each bit records whether
+ * a pixel is brighter than its right hand neighbour. Re-encoding or
+ * retagging a cover barely changes it, unlike its MD5 sum.
+ */
 static gboolean
-file_get_checksum_if_exists (GChecksumType   checksum_type,
-                             const gchar    *path,
-                             gchar         **md5,
-                             gboolean        check_jpeg,
-                             gboolean       *is_jpeg,
-                             GError        **error)
+media_art_file_get_dhash (const gchar  *path,
+                          guint64      *dhash,
+                          GError      **error)
 {
-	GFile *file;
-	GFileInputStream *stream;
-	GChecksum *checksum;
-	GError *local_error = NULL;
-	gssize rsize;
-	guchar buffer[1024];
-	gboolean stop = FALSE;
+	guchar pixels[DHASH_WIDTH * DHASH_HEIGHT * 3];
+	guint luma[DHASH_WIDTH];
+	guint64 hash = 0;
+	gint x, y;
 
-	file = g_file_new_for_path (path);
-	stream = g_file_read (file, NULL, &local_error);
+	media_art_backend_ensure ();
 
-	if (local_error) {
-		g_object_unref (file);
-		g_propagate_error (error, local_error);
+	if (!media_art_file_to_rgb (path, DHASH_WIDTH, DHASH_HEIGHT, pixels, error)) {
 		return FALSE;
 	}
 
-	if (!stream) {
-		g_set_error (error,
-		             g_io_error_quark (),
-		             G_IO_ERROR_FAILED,
-		             "Could not calculate MD5 checksum for '%s', g_file_read() gave no error either?!",
-		             path);
-		g_object_unref (file);
-		return FALSE;
+	for (y = 0; y < DHASH_HEIGHT; y++) {
+		for (x = 0; x < DHASH_WIDTH; x++) {
+			const guchar *p = pixels + (y * DHASH_WIDTH + x) * 3;
+
+			/* ITU-R BT.601 weights, in fixed point */
+			luma[x] = 77 * p[0] + 150 * p[1] + 29 * p[2];
+		}
+
+		for (x = 0; x < DHASH_WIDTH - 1; x++) {
+			hash = (hash << 1) | (luma[x] > luma[x + 1]);
+		}
 	}
 
-	checksum = g_checksum_new (checksum_type);
+	*dhash = hash;
 
-	if (!checksum) {
-		g_set_error (error,
-		             g_io_error_quark (),
-		             G_IO_ERROR_FAILED,
-		             "Could not calculate MD5 checksum for '%s', g_checksum_new() failed",
-		             path);
-		g_object_unref (file);
-		g_object_unref (stream);
+	return TRUE;
+}
+
+/* Returns the dHash of the album cover at @album_path. It is kept in
+ * the index next to the cover's mtime, so each album cover is only
+ * decoded once however many tracks get compared against it.
+ */
+static gboolean
+album_get_dhash (const gchar *album_path,
+                 guint64     *dhash)
+{
+	GStatBuf st;
+	gchar *key, *value;
+	guint64 mtime;
+	gboolean retval = FALSE;
+
+	if (g_stat (album_path, &st) != 0) {
 		return FALSE;
 	}
 
-	/* File exists & readable always means true retval */
-	if (check_jpeg) {
-		if (g_input_stream_read_all (G_INPUT_STREAM (stream),
-		                             buffer,
-		                             3,
-		                             (gsize *) &rsize,
-		                             NULL,
-		                             NULL)) {
-			if (rsize >= 3 &&
-			    buffer[0] == 0xff &&
-			    buffer[1] == 0xd8 &&
-			    buffer[2] == 0xff) {
-				if (is_jpeg) {
-					*is_jpeg = TRUE;
-				}
+	key = g_path_get_basename (album_path);
+	value = _media_art_index_get_value ("phash", key);
 
-				/* Add the read bytes to the checksum */
-				g_checksum_update (checksum, buffer, rsize);
-			} else {
-				/* Larger than 3 bytes but incorrect jpeg header */
-				if (is_jpeg) {
-					*is_jpeg = FALSE;
-				}
+	if (value &&
+	    sscanf (value, "%" G_GINT64_MODIFIER "x-%" G_GUINT64_FORMAT, dhash, &mtime) == 2 &&
+	    mtime == (guint64) st.st_mtime) {
+		retval = TRUE;
+	} else if (media_art_file_get_dhash (album_path, dhash, NULL)) {
+		gchar *new_value;
 
-				stop = TRUE;
-			}
-		} else {
-			/* Smaller than 3 bytes, not a jpeg */
-			if (is_jpeg) {
-				*is_jpeg = FALSE;
-			}
+		new_value = g_strdup_printf ("%016" G_GINT64_MODIFIER "x-%" G_GUINT64_FORMAT,
+		                             *dhash,
+		                             (guint64) st.st_mtime);
+		_media_art_index_set_value ("phash", key, new_value);
+		g_free (new_value);
 
-			stop = TRUE;
-		}
+		retval = TRUE;
 	}
 
-	if (!stop) {
-		while ((rsize = g_input_stream_read (G_INPUT_STREAM (stream),
-		                                     buffer,
-		                                     1024,
-		                                     NULL,
-		                                     NULL)) > 0) {
-			g_checksum_update (checksum, buffer, rsize);
-		}
+	g_free (value);
+	g_free (key);
 
-		if (md5) {
-			*md5 = g_strdup (g_checksum_get_string (checksum));
-		}
+	return retval;
+}
+
+/* Whether the image at @path looks the same as the album cover at
+ * @album_path, even if their bytes differ.
+ */
+static gboolean
+media_art_looks_like_album (const gchar *album_path,
+                            const gchar *path)
+{
+	guint64 album_hash, hash, bits;
+	guint distance = 0;
+
+	if (!album_get_dhash (album_path, &album_hash) ||
+	    !media_art_file_get_dhash (path, &hash, NULL)) {
+		return FALSE;
 	}
 
-	g_object_unref (stream);
-	g_checksum_free (checksum);
-	g_object_unref (file);
+	for (bits = album_hash ^ hash; bits; bits &= bits - 1) {
+		distance++;
+	}
 
-	return TRUE;
+	g_debug ("Perceptual distance from '%s' to '%s' is %u",
+	         path,
+	         album_path,
+	         distance);
+
+	return distance <= DHASH_MAX_DISTANCE;
 }
 
-static gboolean
-convert_from_other_format (const gchar  *found,
-                           const gchar  *target,
-                           const gchar  *album_path,
-                           const gchar  *artist,
-                           GError      **error)
+static JobDeadline *
+job_deadline_get (void)
 {
-	GError *local_error = NULL;
-	gboolean retval;
-	gchar *sum1 = NULL;
-	gchar *sum2 = NULL;
-	gchar *target_temp;
+	JobDeadline *deadline;
 
-	target_temp = g_strdup_printf ("%s-tmp", target);
+	deadline = g_private_get (&job_deadline);
 
-	media_art_file_to_jpeg (found, target_temp, &local_error);
+	if (!deadline) {
+		deadline = g_new0 (JobDeadline, 1);
+		g_private_set (&job_deadline, deadline);
+	}
 
-	if (local_error) {
-		g_propagate_error (error, local_error);
-		g_unlink (target_temp);
-		g_free (target_temp);
-		return FALSE;
+	return deadline;
+}
+
+static void
+job_deadline_push (MediaArtProcess *process)
+{
+	MediaArtProcessPrivate *private;
+	JobDeadline *deadline;
+
+	private = media_art_process_get_instance_private (process);
+	deadline = job_deadline_get ();
+
+	if (deadline->depth++ > 0) {
+		return;
 	}
 
-	/* If artist doesn't exist, try to rename temp file to album path */
-	if (artist == NULL || g_strcmp0 (artist, " ") == 0) {
-		retval = g_rename (target_temp, album_path) == 0;
+	if (private->job_timeout > 0) {
+		deadline->deadline = g_get_monotonic_time () +
+			(gint64) private->job_timeout * G_TIME_SPAN_MILLISECOND;
+	} else {
+		deadline->deadline = 0;
+	}
+}
 
-		if (!retval) {
-			g_set_error (error,
-			             media_art_error_quark (),
-			             MEDIA_ART_ERROR_RENAME_FAILED,
-			             "Could not rename '%s' to '%s': %s",
-			             target_temp,
-			             album_path,
-			             g_strerror (errno));
-			g_unlink (target_temp);
-		}
+static void
+job_deadline_pop (void)
+{
+	JobDeadline *deadline;
 
-		g_debug ("Renaming ('%s' --> '%s'), %s",
-		         target_temp,
-		         album_path,
-		         !retval ? g_strerror (errno) : "no error given");
+	deadline = job_deadline_get ();
 
-		g_free (target_temp);
+	if (--deadline->depth == 0) {
+		deadline->deadline = 0;
+	}
+}
 
-		return retval;
+/* Called between the steps of a job, and from inside the
+ * chunked loops of the long ones.
+ */
+gboolean
+media_art_job_checkpoint (GCancellable  *cancellable,
+                          GError       **error)
+{
+	JobDeadline *deadline;
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+		return FALSE;
 	}
 
-	/* Checksum both temp file and album path and decide what to
-	 * do base on what we find...
-	 */
-	file_get_checksum_if_exists (G_CHECKSUM_MD5,
-	                             target_temp,
-	                             &sum1,
-	                             FALSE,
-	                             NULL,
-	                             &local_error);
+	deadline = g_private_get (&job_deadline);
 
-	if (local_error) {
-		g_propagate_error (error, local_error);
-		g_unlink (target_temp);
-		g_free (target_temp);
+	if (deadline && deadline->deadline > 0 &&
+	    g_get_monotonic_time () > deadline->deadline) {
+		g_set_error (error,
+		             G_IO_ERROR,
+		             G_IO_ERROR_TIMED_OUT,
+		             "Media art job ran out of time");
 		return FALSE;
 	}
 
-	file_get_checksum_if_exists (G_CHECKSUM_MD5,
+	return TRUE;
+}
+
+#define JPEG_SOI  0xd8
+#define JPEG_EOI  0xd9
+#define JPEG_SOS  0xda
+#define JPEG_RST0 0xd0
+#define JPEG_RST7 0xd7
+#define JPEG_TEM  0x01
+#define JPEG_APP2 0xe2
+
+#define JPEG_IS_RST(m) ((m) >= JPEG_RST0 && (m) <= JPEG_RST7)
+
+/* How much of a JPEG file is searched for its colour profile, enough
+ * for the APP segments which come before it in practice.
+ */
+#define JPEG_ICC_SEARCH_SIZE (256 * 1024)
+
+/* Frame headers, all of 0xc0-0xcf but DHT, JPG and DAC */
+#define JPEG_IS_SOF(m) ((m) >= 0xc0 && (m) <= 0xcf && \
+                        (m) != 0xc4 && (m) != 0xc8 && (m) != 0xcc)
+
+/* Walks the marker segments of the JPEG in @buffer, without decoding
+ * any image data, to tell whether it can be stored as it is. It has
+ * to start with SOI, describe a frame (SOF) before its first scan
+ * (SOS) and end with EOI, anything after that is ignored.
+ *
+ * Images cut short by broken taggers are MEDIA_ART_JPEG_TRUNCATED if
+ * at least one scan started: decoders cope with the first @valid_len
+ * bytes followed by an EOI, which media_art_jpeg_save() adds.
+ */
+MediaArtJpegCheck
+media_art_jpeg_check (const unsigned char *buffer,
+                      size_t               len,
+                      size_t              *valid_len)
+{
+	gboolean scanned = FALSE;
+	gboolean framed = FALSE;
+	size_t pos, segment;
+
+	*valid_len = 0;
+
+	if (!buffer || len < 4 || buffer[0] != 0xff || buffer[1] != JPEG_SOI) {
+		return MEDIA_ART_JPEG_INVALID;
+	}
+
+	pos = 2;
+
+	for (;;) {
+		unsigned char marker;
+		size_t length;
+
+		segment = pos;
+
+		if (pos >= len) {
+			goto cut_short;
+		}
+
+		if (buffer[pos] != 0xff) {
+			return MEDIA_ART_JPEG_INVALID;
+		}
+
+		/* Markers may be preceded by any number of fill bytes */
+		while (pos < len && buffer[pos] == 0xff) {
+			pos++;
+		}
+
+		if (pos >= len) {
+			goto cut_short;
+		}
+
+		marker = buffer[pos++];
+
+		if (marker == JPEG_EOI) {
+			if (!scanned) {
+				return MEDIA_ART_JPEG_INVALID;
+			}
+
+			*valid_len = len;
+			return MEDIA_ART_JPEG_VALID;
+		}
+
+		if (marker == JPEG_TEM || JPEG_IS_RST (marker)) {
+			continue;
+		}
+
+		if (marker == 0x00 || marker == JPEG_SOI) {
+			return MEDIA_ART_JPEG_INVALID;
+		}
+
+		if (pos + 2 > len) {
+			goto cut_short;
+		}
+
+		length = (buffer[pos] << 8) | buffer[pos + 1];
+
+		if (length < 2) {
+			return MEDIA_ART_JPEG_INVALID;
+		}
+
+		if (pos + length > len) {
+			goto cut_short;
+		}
+
+		if (JPEG_IS_SOF (marker)) {
+			guint width, n_components;
+
+			/* Precision, height, width, components, then
+			 * three bytes for each component.
+			 */
+			if (length < 8) {
+				return MEDIA_ART_JPEG_INVALID;
+			}
+
+			width = (buffer[pos + 5] << 8) | buffer[pos + 6];
+			n_components = buffer[pos + 7];
+
+			if (width == 0 || n_components == 0 ||
+			    length != 8 + 3 * n_components) {
+				return MEDIA_ART_JPEG_INVALID;
+			}
+
+			framed = TRUE;
+		}
+
+		pos += length;
+
+		if (marker != JPEG_SOS) {
+			continue;
+		}
+
+		if (!framed) {
+			return MEDIA_ART_JPEG_INVALID;
+		}
+
+		scanned = TRUE;
+
+		/* Skip the entropy coded data up to the next marker,
+		 * where 0xff is only followed by a stuffed zero or a
+		 * restart marker.
+		 */
+		for (;;) {
+			const unsigned char *p;
+
+			p = memchr (buffer + pos, 0xff, len - pos);
+
+			if (!p || p + 1 >= buffer + len) {
+				*valid_len = len;
+				return MEDIA_ART_JPEG_TRUNCATED;
+			}
+
+			pos = p - buffer;
+
+			if (p[1] == 0x00 || JPEG_IS_RST (p[1])) {
+				pos += 2;
+			} else if (p[1] == 0xff) {
+				pos += 1;
+			} else {
+				break;
+			}
+		}
+	}
+
+cut_short:
+	/* Keep the scans we have, without the partial segment */
+	if (!scanned) {
+		return MEDIA_ART_JPEG_INVALID;
+	}
+
+	*valid_len = segment;
+
+	return MEDIA_ART_JPEG_TRUNCATED;
+}
+
+/* Stores the JPEG in @buffer at @target, as checked by
+ * media_art_jpeg_check(), terminating it if it was truncated.
+ */
+gboolean
+media_art_jpeg_save (const unsigned char  *buffer,
+                     size_t                valid_len,
+                     MediaArtJpegCheck     check,
+                     const gchar          *target,
+                     GError              **error)
+{
+	gchar *repaired;
+	gboolean retval;
+
+	g_return_val_if_fail (check != MEDIA_ART_JPEG_INVALID, FALSE);
+
+	if (check == MEDIA_ART_JPEG_VALID) {
+		return g_file_set_contents (target, (const gchar *) buffer, (gssize) valid_len, error);
+	}
+
+	g_debug ("Terminating truncated JPEG (%" G_GSIZE_FORMAT " bytes kept) for '%s'",
+	         valid_len,
+	         target);
+
+	repaired = media_art_pool_alloc (valid_len + 2);
+	memcpy (repaired, buffer, valid_len);
+	repaired[valid_len] = (gchar) 0xff;
+	repaired[valid_len + 1] = (gchar) JPEG_EOI;
+
+	retval = g_file_set_contents (target, repaired, (gssize) valid_len + 2, error);
+	media_art_pool_free (repaired, valid_len + 2);
+
+	return retval;
+}
+
+/* Whether the JPEG in @buffer embeds an ICC colour profile, which is
+ * stored in APP2 segments before the first scan.
+ */
+gboolean
+media_art_jpeg_has_icc_profile (const unsigned char *buffer,
+                                size_t               len)
+{
+	static const char icc_tag[] = "ICC_PROFILE";
+	size_t pos = 2;
+
+	if (!buffer || len < 4 || buffer[0] != 0xff || buffer[1] != JPEG_SOI) {
+		return FALSE;
+	}
+
+	while (pos + 4 <= len && buffer[pos] == 0xff) {
+		unsigned char marker;
+		size_t length;
+
+		marker = buffer[pos + 1];
+
+		if (marker == 0xff) {
+			pos++;
+			continue;
+		}
+
+		if (marker == JPEG_SOS || marker == JPEG_EOI) {
+			break;
+		}
+
+		length = (buffer[pos + 2] << 8) | buffer[pos + 3];
+
+		if (length < 2) {
+			break;
+		}
+
+		/* The tag includes its terminating nul */
+		if (marker == JPEG_APP2 &&
+		    length >= 2 + sizeof (icc_tag) &&
+		    pos + 4 + sizeof (icc_tag) <= len &&
+		    memcmp (buffer + pos + 4, icc_tag, sizeof (icc_tag)) == 0) {
+			return TRUE;
+		}
+
+		pos += 2 + length;
+	}
+
+	return FALSE;
+}
+
+/* Like media_art_jpeg_has_icc_profile(), for the JPEG at @path. Only
+ * the head of the file is read.
+ */
+static gboolean
+file_jpeg_has_icc_profile (const gchar  *path,
+                           GCancellable *cancellable)
+{
+	GFile *file;
+	GFileInputStream *stream;
+	guchar *buffer;
+	gsize len = 0;
+	gboolean retval = FALSE;
+
+	file = g_file_new_for_path (path);
+	stream = g_file_read (file, cancellable, NULL);
+	g_object_unref (file);
+
+	if (!stream) {
+		return FALSE;
+	}
+
+	buffer = g_malloc (JPEG_ICC_SEARCH_SIZE);
+
+	if (g_input_stream_read_all (G_INPUT_STREAM (stream),
+	                             buffer,
+	                             JPEG_ICC_SEARCH_SIZE,
+	                             &len,
+	                             cancellable,
+	                             NULL) || len > 0) {
+		retval = media_art_jpeg_has_icc_profile (buffer, len);
+	}
+
+	g_free (buffer);
+	g_object_unref (stream);
+
+	return retval;
+}
+
+static gboolean
+file_get_checksum_if_exists (GChecksumType   checksum_type,
+                             const gchar    *path,
+                             gchar         **md5,
+                             gboolean        check_jpeg,
+                             gboolean       *is_jpeg,
+                             GCancellable   *cancellable,
+                             GError        **error)
+{
+	GFile *file;
+	GFileInputStream *stream;
+	GChecksum *checksum;
+	GError *local_error = NULL;
+	gssize rsize;
+	guchar buffer[16384];
+	gboolean stop = FALSE;
+
+	file = g_file_new_for_path (path);
+	stream = g_file_read (file, cancellable, &local_error);
+
+	if (local_error) {
+		g_object_unref (file);
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	if (!stream) {
+		g_set_error (error,
+		             g_io_error_quark (),
+		             G_IO_ERROR_FAILED,
+		             "Could not calculate MD5 checksum for '%s', g_file_read() gave no error either?!",
+		             path);
+		g_object_unref (file);
+		return FALSE;
+	}
+
+	checksum = g_checksum_new (checksum_type);
+
+	if (!checksum) {
+		g_set_error (error,
+		             g_io_error_quark (),
+		             G_IO_ERROR_FAILED,
+		             "Could not calculate MD5 checksum for '%s', g_checksum_new() failed",
+		             path);
+		g_object_unref (file);
+		g_object_unref (stream);
+		return FALSE;
+	}
+
+	/* File exists & readable always means true retval */
+	if (check_jpeg) {
+		if (g_input_stream_read_all (G_INPUT_STREAM (stream),
+		                             buffer,
+		                             3,
+		                             (gsize *) &rsize,
+		                             cancellable,
+		                             NULL)) {
+			if (rsize >= 3 &&
+			    buffer[0] == 0xff &&
+			    buffer[1] == 0xd8 &&
+			    buffer[2] == 0xff) {
+				if (is_jpeg) {
+					*is_jpeg = TRUE;
+				}
+
+				/* Add the read bytes to the checksum */
+				g_checksum_update (checksum, buffer, rsize);
+			} else {
+				/* Larger than 3 bytes but incorrect jpeg header */
+				if (is_jpeg) {
+					*is_jpeg = FALSE;
+				}
+
+				stop = TRUE;
+			}
+		} else {
+			/* Smaller than 3 bytes, not a jpeg */
+			if (is_jpeg) {
+				*is_jpeg = FALSE;
+			}
+
+			stop = TRUE;
+		}
+	}
+
+	if (!stop) {
+		/* Check once per chunk, so a cancelled or expired job
+		 * stops within one read.
+		 */
+		while (media_art_job_checkpoint (cancellable, &local_error) &&
+		       (rsize = g_input_stream_read (G_INPUT_STREAM (stream),
+		                                     buffer,
+		                                     sizeof (buffer),
+		                                     cancellable,
+		                                     &local_error)) > 0) {
+			g_checksum_update (checksum, buffer, rsize);
+		}
+
+		if (local_error) {
+			g_propagate_error (error, local_error);
+			g_object_unref (stream);
+			g_checksum_free (checksum);
+			g_object_unref (file);
+			return FALSE;
+		}
+
+		if (md5) {
+			*md5 = g_strdup (g_checksum_get_string (checksum));
+		}
+	}
+
+	g_object_unref (stream);
+	g_checksum_free (checksum);
+	g_object_unref (file);
+
+	return TRUE;
+}
+
+static gboolean
+convert_from_other_format (const gchar                *found,
+                           const gchar                *target,
+                           const gchar                *album_path,
+                           const gchar                *artist,
+                           gboolean                    to_srgb,
+                           MediaArtPlaceholderPixels  *placeholder,
+                           GCancellable               *cancellable,
+                           GError                    **error)
+{
+	GError *local_error = NULL;
+	gboolean retval;
+	gchar *sum1 = NULL;
+	gchar *sum2 = NULL;
+	gchar *target_temp;
+
+	media_art_backend_ensure ();
+
+	target_temp = g_strdup_printf ("%s-tmp", target);
+
+	media_art_file_to_jpeg_cancellable (found, target_temp, to_srgb, placeholder, cancellable, &local_error);
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		g_unlink (target_temp);
+		g_free (target_temp);
+		return FALSE;
+	}
+
+	/* If artist doesn't exist, try to rename temp file to album path */
+	if (artist == NULL || g_strcmp0 (artist, " ") == 0) {
+		retval = g_rename (target_temp, album_path) == 0;
+
+		if (!retval) {
+			g_set_error (error,
+			             media_art_error_quark (),
+			             MEDIA_ART_ERROR_RENAME_FAILED,
+			             "Could not rename '%s' to '%s': %s",
+			             target_temp,
+			             album_path,
+			             g_strerror (errno));
+			g_unlink (target_temp);
+		}
+
+		g_debug ("Renaming ('%s' --> '%s'), %s",
+		         target_temp,
+		         album_path,
+		         !retval ? g_strerror (errno) : "no error given");
+
+		g_free (target_temp);
+
+		return retval;
+	}
+
+	/* Checksum both temp file and album path and decide what to
+	 * do base on what we find...
+	 */
+	file_get_checksum_if_exists (G_CHECKSUM_MD5,
+	                             target_temp,
+	                             &sum1,
+	                             FALSE,
+	                             NULL,
+	                             cancellable,
+	                             &local_error);
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		g_unlink (target_temp);
+		g_free (target_temp);
+		return FALSE;
+	}
+
+	file_get_checksum_if_exists (G_CHECKSUM_MD5,
 	                             album_path,
 	                             &sum2,
 	                             FALSE,
 	                             NULL,
+	                             cancellable,
 	                             &local_error);
 
 	if (!local_error) {
@@ -533,41 +1315,32 @@ convert_from_other_format (const gchar  *found,
 }
 
 static MediaArtSearch *
-media_art_search_new (const gchar  *uri,
-                      MediaArtType  type,
-                      const gchar  *artist,
-                      const gchar  *title)
+media_art_search_new (MediaArtArena *arena,
+                      const gchar   *uri,
+                      MediaArtType   type,
+                      const gchar   *artist,
+                      const gchar   *title)
 {
 	MediaArtSearch *search;
-	gchar *temp;
 
-	search = g_slice_new0 (MediaArtSearch);
-	search->uri = g_strdup (uri);
+	search = media_art_arena_alloc0 (arena, sizeof (MediaArtSearch));
+	search->uri = uri;
 	search->type = type;
 
+	/* Stripping already lower cases the string */
 	if (artist) {
-		temp = media_art_strip_invalid_entities (artist);
-		search->artist_strdown = g_utf8_strdown (temp, -1);
-		g_free (temp);
+		search->artist_strdown = media_art_arena_take (arena,
+		                                               media_art_strip_invalid_entities (artist),
+		                                               g_free);
 	}
 
-	temp = media_art_strip_invalid_entities (title);
-	search->title_strdown = g_utf8_strdown (temp, -1);
-	g_free (temp);
+	search->title_strdown = media_art_arena_take (arena,
+	                                              media_art_strip_invalid_entities (title),
+	                                              g_free);
 
 	return search;
 }
 
-static void
-media_art_search_free (MediaArtSearch *search)
-{
-	g_free (search->uri);
-	g_free (search->artist_strdown);
-	g_free (search->title_strdown);
-
-	g_slice_free (MediaArtSearch, search);
-}
-
 static ImageMatchType
 classify_image_file (MediaArtSearch *search,
                      const gchar    *file_name_strdown)
@@ -579,67 +1352,394 @@ classify_image_file (MediaArtSearch *search,
 		return IMAGE_MATCH_EXACT;
 	}
 
-	if (search->type == MEDIA_ART_ALBUM) {
-		/* Accept cover, front, folder, AlbumArt_{GUID}_Large (first choice)
-		 * second choice is AlbumArt_{GUID}_Small and AlbumArtSmall. We
-		 * don't support just AlbumArt. (it must have a Small or Large) */
+	if (search->type == MEDIA_ART_ALBUM) {
+		/* Accept cover, front, folder, AlbumArt_{GUID}_Large (first choice)
+		 * second choice is AlbumArt_{GUID}_Small and AlbumArtSmall. We
+		 * don't support just AlbumArt. (it must have a Small or Large) */
+
+		if (strstr (file_name_strdown, "cover") ||
+		    strstr (file_name_strdown, "front") ||
+		    strstr (file_name_strdown, "folder")) {
+			return IMAGE_MATCH_EXACT;
+		}
+
+		if (strstr (file_name_strdown, "albumart")) {
+			if (strstr (file_name_strdown, "large")) {
+				return IMAGE_MATCH_EXACT;
+			} else if (strstr (file_name_strdown, "small")) {
+				return IMAGE_MATCH_EXACT_SMALL;
+			}
+		}
+	}
+
+	if (search->type == MEDIA_ART_VIDEO) {
+		if (strstr (file_name_strdown, "folder") ||
+		    strstr (file_name_strdown, "poster")) {
+			return IMAGE_MATCH_EXACT;
+		}
+	}
+
+	/* Lowest priority for other images, but we still might use it for videos */
+	return IMAGE_MATCH_SAME_DIRECTORY;
+}
+
+static void
+image_candidates_add (MediaArtArena   *arena,
+                      ImageCandidates *candidates,
+                      MediaArtSearch  *search,
+                      const gchar     *name)
+{
+	gchar *name_utf8, *name_strdown;
+
+	name_utf8 = g_filename_to_utf8 (name, -1, NULL, NULL, NULL);
+
+	if (!name_utf8) {
+		g_debug ("Could not convert filename '%s' to UTF-8", name);
+		return;
+	}
+
+	name_strdown = g_utf8_strdown (name_utf8, -1);
+
+	if (g_str_has_suffix (name_strdown, "jpeg") ||
+	    g_str_has_suffix (name_strdown, "jpg") ||
+	    g_str_has_suffix (name_strdown, "png")) {
+		ImageCandidate *candidate;
+		gint priority;
+
+		priority = classify_image_file (search, name_strdown);
+
+		candidate = media_art_arena_alloc (arena, sizeof (ImageCandidate));
+		candidate->name = media_art_arena_take (arena, name_utf8, g_free);
+		candidate->next = candidates->list[priority];
+		candidates->list[priority] = candidate;
+		candidates->count[priority]++;
+	} else {
+		g_free (name_utf8);
+	}
+
+	g_free (name_strdown);
+}
+
+/* Picks a media art image among the candidates, returns its UTF-8 name */
+static const gchar *
+image_candidates_pick (ImageCandidates *candidates,
+                       MediaArtType     type)
+{
+	if (candidates->list[IMAGE_MATCH_EXACT]) {
+		return candidates->list[IMAGE_MATCH_EXACT]->name;
+	} else if (candidates->list[IMAGE_MATCH_EXACT_SMALL]) {
+		return candidates->list[IMAGE_MATCH_EXACT_SMALL]->name;
+	} else if (type == MEDIA_ART_VIDEO && candidates->count[IMAGE_MATCH_SAME_DIRECTORY] == 1) {
+		return candidates->list[IMAGE_MATCH_SAME_DIRECTORY]->name;
+	}
+
+	return NULL;
+}
+
+static void
+remote_listing_free (RemoteListing *listing)
+{
+	g_ptr_array_unref (listing->names);
+	g_free (listing);
+}
+
+/* Returns the names in @dir, from a recent listing if we have one */
+static GPtrArray *
+remote_listing_get (GFile         *dir,
+                    GCancellable  *cancellable,
+                    GError       **error)
+{
+	GFileEnumerator *enumerator;
+	RemoteListing *listing;
+	GError *local_error = NULL;
+	GPtrArray *names;
+	GList *infos, *l;
+	gchar *uri;
+	gint64 now;
+
+	uri = g_file_get_uri (dir);
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&remote_listings_lock);
+
+	listing = remote_listings ? g_hash_table_lookup (remote_listings, uri) : NULL;
+
+	if (listing && now - listing->time < REMOTE_LISTING_TTL) {
+		names = g_ptr_array_ref (listing->names);
+		g_mutex_unlock (&remote_listings_lock);
+		g_free (uri);
+
+		return names;
+	}
+
+	g_mutex_unlock (&remote_listings_lock);
+
+	enumerator = g_file_enumerate_children (dir,
+	                                        G_FILE_ATTRIBUTE_STANDARD_NAME ","
+	                                        G_FILE_ATTRIBUTE_STANDARD_TYPE,
+	                                        G_FILE_QUERY_INFO_NONE,
+	                                        cancellable,
+	                                        error);
+
+	if (!enumerator) {
+		g_free (uri);
+		return NULL;
+	}
+
+	names = g_ptr_array_new_with_free_func (g_free);
+
+	/* Batched, each batch is a round trip on most backends */
+	while ((infos = g_file_enumerator_next_files (enumerator,
+	                                              DIR_CHECKPOINT_INTERVAL,
+	                                              cancellable,
+	                                              &local_error)) != NULL) {
+		for (l = infos; l; l = l->next) {
+			GFileInfo *info = l->data;
+
+			if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR) {
+				g_ptr_array_add (names, g_strdup (g_file_info_get_name (info)));
+			}
+		}
+
+		g_list_free_full (infos, g_object_unref);
+
+		if (!media_art_job_checkpoint (cancellable, &local_error)) {
+			break;
+		}
+	}
+
+	g_object_unref (enumerator);
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		g_ptr_array_unref (names);
+		g_free (uri);
+
+		return NULL;
+	}
+
+	listing = g_new0 (RemoteListing, 1);
+	listing->names = g_ptr_array_ref (names);
+	listing->time = now;
+
+	g_mutex_lock (&remote_listings_lock);
+
+	if (!remote_listings) {
+		remote_listings = g_hash_table_new_full (g_str_hash,
+		                                         g_str_equal,
+		                                         g_free,
+		                                         (GDestroyNotify) remote_listing_free);
+	} else if (g_hash_table_size (remote_listings) >= REMOTE_LISTING_MAX) {
+		/* Tracks come in album order, old listings are
+		 * rarely needed again.
+		 */
+		g_hash_table_remove_all (remote_listings);
+	}
+
+	g_hash_table_insert (remote_listings, uri, listing);
+
+	g_mutex_unlock (&remote_listings_lock);
+
+	return names;
+}
+
+static void
+remote_art_free (gchar *path)
+{
+	g_unlink (path);
+	g_free (path);
+}
+
+/* Copies @file into a local temporary file, for the rest of the
+ * heuristic to use like the local media art it normally finds.
+ */
+static gchar *
+remote_art_fetch (GFile         *file,
+                  GCancellable  *cancellable,
+                  GError       **error)
+{
+	GFileInputStream *stream;
+	gchar *basename, *name_template, *path = NULL;
+	const gchar *suffix;
+	GError *local_error = NULL;
+	guchar *buffer;
+	gsize total = 0;
+	gssize n_read;
+	gint fd;
+
+	stream = g_file_read (file, cancellable, error);
+
+	if (!stream) {
+		return NULL;
+	}
+
+	/* The heuristic goes by the file name suffix */
+	basename = g_file_get_basename (file);
+	suffix = strrchr (basename, '.');
+	name_template = g_strdup_printf ("media-art-XXXXXX%s", suffix ? suffix : "");
+	g_free (basename);
+
+	fd = g_file_open_tmp (name_template, &path, error);
+	g_free (name_template);
+
+	if (fd < 0) {
+		g_object_unref (stream);
+		return NULL;
+	}
+
+	buffer = media_art_pool_alloc (REMOTE_READ_CHUNK_SIZE);
+
+	while (media_art_job_checkpoint (cancellable, &local_error) &&
+	       (n_read = g_input_stream_read (G_INPUT_STREAM (stream),
+	                                      buffer,
+	                                      REMOTE_READ_CHUNK_SIZE,
+	                                      cancellable,
+	                                      &local_error)) > 0) {
+		total += n_read;
+
+		if (total > REMOTE_ART_MAX_SIZE) {
+			g_set_error (&local_error,
+			             G_IO_ERROR,
+			             G_IO_ERROR_FAILED,
+			             "Media art is larger than %d bytes",
+			             REMOTE_ART_MAX_SIZE);
+			break;
+		}
+
+		if (write (fd, buffer, n_read) != n_read) {
+			g_set_error (&local_error,
+			             G_IO_ERROR,
+			             g_io_error_from_errno (errno),
+			             "Could not write '%s': %s",
+			             path,
+			             g_strerror (errno));
+			break;
+		}
+	}
+
+	media_art_pool_free (buffer, REMOTE_READ_CHUNK_SIZE);
+	close (fd);
+	g_object_unref (stream);
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		remote_art_free (path);
+		return NULL;
+	}
+
+	return path;
+}
+
+/* The folder heuristic for media outside the local file system,
+ * through GIO rather than GDir. The chosen image is copied locally,
+ * and removed again with @arena.
+ */
+static const gchar *
+media_art_find_remote (MediaArtArena *arena,
+                       const gchar   *uri,
+                       MediaArtType   type,
+                       const gchar   *artist,
+                       const gchar   *title,
+                       GCancellable  *cancellable)
+{
+	ImageCandidates candidates = { { NULL, }, { 0, } };
+	MediaArtSearch *search;
+	GFile *file, *dir, *art_file;
+	GPtrArray *names;
+	GError *error = NULL;
+	const gchar *art_file_name;
+	gchar *art_file_path = NULL;
+	gchar *name;
+	guint i;
+
+	file = g_file_new_for_uri (uri);
+	dir = g_file_get_parent (file);
+	g_object_unref (file);
+
+	if (!dir) {
+		return NULL;
+	}
+
+	names = remote_listing_get (dir, cancellable, &error);
+
+	if (!names) {
+		g_debug ("Media art directory could not be listed: %s",
+		         error ? error->message : "no error given");
+		g_clear_error (&error);
+		g_object_unref (dir);
+
+		return NULL;
+	}
+
+	search = media_art_search_new (arena, uri, type, artist, title);
 
-		if (strstr (file_name_strdown, "cover") ||
-		    strstr (file_name_strdown, "front") ||
-		    strstr (file_name_strdown, "folder")) {
-			return IMAGE_MATCH_EXACT;
-		}
+	for (i = 0; i < names->len; i++) {
+		image_candidates_add (arena, &candidates, search, g_ptr_array_index (names, i));
+	}
 
-		if (strstr (file_name_strdown, "albumart")) {
-			if (strstr (file_name_strdown, "large")) {
-				return IMAGE_MATCH_EXACT;
-			} else if (strstr (file_name_strdown, "small")) {
-				return IMAGE_MATCH_EXACT_SMALL;
-			}
-		}
+	g_ptr_array_unref (names);
+
+	art_file_name = image_candidates_pick (&candidates, type);
+
+	if (!art_file_name) {
+		g_debug ("Album art NOT found in same directory");
+		g_object_unref (dir);
+		return NULL;
 	}
 
-	if (search->type == MEDIA_ART_VIDEO) {
-		if (strstr (file_name_strdown, "folder") ||
-		    strstr (file_name_strdown, "poster")) {
-			return IMAGE_MATCH_EXACT;
-		}
+	name = g_filename_from_utf8 (art_file_name, -1, NULL, NULL, NULL);
+	art_file = g_file_get_child (dir, name);
+	g_free (name);
+
+	art_file_path = remote_art_fetch (art_file, cancellable, &error);
+
+	if (!art_file_path) {
+		g_debug ("Album art could not be copied from '%s': %s",
+		         art_file_name,
+		         error ? error->message : "no error given");
+		g_clear_error (&error);
 	}
 
-	/* Lowest priority for other images, but we still might use it for videos */
-	return IMAGE_MATCH_SAME_DIRECTORY;
+	g_object_unref (art_file);
+	g_object_unref (dir);
+
+	return media_art_arena_take (arena, art_file_path, (GDestroyNotify) remote_art_free);
 }
 
-static gchar *
-media_art_find_by_artist_and_title (const gchar  *uri,
-                                    MediaArtType  type,
-                                    const gchar  *artist,
-                                    const gchar  *title)
+static const gchar *
+media_art_find_by_artist_and_title (MediaArtArena *arena,
+                                    const gchar   *uri,
+                                    MediaArtType   type,
+                                    const gchar   *artist,
+                                    const gchar   *title,
+                                    GCancellable  *cancellable)
 {
+	ImageCandidates candidates = { { NULL, }, { 0, } };
 	MediaArtSearch *search;
 	GDir *dir;
 	GError *error = NULL;
-	gchar *dirname = NULL;
+	const gchar *dirname = NULL;
 	const gchar *name;
-	gchar *name_utf8, *name_strdown;
-	guint i;
-	gchar *art_file_name;
+	const gchar *art_file_name;
 	gchar *art_file_path;
-	gint priority;
-
-	GList *image_list[IMAGE_MATCH_TYPE_COUNT] = { NULL, };
+	guint n_entries = 0;
 
 	g_return_val_if_fail (type > MEDIA_ART_NONE && type < MEDIA_ART_TYPE_COUNT, FALSE);
 	g_return_val_if_fail (title != NULL, FALSE);
 
-	dir = get_parent_g_dir (uri, &dirname, &error);
+	dir = get_parent_g_dir (arena, uri, &dirname, &error);
+
+	if (!dir && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+		g_clear_error (&error);
+
+		return media_art_find_remote (arena, uri, type, artist, title, cancellable);
+	}
 
 	if (!dir) {
 		g_debug ("Media art directory could not be opened: %s",
 		         error ? error->message : "no error given");
 
 		g_clear_error (&error);
-		g_free (dirname);
 
 		return NULL;
 	}
@@ -649,82 +1749,78 @@ media_art_find_by_artist_and_title (const gchar  *uri,
 	 * to decide if the image is a cover or if the file is in a random directory.
 	 */
 
-	search = media_art_search_new (uri, type, artist, title);
+	search = media_art_search_new (arena, uri, type, artist, title);
 
 	for (name = g_dir_read_name (dir);
 	     name != NULL;
 	     name = g_dir_read_name (dir)) {
 
-		name_utf8 = g_filename_to_utf8 (name, -1, NULL, NULL, NULL);
-
-		if (!name_utf8) {
-			g_debug ("Could not convert filename '%s' to UTF-8", name);
-			continue;
-		}
-
-		name_strdown = g_utf8_strdown (name_utf8, -1);
-
-		if (g_str_has_suffix (name_strdown, "jpeg") ||
-		    g_str_has_suffix (name_strdown, "jpg") ||
-		    g_str_has_suffix (name_strdown, "png")) {
-
-			priority = classify_image_file (search, name_strdown);
-			image_list[priority] = g_list_prepend (image_list[priority],
-			                                       name_utf8);
-		} else {
-			g_free (name_utf8);
+		/* Large directories on network mounts can take a
+		 * while, the caller reports why we gave up.
+		 */
+		if (++n_entries % DIR_CHECKPOINT_INTERVAL == 0 &&
+		    !media_art_job_checkpoint (cancellable, NULL)) {
+			g_dir_close (dir);
+			return NULL;
 		}
 
-		g_free (name_strdown);
+		image_candidates_add (arena, &candidates, search, name);
 	}
 
+	g_dir_close (dir);
+
 	/* Use the results to pick a media art image */
 
-	art_file_name = NULL;
-	art_file_path = NULL;
+	art_file_name = image_candidates_pick (&candidates, type);
 
-	if (g_list_length (image_list[IMAGE_MATCH_EXACT]) > 0) {
-		art_file_name = g_strdup (image_list[IMAGE_MATCH_EXACT]->data);
-	} else if (g_list_length (image_list[IMAGE_MATCH_EXACT_SMALL]) > 0) {
-		art_file_name = g_strdup (image_list[IMAGE_MATCH_EXACT_SMALL]->data);
-	} else {
-		if (type == MEDIA_ART_VIDEO && g_list_length (image_list[IMAGE_MATCH_SAME_DIRECTORY]) == 1) {
-			art_file_name = g_strdup (image_list[IMAGE_MATCH_SAME_DIRECTORY]->data);
-		}
+	if (!art_file_name) {
+		g_debug ("Album art NOT found in same directory");
+		return NULL;
 	}
 
-	for (i = 0; i < IMAGE_MATCH_TYPE_COUNT; i ++) {
-		g_list_foreach (image_list[i], (GFunc)g_free, NULL);
-		g_list_free (image_list[i]);
-	}
+	art_file_path = g_build_filename (dirname, art_file_name, NULL);
 
-	if (art_file_name) {
-		art_file_path = g_build_filename (dirname, art_file_name, NULL);
-		g_free (art_file_name);
-	} else {
-		g_debug ("Album art NOT found in same directory");
-		art_file_path = NULL;
-	}
+	/* It's read in full next, whichever way it is used. The hints
+	 * for the job's directory may not have covered it: they stop
+	 * after a few hundred entries, and a long queue can outlast
+	 * the pages they pulled in.
+	 */
+	_media_art_readahead_file (art_file_path);
 
-	media_art_search_free (search);
-	g_dir_close (dir);
-	g_free (dirname);
+	return media_art_arena_take (arena, art_file_path, g_free);
+}
 
-	return art_file_path;
+/* Names the source of a job in the failures table. Buffers and the
+ * images found next to files are kept apart, a broken embedded cover
+ * says nothing about the one next to the file.
+ */
+static gchar *
+job_get_source (const gchar  *kind,
+                MediaArtType  type,
+                const gchar  *uri)
+{
+	return g_strdup_printf ("%s:%s:%s", kind, media_art_type_name[type], uri);
 }
 
 static gboolean
-get_heuristic (MediaArtType   type,
-               const gchar   *filename_uri,
-               const gchar   *artist,
-               const gchar   *title,
-               GError       **error)
+get_heuristic (MediaArtArena              *arena,
+               MediaArtType                type,
+               MediaArtProcessFlags        flags,
+               const gchar                *filename_uri,
+               const gchar                *artist,
+               const gchar                *title,
+               MediaArtPlaceholderPixels  *placeholder,
+               GCancellable               *cancellable,
+               GError                    **error)
 {
-	gchar *art_file_path = NULL;
+	const gchar *art_file_path = NULL;
 	gchar *album_art_file_path = NULL;
 	gchar *target = NULL;
 	gchar *artist_stripped = NULL;
 	gchar *title_stripped = NULL;
+	gchar *source;
+	GError *image_error = NULL;
+	GStatBuf st;
 	gboolean retval = FALSE;
 
 	if (title == NULL || title[0] == '\0') {
@@ -736,30 +1832,49 @@ get_heuristic (MediaArtType   type,
 	}
 
 	if (artist) {
-		artist_stripped = media_art_strip_invalid_entities (artist);
+		artist_stripped = media_art_arena_take (arena,
+		                                        media_art_strip_invalid_entities (artist),
+		                                        g_free);
 	}
-	title_stripped = media_art_strip_invalid_entities (title);
+	title_stripped = media_art_arena_take (arena,
+	                                       media_art_strip_invalid_entities (title),
+	                                       g_free);
 
 	media_art_get_path (artist_stripped,
 	                    title_stripped,
 	                    media_art_type_name[type],
 	                    &target);
+	media_art_arena_take (arena, target, g_free);
 
-	art_file_path = media_art_find_by_artist_and_title (filename_uri,
+	art_file_path = media_art_find_by_artist_and_title (arena,
+	                                                    filename_uri,
 	                                                    type,
 	                                                    artist,
-	                                                    title);
+	                                                    title,
+	                                                    cancellable);
+
+	if (!media_art_job_checkpoint (cancellable, error)) {
+		return FALSE;
+	}
 
 	if (!art_file_path) {
 		// FIXME: Do we GError here?
+		return FALSE;
+	}
 
-		g_free (art_file_path);
-		g_free (album_art_file_path);
+	/* Failures are down to the image, so it is what gets
+	 * quarantined, and replacing it is what lifts that.
+	 */
+	source = media_art_arena_take (arena,
+	                               job_get_source ("image", type, art_file_path),
+	                               g_free);
 
-		g_free (target);
-		g_free (artist_stripped);
-		g_free (title_stripped);
+	if (g_stat (art_file_path, &st) != 0) {
+		st.st_mtime = 0;
+	}
 
+	if ((flags & MEDIA_ART_PROCESS_FLAGS_FORCE) == 0 &&
+	    !media_art_quarantine_check (source, st.st_mtime, error)) {
 		return FALSE;
 	}
 
@@ -767,10 +1882,28 @@ get_heuristic (MediaArtType   type,
 	    g_str_has_suffix (art_file_path, "jpg")) {
 		GError *local_error = NULL;
 		gboolean is_jpeg = FALSE;
+		gboolean to_srgb;
 		gchar *sum1 = NULL;
 
-		if (type != MEDIA_ART_ALBUM ||
-		    (artist == NULL || g_strcmp0 (artist, " ") == 0)) {
+		/* Tagged JPEGs are converted rather than copied as they are */
+		to_srgb = (flags & MEDIA_ART_PROCESS_FLAGS_SRGB) != 0 &&
+		          file_jpeg_has_icc_profile (art_file_path, cancellable);
+
+		if (to_srgb &&
+		    (type != MEDIA_ART_ALBUM ||
+		     (artist == NULL || g_strcmp0 (artist, " ") == 0))) {
+			g_debug ("Album art (JPEG) found in same directory being converted to sRGB:'%s'",
+			         art_file_path);
+
+			media_art_backend_ensure ();
+			retval = media_art_file_to_jpeg_cancellable (art_file_path,
+			                                             target,
+			                                             TRUE,
+			                                             placeholder,
+			                                             cancellable,
+			                                             &image_error);
+		} else if (type != MEDIA_ART_ALBUM ||
+		           (artist == NULL || g_strcmp0 (artist, " ") == 0)) {
 			GFile *art_file;
 			GFile *target_file;
 
@@ -780,17 +1913,17 @@ get_heuristic (MediaArtType   type,
 			target_file = g_file_new_for_path (target);
 			art_file = g_file_new_for_path (art_file_path);
 
-			g_file_copy (art_file,
-			             target_file,
-			             0,
-			             NULL,
-			             NULL,
-			             NULL,
-			             &local_error);
+			retval = g_file_copy (art_file,
+			                      target_file,
+			                      0,
+			                      cancellable,
+			                      NULL,
+			                      NULL,
+			                      &local_error);
 
 			if (local_error) {
 				g_debug ("%s", local_error->message);
-				g_propagate_error (error, local_error);
+				g_propagate_error (&image_error, local_error);
 			}
 
 			g_object_unref (art_file);
@@ -800,14 +1933,16 @@ get_heuristic (MediaArtType   type,
 		                                        &sum1,
 		                                        TRUE,
 		                                        &is_jpeg,
+		                                        cancellable,
 		                                        &local_error)) {
 			/* Avoid duplicate artwork for each track in an album */
 			media_art_get_path (NULL,
 			                    title_stripped,
 			                    media_art_type_name [type],
 			                    &album_art_file_path);
+			media_art_arena_take (arena, album_art_file_path, g_free);
 
-			if (is_jpeg) {
+			if (is_jpeg && !to_srgb) {
 				gchar *sum2 = NULL;
 
 				g_debug ("Album art (JPEG) found in same directory being used:'%s'", art_file_path);
@@ -817,6 +1952,7 @@ get_heuristic (MediaArtType   type,
 				                                 &sum2,
 				                                 FALSE,
 				                                 NULL,
+				                                 cancellable,
 				                                 &local_error)) {
 					if (g_strcmp0 (sum1, sum2) == 0) {
 						/* If album-space-md5.jpg is the same as found,
@@ -824,7 +1960,7 @@ get_heuristic (MediaArtType   type,
 						retval = symlink (album_art_file_path, target) == 0;
 
 						if (!retval) {
-							g_set_error (error,
+							g_set_error (&image_error,
 							             media_art_error_quark (),
 							             MEDIA_ART_ERROR_SYMLINK_FAILED,
 							             "Could not symlink '%s' to '%s', %s",
@@ -848,13 +1984,13 @@ get_heuristic (MediaArtType   type,
 						retval = g_file_copy (art_file,
 						                      target_file,
 						                      0,
-						                      NULL,
+						                      cancellable,
 						                      NULL,
 						                      NULL,
 						                      &local_error);
 
 						if (local_error) {
-							g_propagate_error (error, local_error);
+							g_propagate_error (&image_error, local_error);
 						}
 
 						g_object_unref (art_file);
@@ -875,18 +2011,18 @@ get_heuristic (MediaArtType   type,
 					retval = g_file_copy (art_file,
 					                      album_art_file,
 					                      0,
-					                      NULL,
+					                      cancellable,
 					                      NULL,
 					                      NULL,
 					                      &local_error);
 
 					if (local_error) {
-						g_propagate_error (error, local_error);
+						g_propagate_error (&image_error, local_error);
 					} else {
 						retval = symlink (album_art_file_path, target) == 0;
 
 						if (!retval) {
-							g_set_error (error,
+							g_set_error (&image_error,
 							             media_art_error_quark (),
 							             MEDIA_ART_ERROR_SYMLINK_FAILED,
 							             "Could not symlink '%s' to '%s', %s",
@@ -904,18 +2040,26 @@ get_heuristic (MediaArtType   type,
 					g_object_unref (art_file);
 				}
 			} else {
-				g_debug ("Album art found in same directory but not a real JPEG file (trying to convert): '%s'", art_file_path);
+				if (is_jpeg) {
+					g_debug ("Album art (JPEG) found in same directory being converted to sRGB:'%s'", art_file_path);
+				} else {
+					g_debug ("Album art found in same directory but not a real JPEG file (trying to convert): '%s'", art_file_path);
+				}
+
 				retval = convert_from_other_format (art_file_path,
 				                                    target,
 				                                    album_art_file_path,
 				                                    artist,
-				                                    error);
+				                                    (flags & MEDIA_ART_PROCESS_FLAGS_SRGB) != 0,
+				                                    placeholder,
+				                                    cancellable,
+				                                    &image_error);
 			}
 
 			g_free (sum1);
 		} else {
 			/* Can't read contents of the cover.jpg file ... */
-			g_propagate_error (error, local_error);
+			g_propagate_error (&image_error, local_error);
 			retval = FALSE;
 		}
 	} else if (g_str_has_suffix (art_file_path, "png")) {
@@ -924,6 +2068,7 @@ get_heuristic (MediaArtType   type,
 			                    title_stripped,
 			                    media_art_type_name[type],
 			                    &album_art_file_path);
+			media_art_arena_take (arena, album_art_file_path, g_free);
 		}
 
 		g_debug ("Album art (PNG) found in same directory being used:'%s'", art_file_path);
@@ -931,15 +2076,18 @@ get_heuristic (MediaArtType   type,
 		                                    target,
 		                                    album_art_file_path,
 		                                    artist,
-		                                    error);
+		                                    (flags & MEDIA_ART_PROCESS_FLAGS_SRGB) != 0,
+		                                    placeholder,
+		                                    cancellable,
+		                                    &image_error);
 	}
 
-	g_free (art_file_path);
-	g_free (album_art_file_path);
-
-	g_free (target);
-	g_free (artist_stripped);
-	g_free (title_stripped);
+	if (image_error) {
+		media_art_quarantine_add (source, st.st_mtime, image_error);
+		g_propagate_error (error, image_error);
+	} else if (retval) {
+		media_art_quarantine_remove (source);
+	}
 
 	return retval;
 }
@@ -968,13 +2116,16 @@ is_buffer_jpeg (const gchar         *mime,
 }
 
 static gboolean
-media_art_set (const unsigned char  *buffer,
-               size_t                len,
-               const gchar          *mime,
-               MediaArtType          type,
-               const gchar          *artist,
-               const gchar          *title,
-               GError              **error)
+media_art_set (const unsigned char        *buffer,
+               size_t                      len,
+               const gchar                *mime,
+               MediaArtType                type,
+               const gchar                *artist,
+               const gchar                *title,
+               MediaArtProcessFlags        flags,
+               MediaArtPlaceholderPixels  *placeholder,
+               GCancellable               *cancellable,
+               GError                    **error)
 {
 	GError *local_error = NULL;
 	gchar *artist_path;
@@ -982,11 +2133,16 @@ media_art_set (const unsigned char  *buffer,
 	gchar *md5_album = NULL;
 	gchar *md5_tmp = NULL;
 	gchar *temp;
+	gboolean to_srgb;
 	gboolean retval = FALSE;
 
 	g_return_val_if_fail (type > MEDIA_ART_NONE && type < MEDIA_ART_TYPE_COUNT, FALSE);
 	g_return_val_if_fail (title != NULL, FALSE);
 
+	media_art_backend_ensure ();
+
+	to_srgb = (flags & MEDIA_ART_PROCESS_FLAGS_SRGB) != 0;
+
 	/* What we do here:
 	 *
 	 * NOTE: artist_path is the final location for the media art
@@ -1001,9 +2157,12 @@ media_art_set (const unsigned char  *buffer,
 	 * 4. If buffer is jpeg:
 	 *       i) If the MD5sum is the same for buffer and existing
 	 *          file, symlink to artist_path.
-	 *      ii) Otherwise, save buffer to jpeg and call it artist_path.
+	 *      ii) Otherwise, if deduplicating perceptually or
+	 *          converting its colour profile to sRGB, go to 5.
+	 *     iii) Otherwise, save buffer to jpeg and call it artist_path.
 	 * 5. If buffer is not jpeg, save to disk:
-	 *       i) Compare to existing md5sum cache for ALBUM.
+	 *       i) Compare to existing md5sum cache for ALBUM, and if
+	 *          deduplicating perceptually, to its dHash.
 	 *      ii) If same, unlink new jpeg from buffer and symlink to artist_path.
 	 *     iii) If not same, rename new buffer to artist_path.
 	 *      iv) If we couldn't save the buffer or read from the new
@@ -1020,7 +2179,7 @@ media_art_set (const unsigned char  *buffer,
 	 *       i) save buffer to jpeg only.
 	 */
 	if (type != MEDIA_ART_ALBUM || (artist == NULL || g_strcmp0 (artist, " ") == 0)) {
-		retval = media_art_buffer_to_jpeg (buffer, len, mime, artist_path, &local_error);
+		retval = media_art_buffer_to_jpeg_cancellable (buffer, len, mime, artist_path, to_srgb, placeholder, cancellable, &local_error);
 
 		g_debug ("Saving buffer to jpeg (%ld bytes) --> '%s', %s",
 		         len,
@@ -1046,7 +2205,7 @@ media_art_set (const unsigned char  *buffer,
 	                    &album_path);
 
 	if (!g_file_test (album_path, G_FILE_TEST_EXISTS)) {
-		media_art_buffer_to_jpeg (buffer, len, mime, album_path, &local_error);
+		media_art_buffer_to_jpeg_cancellable (buffer, len, mime, album_path, to_srgb, placeholder, cancellable, &local_error);
 
 		g_debug ("Saving buffer to jpeg (%ld bytes) --> '%s', %s",
 		         len,
@@ -1090,6 +2249,7 @@ media_art_set (const unsigned char  *buffer,
 	                             &md5_album,
 	                             FALSE,
 	                             NULL,
+	                             cancellable,
 	                             &local_error);
 
 	if (local_error) {
@@ -1106,13 +2266,30 @@ media_art_set (const unsigned char  *buffer,
 	/* 4. If buffer is jpeg:
 	 *       i) If the MD5sum is the same for buffer and existing
 	 *          file, symlink to artist_path.
-	 *      ii) Otherwise, save buffer to jpeg and call it artist_path.
+	 *      ii) Otherwise, if deduplicating perceptually or
+	 *          converting its colour profile to sRGB, go to 5.
+	 *     iii) Otherwise, save buffer to jpeg and call it artist_path.
 	 */
 	if (is_buffer_jpeg (mime, buffer, len)) {
 		gchar *md5_data;
 
 		md5_data = checksum_for_data (G_CHECKSUM_MD5, buffer, len);
 
+		if (g_strcmp0 (md5_data, md5_album) != 0 &&
+		    (flags & MEDIA_ART_PROCESS_FLAGS_PERCEPTUAL_DEDUP) != 0) {
+			/* Step 5 has to decode it to compare anyway */
+			g_free (md5_data);
+			goto save_temp;
+		}
+
+		if (to_srgb && media_art_jpeg_has_icc_profile (buffer, len)) {
+			/* What gets saved won't have the checksum of
+			 * @buffer, so compare the converted copy instead.
+			 */
+			g_free (md5_data);
+			goto save_temp;
+		}
+
 		/* If album-space-md5.jpg is the same as buffer, make
 		 * a symlink to album-md5-md5.jpg
 		 */
@@ -1137,7 +2314,7 @@ media_art_set (const unsigned char  *buffer,
 			/* If album-space-md5.jpg isn't the same as
 			 * buffer, make a new album-md5-md5.jpg
 			 */
-			retval = media_art_buffer_to_jpeg (buffer, len, mime, artist_path, &local_error);
+			retval = media_art_buffer_to_jpeg_cancellable (buffer, len, mime, artist_path, to_srgb, placeholder, cancellable, &local_error);
 
 			g_debug ("Saving buffer to jpeg (%ld bytes) --> '%s', %s",
 			         len,
@@ -1158,14 +2335,16 @@ media_art_set (const unsigned char  *buffer,
 	}
 
 	/* 5. If buffer is not jpeg:
-	 *       i) Compare to existing md5sum data with cache for ALBUM.
+	 *       i) Compare to existing md5sum data with cache for ALBUM,
+	 *          and if deduplicating perceptually, to its dHash.
 	 *      ii) If same, unlink new jpeg from buffer and symlink to artist_path.
 	 *     iii) If not same, rename new buffer to artist_path.
 	 *      iv) If we couldn't save the buffer or read from the new
 	 *          cache, unlink it...
 	 */
+save_temp:
 	temp = g_strdup_printf ("%s-tmp", album_path);
-	media_art_buffer_to_jpeg (buffer, len, mime, temp, &local_error);
+	media_art_buffer_to_jpeg_cancellable (buffer, len, mime, temp, to_srgb, placeholder, cancellable, &local_error);
 
 	g_debug ("Saving buffer to jpeg (%ld bytes) --> '%s', %s",
 	         len,
@@ -1192,10 +2371,13 @@ media_art_set (const unsigned char  *buffer,
 	                             &md5_tmp,
 	                             FALSE,
 	                             NULL,
+	                             cancellable,
 	                             &local_error);
 
 	if (!local_error) {
-		if (g_strcmp0 (md5_tmp, md5_album) == 0) {
+		if (g_strcmp0 (md5_tmp, md5_album) == 0 ||
+		    ((flags & MEDIA_ART_PROCESS_FLAGS_PERCEPTUAL_DEDUP) != 0 &&
+		     media_art_looks_like_album (album_path, temp))) {
 			/* If album-space-md5.jpg is the same as
 			 * buffer, make a symlink to album-md5-md5.jpg
 			 */
@@ -1330,6 +2512,12 @@ get_heuristic_for_parent_path (GFile        *file,
 	parent = g_file_get_parent (file);
 	if (parent) {
 		parent_path = g_file_get_path (parent);
+
+		/* Non-native locations have no path */
+		if (!parent_path) {
+			parent_path = g_file_get_uri (parent);
+		}
+
 		g_object_unref (parent);
 	}
 
@@ -1345,8 +2533,149 @@ get_heuristic_for_parent_path (GFile        *file,
 	return key;
 }
 
+/* The directory the heuristic will list for @file, if it's local */
+static gchar *
+get_readahead_dir (GFile *file)
+{
+	GFile *parent;
+	gchar *path = NULL;
+
+	if (!g_file_is_native (file)) {
+		return NULL;
+	}
+
+	parent = g_file_get_parent (file);
+
+	if (parent) {
+		path = g_file_get_path (parent);
+		g_object_unref (parent);
+	}
+
+	return path;
+}
+
+static gboolean
+media_art_process_cache_lookup (MediaArtProcess *process,
+                                const gchar     *key)
+{
+	MediaArtProcessPrivate *private;
+
+	private = media_art_process_get_instance_private (process);
+
+	return media_art_key_cache_lookup (private->media_art_cache, key);
+}
+
+typedef struct {
+	gchar *uri;
+	gchar *cache_path;
+} IndexUri;
+
+static void
+index_uri_free (IndexUri *data)
+{
+	g_free (data->uri);
+	g_free (data->cache_path);
+	g_slice_free (IndexUri, data);
+}
+
+static void
+index_uri_thread (GTask        *task,
+                  gpointer      source_object,
+                  gpointer      task_data,
+                  GCancellable *cancellable)
+{
+	IndexUri *data = task_data;
+
+	_media_art_index_set_uri (data->uri, data->cache_path);
+}
+
+/* Cheap check, safe to run on the caller's thread, for whether
+ * processing @file would end up doing nothing. Only local files
+ * are considered, since stat() on those does not block for long,
+ * anything we are unsure about is left to the worker threads.
+ *
+ * On a hit, @file is recorded for media_art_get_path_for_uri() the
+ * way the worker would have, so rescans fill the index too. That
+ * happens later, in a low priority job.
+ */
+static gboolean
+media_art_process_is_cache_hit (MediaArtProcess      *process,
+                                MediaArtType          type,
+                                MediaArtProcessFlags  flags,
+                                GFile                *file,
+                                gboolean              use_heuristic_cache,
+                                const gchar          *artist,
+                                const gchar          *title)
+{
+	GStatBuf file_st, cache_st;
+	gchar *path, *cache_path = NULL;
+	gboolean hit = FALSE, cache_exists = FALSE;
+
+	if (flags & MEDIA_ART_PROCESS_FLAGS_FORCE) {
+		return FALSE;
+	}
+
+	if (!g_file_is_native (file)) {
+		return FALSE;
+	}
+
+	path = g_file_get_path (file);
+
+	if (!path || g_stat (path, &file_st) != 0) {
+		/* Let the worker report the error */
+		g_free (path);
+		return FALSE;
+	}
+
+	g_free (path);
+
+	media_art_get_path (artist,
+	                    title,
+	                    media_art_type_name[type],
+	                    &cache_path);
+
+	if (cache_path) {
+		cache_exists = g_stat (cache_path, &cache_st) == 0;
+	}
+
+	if (cache_exists && cache_st.st_mtime >= file_st.st_mtime) {
+		hit = TRUE;
+	} else if (use_heuristic_cache) {
+		gchar *key;
+
+		key = get_heuristic_for_parent_path (file, type, artist, title);
+		hit = media_art_process_cache_lookup (process, key);
+		g_free (key);
+	}
+
+	if (hit && cache_exists) {
+		IndexUri *data;
+
+		data = g_slice_new (IndexUri);
+		data->uri = g_file_get_uri (file);
+		data->cache_path = cache_path;
+		cache_path = NULL;
+
+		/* Rewriting the index bucket takes a lock and disk I/O,
+		 * which the caller's thread should not wait for.
+		 */
+		media_art_job_unref (media_art_scheduler_submit_detached (G_OBJECT (process),
+		                                                          data,
+		                                                          (GDestroyNotify) index_uri_free,
+		                                                          NULL,
+		                                                          index_uri_thread,
+		                                                          NULL,
+		                                                          G_PRIORITY_LOW));
+	}
+
+	g_free (cache_path);
+
+	return hit;
+}
+
 static ProcessData *
-process_data_new (MediaArtType          type,
+process_data_new (ProcessKind           kind,
+                  MediaArtType          type,
                   MediaArtProcessFlags  flags,
                   GFile                *file,
                   const gchar          *uri,
@@ -1356,9 +2685,14 @@ process_data_new (MediaArtType          type,
                   const gchar          *artist,
                   const gchar          *title)
 {
+	MediaArtArena *arena;
 	ProcessData *data;
 
-	data = g_slice_new0 (ProcessData);
+	arena = media_art_arena_acquire ();
+
+	data = media_art_arena_alloc0 (arena, sizeof (ProcessData));
+	data->arena = arena;
+	data->kind = kind;
 	data->type = type;
 	data->flags = flags;
 
@@ -1366,18 +2700,14 @@ process_data_new (MediaArtType          type,
 		data->file = g_object_ref (file);
 	}
 
-	data->uri = g_strdup (uri);
+	data->uri = media_art_arena_strdup (arena, uri);
 
 	data->len = len;
-#if GLIB_CHECK_VERSION (2, 68, 0)
-        data->buffer = g_memdup2 (buffer, data->len);
-#else
-	data->buffer = g_memdup (buffer, data->len);
-#endif
-	data->mime = g_strdup (mime);
+	data->buffer = media_art_arena_memdup (arena, buffer, data->len);
+	data->mime = media_art_arena_strdup (arena, mime);
 
-	data->artist = g_strdup (artist);
-	data->title = g_strdup (title);
+	data->artist = media_art_arena_strdup (arena, artist);
+	data->title = media_art_arena_strdup (arena, title);
 
 	return data;
 }
@@ -1393,15 +2723,8 @@ process_data_free (ProcessData *data)
 		g_object_unref (data->file);
 	}
 
-	g_free (data->uri);
-
-	g_free (data->buffer);
-	g_free (data->mime);
-
-	g_free (data->artist);
-	g_free (data->title);
-
-	g_slice_free (ProcessData, data);
+	/* Frees data itself too */
+	media_art_arena_release (data->arena);
 }
 
 static void
@@ -1416,7 +2739,8 @@ process_thread (GTask        *task,
 	gboolean success = FALSE;
 
 	if (!g_cancellable_set_error_if_cancelled (cancellable, &error)) {
-		if (data->file) {
+		switch (data->kind) {
+		case PROCESS_KIND_FILE:
 			success = media_art_process_file (process,
 			                                  data->type,
 			                                  data->flags,
@@ -1425,7 +2749,8 @@ process_thread (GTask        *task,
 			                                  data->title,
 			                                  cancellable,
 			                                  &error);
-		} else if (data->uri) {
+			break;
+		case PROCESS_KIND_URI:
 			success = media_art_process_uri (process,
 			                                 data->type,
 			                                 data->flags,
@@ -1434,7 +2759,8 @@ process_thread (GTask        *task,
 			                                 data->title,
 			                                 cancellable,
 			                                 &error);
-		} else {
+			break;
+		case PROCESS_KIND_BUFFER:
 			success = media_art_process_buffer (process,
 			                                    data->type,
 			                                    data->flags,
@@ -1446,58 +2772,178 @@ process_thread (GTask        *task,
 			                                    data->title,
 			                                    cancellable,
 			                                    &error);
+			break;
 		}
 	}
 
-	if (error) {
+	if (!task) {
+		MediaArtProcessPrivate *private;
+
+		private = media_art_process_get_instance_private (process);
+		media_art_batch_push (private->batch, data->user_data, success, error);
+	} else if (error) {
 		g_task_return_error (task, error);
 	} else {
 		g_task_return_boolean (task, success);
 	}
 }
 
-/**
- * media_art_process_buffer:
- * @process: Media art process object
- * @type: The type of media
- * @flags: The options given for how to process the media art
- * @related_file: File related to the media art
- * @buffer: (array length=len)(allow-none): a buffer containing @file data, or %NULL
- * @len: length of @buffer, or 0
- * @mime: (allow-none): MIME type of @buffer, or %NULL
- * @artist: (allow-none): The artist name @file or %NULL
- * @title: (allow-none): The title for @file or %NULL
- * @cancellable: (allow-none): optional #GCancellable object, %NULL to
- * ignore
- * @error: a #GError location to store the error occurring, or %NULL
- * to ignore.
- *
- * Processes a memory buffer represented by @buffer and @len. If you
- * have extracted any embedded media art and passed this in as
- * @buffer, the image data will be converted to the correct format and
- * saved in the media art cache.
- *
- * Either @artist OR @title can be %NULL, but they can not both be %NULL.
- *
- * If @file is on a removable filesystem, the media art file will be saved in a
- * cache on the removable file system rather than on the host machine.
- *
- * Returns: %TRUE if @file could be processed or %FALSE if @error is set.
- *
- * Since: 0.5.0
+/* Queues @data to be processed, or completes the request at once if
+ * @data is %NULL (a cache hit). Results go to the batch function if
+ * there is one, or to @callback through a GTask.
+ */
+static MediaArtJob *
+process_data_submit (MediaArtProcess     *process,
+                     ProcessData         *data,
+                     const gchar         *readahead_dir,
+                     gint                 io_priority,
+                     GCancellable        *cancellable,
+                     GAsyncReadyCallback  callback,
+                     gpointer             user_data)
+{
+	MediaArtProcessPrivate *private;
+	MediaArtJob *job;
+	GTask *task;
+
+	private = media_art_process_get_instance_private (process);
+
+	if (private->batch) {
+		if (!data) {
+			media_art_batch_push (private->batch, user_data, TRUE, NULL);
+			return media_art_job_new_finished (io_priority);
+		}
+
+		data->user_data = user_data;
+
+		return media_art_scheduler_submit_detached (G_OBJECT (process),
+		                                            data,
+		                                            (GDestroyNotify) process_data_free,
+		                                            cancellable,
+		                                            process_thread,
+		                                            readahead_dir,
+		                                            io_priority);
+	}
+
+	task = g_task_new (process, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+
+	if (!data) {
+		g_task_return_boolean (task, TRUE);
+		job = media_art_job_new_finished (io_priority);
+	} else {
+		g_task_set_task_data (task, data, (GDestroyNotify) process_data_free);
+		job = media_art_scheduler_submit (task, process_thread, readahead_dir, io_priority);
+	}
+
+	g_object_unref (task);
+
+	return job;
+}
+
+/* Remembers the cache entries media_art_set() and get_heuristic()
+ * may write, to update the cache statistics with what they did.
+ * Other jobs writing the same entries wait until job_stats_end().
+ */
+static void
+job_stats_begin (MediaArtStatsChange *change,
+                 MediaArtType         type,
+                 const gchar         *artist,
+                 const gchar         *title)
+{
+	gchar *artist_path = NULL;
+	gchar *album_path = NULL;
+
+	media_art_get_path (artist, title, media_art_type_name[type], &artist_path);
+
+	if (artist && title) {
+		media_art_get_path (NULL, title, media_art_type_name[type], &album_path);
+	}
+
+	_media_art_stats_change_begin (change, artist_path, album_path);
+
+	g_free (artist_path);
+	g_free (album_path);
+}
+
+static void
+job_stats_end (MediaArtStatsChange *change)
+{
+	_media_art_stats_change_end (change);
+}
+
+static void
+placeholder_update (const gchar                     *path,
+                    const MediaArtPlaceholderPixels *placeholder)
+{
+	guchar pixels[MEDIA_ART_PLACEHOLDER_SIZE * MEDIA_ART_PLACEHOLDER_SIZE * 3];
+	GError *error = NULL;
+
+	if (!path || _media_art_placeholder_is_current (path)) {
+		return;
+	}
+
+	if (placeholder->valid) {
+		_media_art_placeholder_store (path, placeholder->pixels);
+		return;
+	}
+
+	media_art_backend_ensure ();
+
+	if (!media_art_file_to_rgb (path,
+	                            MEDIA_ART_PLACEHOLDER_SIZE,
+	                            MEDIA_ART_PLACEHOLDER_SIZE,
+	                            pixels,
+	                            &error)) {
+		g_debug ("Could not make placeholder for '%s': %s",
+		         path,
+		         error ? error->message : "no error given");
+		g_clear_error (&error);
+		return;
+	}
+
+	_media_art_placeholder_store (path, pixels);
+}
+
+/* Generates the placeholders of the cache entries a job just wrote,
+ * once they have their final mtime. Whatever the job wrote came from
+ * the one image in @placeholder (or looks like it, when deduplicating
+ * perceptually), if the backend decoded it. Only the JPEGs stored as
+ * they are get a thumbnail sized copy decoded here.
  */
-gboolean
-media_art_process_buffer (MediaArtProcess       *process,
-                          MediaArtType           type,
-                          MediaArtProcessFlags   flags,
-                          GFile                 *related_file,
-                          const guchar          *buffer,
-                          gsize                  len,
-                          const gchar           *mime,
-                          const gchar           *artist,
-                          const gchar           *title,
-                          GCancellable          *cancellable,
-                          GError               **error)
+static void
+job_update_placeholders (MediaArtType                     type,
+                         const gchar                     *artist,
+                         const gchar                     *title,
+                         const MediaArtPlaceholderPixels *placeholder)
+{
+	gchar *artist_path = NULL;
+	gchar *album_path = NULL;
+
+	media_art_get_path (artist, title, media_art_type_name[type], &artist_path);
+
+	if (artist && title) {
+		media_art_get_path (NULL, title, media_art_type_name[type], &album_path);
+	}
+
+	placeholder_update (artist_path, placeholder);
+	placeholder_update (album_path, placeholder);
+
+	g_free (artist_path);
+	g_free (album_path);
+}
+
+static gboolean
+process_buffer_job (MediaArtProcess       *process,
+                    MediaArtType           type,
+                    MediaArtProcessFlags   flags,
+                    GFile                 *related_file,
+                    const guchar          *buffer,
+                    gsize                  len,
+                    const gchar           *mime,
+                    const gchar           *artist,
+                    const gchar           *title,
+                    GCancellable          *cancellable,
+                    GError               **error)
 {
 	GFile *cache_art_file;
 	GError *local_error = NULL;
@@ -1505,13 +2951,6 @@ media_art_process_buffer (MediaArtProcess       *process,
 	gboolean processed, created;
 	guint64 mtime, cache_mtime = 0;
 
-	g_return_val_if_fail (MEDIA_ART_IS_PROCESS (process), FALSE);
-	g_return_val_if_fail (type > MEDIA_ART_NONE && type < MEDIA_ART_TYPE_COUNT, FALSE);
-	g_return_val_if_fail (G_IS_FILE (related_file), FALSE);
-	g_return_val_if_fail (buffer != NULL, FALSE);
-	g_return_val_if_fail (len > 0, FALSE);
-	g_return_val_if_fail (artist != NULL || title != NULL, FALSE);
-
 	processed = created = FALSE;
 
 	uri = g_file_get_uri (related_file);
@@ -1542,7 +2981,7 @@ media_art_process_buffer (MediaArtProcess       *process,
 
 	cache_mtime = get_mtime (cache_art_file, &local_error);
 
-	if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+	if (!media_art_job_checkpoint (cancellable, error)) {
 		g_free (uri);
 		return FALSE;
 	}
@@ -1578,8 +3017,41 @@ media_art_process_buffer (MediaArtProcess       *process,
 
 	if (flags & MEDIA_ART_PROCESS_FLAGS_FORCE ||
 	    cache_mtime == 0 || mtime > cache_mtime) {
-		processed = media_art_set (buffer, len, mime, type, artist, title, error);
-		set_mtime (cache_art_path, mtime);
+		MediaArtPlaceholderPixels placeholder = { FALSE, };
+		MediaArtStatsChange stats;
+		gchar *source;
+
+		source = job_get_source ("buffer", type, uri);
+
+		if ((flags & MEDIA_ART_PROCESS_FLAGS_FORCE) == 0 &&
+		    !media_art_quarantine_check (source, mtime, error)) {
+			if (cache_art_file) {
+				g_object_unref (cache_art_file);
+			}
+			g_free (cache_art_path);
+			g_free (source);
+			g_free (uri);
+
+			return FALSE;
+		}
+
+		job_stats_begin (&stats, type, artist, title);
+		processed = media_art_set (buffer, len, mime, type, artist, title, flags, &placeholder, cancellable, &local_error);
+		job_stats_end (&stats);
+
+		if (processed) {
+			set_mtime (cache_art_path, mtime);
+			job_update_placeholders (type, artist, title, &placeholder);
+			media_art_quarantine_remove (source);
+		} else if (local_error) {
+			media_art_quarantine_add (source, mtime, local_error);
+		}
+
+		if (local_error) {
+			g_propagate_error (error, local_error);
+		}
+
+		g_free (source);
 	} else {
 		g_debug ("Album art already exists for uri:'%s' as '%s'",
 		         uri,
@@ -1587,6 +3059,10 @@ media_art_process_buffer (MediaArtProcess       *process,
 		processed = TRUE;
 	}
 
+	if (processed && !g_cancellable_is_cancelled (cancellable)) {
+		_media_art_index_set_uri (uri, cache_art_path);
+	}
+
 	if (cache_art_file) {
 		g_object_unref (cache_art_file);
 	}
@@ -1601,6 +3077,75 @@ media_art_process_buffer (MediaArtProcess       *process,
 	return processed;
 }
 
+/**
+ * media_art_process_buffer:
+ * @process: Media art process object
+ * @type: The type of media
+ * @flags: The options given for how to process the media art
+ * @related_file: File related to the media art
+ * @buffer: (array length=len)(allow-none): a buffer containing @file data, or %NULL
+ * @len: length of @buffer, or 0
+ * @mime: (allow-none): MIME type of @buffer, or %NULL
+ * @artist: (allow-none): The artist name @file or %NULL
+ * @title: (allow-none): The title for @file or %NULL
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ * ignore
+ * @error: a #GError location to store the error occurring, or %NULL
+ * to ignore.
+ *
+ * Processes a memory buffer represented by @buffer and @len. If you
+ * have extracted any embedded media art and passed this in as
+ * @buffer, the image data will be converted to the correct format and
+ * saved in the media art cache.
+ *
+ * Either @artist OR @title can be %NULL, but they can not both be %NULL.
+ *
+ * If @file is on a removable filesystem, the media art file will be saved in a
+ * cache on the removable file system rather than on the host machine.
+ *
+ * Returns: %TRUE if @file could be processed or %FALSE if @error is set.
+ *
+ * Since: 0.5.0
+ */
+gboolean
+media_art_process_buffer (MediaArtProcess       *process,
+                          MediaArtType           type,
+                          MediaArtProcessFlags   flags,
+                          GFile                 *related_file,
+                          const guchar          *buffer,
+                          gsize                  len,
+                          const gchar           *mime,
+                          const gchar           *artist,
+                          const gchar           *title,
+                          GCancellable          *cancellable,
+                          GError               **error)
+{
+	gboolean retval;
+
+	g_return_val_if_fail (MEDIA_ART_IS_PROCESS (process), FALSE);
+	g_return_val_if_fail (type > MEDIA_ART_NONE && type < MEDIA_ART_TYPE_COUNT, FALSE);
+	g_return_val_if_fail (G_IS_FILE (related_file), FALSE);
+	g_return_val_if_fail (buffer != NULL, FALSE);
+	g_return_val_if_fail (len > 0, FALSE);
+	g_return_val_if_fail (artist != NULL || title != NULL, FALSE);
+
+	job_deadline_push (process);
+	retval = process_buffer_job (process,
+	                             type,
+	                             flags,
+	                             related_file,
+	                             buffer,
+	                             len,
+	                             mime,
+	                             artist,
+	                             title,
+	                             cancellable,
+	                             error);
+	job_deadline_pop ();
+
+	return retval;
+}
+
 /**
  * media_art_process_buffer_async:
  * @process: Media art process object
@@ -1655,13 +3200,71 @@ media_art_process_buffer_async (MediaArtProcess      *process,
                                 GAsyncReadyCallback   callback,
                                 gpointer              user_data)
 {
-	GTask *task;
+	media_art_job_unref (media_art_process_buffer_submit (process,
+	                                                      type,
+	                                                      flags,
+	                                                      related_file,
+	                                                      buffer,
+	                                                      len,
+	                                                      mime,
+	                                                      artist,
+	                                                      title,
+	                                                      io_priority,
+	                                                      cancellable,
+	                                                      callback,
+	                                                      user_data));
+}
 
-	task = g_task_new (process, cancellable, callback, user_data);
-	g_task_set_task_data (task, process_data_new (type, flags, related_file, NULL, buffer, len, mime, artist, title), (GDestroyNotify) process_data_free);
-	g_task_set_priority (task, io_priority);
-	g_task_run_in_thread (task, process_thread);
-	g_object_unref (task);
+/**
+ * media_art_process_buffer_submit:
+ * @process: Media art process object
+ * @type: The type of media
+ * @flags: The options given for how to process the media art
+ * @related_file: File related to the media art
+ * @buffer: (array length=len)(allow-none): a buffer containing @file
+ * data, or %NULL
+ * @len: length of @buffer, or 0
+ * @mime: MIME type of @buffer, or %NULL
+ * @artist: (allow-none): The artist name @file or %NULL
+ * @title: (allow-none): The title for @file or %NULL
+ * @io_priority: the [I/O priority][io-priority] of the request
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ * ignore
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ * request is satisfied
+ * @user_data: (closure): the data to pass to callback function
+ *
+ * Precisely the same operation as media_art_process_buffer_async(),
+ * but returns a handle which can be used to change the priority of
+ * the request while it is queued, see media_art_job_set_priority().
+ *
+ * Returns: (transfer full): a #MediaArtJob, free with
+ * media_art_job_unref().
+ *
+ * Since: 1.10
+ */
+MediaArtJob *
+media_art_process_buffer_submit (MediaArtProcess      *process,
+                                 MediaArtType          type,
+                                 MediaArtProcessFlags  flags,
+                                 GFile                *related_file,
+                                 const guchar         *buffer,
+                                 gsize                 len,
+                                 const gchar          *mime,
+                                 const gchar          *artist,
+                                 const gchar          *title,
+                                 gint                  io_priority,
+                                 GCancellable         *cancellable,
+                                 GAsyncReadyCallback   callback,
+                                 gpointer              user_data)
+{
+	ProcessData *data = NULL;
+
+	if (!media_art_process_is_cache_hit (process, type, flags, related_file, FALSE, artist, title)) {
+		data = process_data_new (PROCESS_KIND_BUFFER, type, flags, related_file, NULL, buffer, len, mime, artist, title);
+	}
+
+	return process_data_submit (process, data, NULL, io_priority, cancellable, callback, user_data);
 }
 
 /**
@@ -1689,60 +3292,15 @@ media_art_process_buffer_finish (MediaArtProcess  *process,
 
 }
 
-/**
- * media_art_process_file:
- * @process: Media art process object
- * @type: The type of media
- * @flags: The options given for how to process the media art
- * @file: File to be processed
- * @artist: (allow-none): The artist name @file or %NULL
- * @title: (allow-none): The title for @file or %NULL
- * @cancellable: (allow-none): optional #GCancellable object, %NULL to
- * ignore
- * @error: a #GError location to store the error occurring, or %NULL
- * to ignore.
- *
- * Process @file and check if media art exists and if it is up to date
- * with @artist and @title provided. Either @artist OR @title can be
- * %NULL, but they can not both be %NULL.
- *
- * NOTE: This function MAY retrieve media art for
- * @artist and @title combinations. It is not guaranteed and depends
- * on download services available over DBus at the time.
- *
- * In cases where download is unavailable, media_art_process_file()
- * will only try to procure a cache for possible media art found in
- * directories surrounding the location of @file. If a buffer or
- * memory chunk needs to be saved to disk which has been retrieved
- * from an MP3 (for example), you should use
- * media_art_process_buffer().
- *
- * The modification time (mtime) of @file is checked against the
- * cached stored for @artist and @title. If the cache is old or
- * doesn't exist, it will be updated. What this actually does is
- * update the mtime of the cache (a symlink) on the disk.
- *
- * If there is no actual media art stored locally (for example, it's
- * stored in a directory on a removable device), it is copied locally
- * (usually to an XDG cache directory).
- *
- * If @file is on a removable filesystem, the media art file will be
- * saved in a cache on the removable file system rather than on the
- * host machine.
- *
- * Returns: %TRUE if @file could be processed or %FALSE if @error is set.
- *
- * Since: 0.3.0
- */
-gboolean
-media_art_process_file (MediaArtProcess       *process,
-                        MediaArtType           type,
-                        MediaArtProcessFlags   flags,
-                        GFile                 *file,
-                        const gchar           *artist,
-                        const gchar           *title,
-                        GCancellable          *cancellable,
-                        GError               **error)
+static gboolean
+process_file_job (MediaArtProcess       *process,
+                  MediaArtType           type,
+                  MediaArtProcessFlags   flags,
+                  GFile                 *file,
+                  const gchar           *artist,
+                  const gchar           *title,
+                  GCancellable          *cancellable,
+                  GError               **error)
 {
 	MediaArtProcessPrivate *private;
 	GFile *cache_art_file;
@@ -1751,11 +3309,6 @@ media_art_process_file (MediaArtProcess       *process,
 	gboolean no_cache_or_old;
 	guint64 mtime, cache_mtime;
 
-	g_return_val_if_fail (MEDIA_ART_IS_PROCESS (process), FALSE);
-	g_return_val_if_fail (type > MEDIA_ART_NONE && type < MEDIA_ART_TYPE_COUNT, FALSE);
-	g_return_val_if_fail (G_IS_FILE (file), FALSE);
-	g_return_val_if_fail (artist != NULL || title != NULL, FALSE);
-
 	private = media_art_process_get_instance_private (process);
 
 	uri = g_file_get_uri (file);
@@ -1777,7 +3330,7 @@ media_art_process_file (MediaArtProcess       *process,
 		return FALSE;
 	}
 
-	if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+	if (!media_art_job_checkpoint (cancellable, error)) {
 		g_free (uri);
 		return FALSE;
 	}
@@ -1789,8 +3342,13 @@ media_art_process_file (MediaArtProcess       *process,
 
 	cache_art_path = g_file_get_path (cache_art_file);
 
+	/* Some locations (remote ones, mostly) have no mtime, so check
+	 * for a missing cache explicitly rather than relying on it
+	 * being older.
+	 */
 	cache_mtime = get_mtime (cache_art_file, &local_error);
-	no_cache_or_old = cache_mtime == -1 || cache_mtime < mtime;
+	no_cache_or_old = local_error != NULL || cache_mtime < mtime;
+	g_clear_error (&local_error);
 
 	if (no_cache_or_old) {
 		/* If not, we perform a heuristic on the dir */
@@ -1798,38 +3356,144 @@ media_art_process_file (MediaArtProcess       *process,
 
 		key = get_heuristic_for_parent_path (file, type, artist, title);
 
-		if (!g_hash_table_lookup (private->media_art_cache, key)) {
+		if (!media_art_process_cache_lookup (process, key)) {
 			/* Check we're not cancelled before
 			 * potentially trying a download operation.
 			 */
-			if (!g_cancellable_set_error_if_cancelled (cancellable, error)) {
-				if (!get_heuristic (type, uri, artist, title, error)) {
+			if (media_art_job_checkpoint (cancellable, error)) {
+				MediaArtPlaceholderPixels placeholder = { FALSE, };
+				MediaArtStatsChange stats;
+				MediaArtArena *arena;
+				gboolean found;
+
+				job_stats_begin (&stats, type, artist, title);
+				arena = media_art_arena_acquire ();
+				found = get_heuristic (arena, type, flags, uri, artist, title, &placeholder, cancellable, &local_error);
+				media_art_arena_release (arena);
+				job_stats_end (&stats);
+
+				/* Failed images are quarantined already */
+				if (!found) {
+					if (local_error) {
+						g_propagate_error (error, local_error);
+					}
+
+					if (cache_art_file) {
+						g_object_unref (cache_art_file);
+					}
+					g_free (cache_art_path);
+					g_free (key);
+					g_free (uri);
+
 					return FALSE;
 				}
 
 				set_mtime (cache_art_path, mtime);
+				job_update_placeholders (type, artist, title, &placeholder);
 
-				g_hash_table_insert (private->media_art_cache,
-				                     key,
-				                     GINT_TO_POINTER(TRUE));
+				media_art_key_cache_insert (private->media_art_cache, key);
 			}
-		} else {
-			g_free (key);
 		}
+
+		g_free (key);
 	} else {
 		g_debug ("Album art already exists for uri:'%s' as '%s'",
 		         uri,
 		         cache_art_path);
 	}
 
-	if (cache_art_file) {
-		g_object_unref (cache_art_file);
-	}
+	/* Remember where the art for this file went, for
+	 * media_art_get_path_for_uri().
+	 */
+	if (!g_cancellable_is_cancelled (cancellable) &&
+	    g_file_test (cache_art_path, G_FILE_TEST_EXISTS)) {
+		_media_art_index_set_uri (uri, cache_art_path);
+	}
+
+	if (cache_art_file) {
+		g_object_unref (cache_art_file);
+	}
+
+	g_free (cache_art_path);
+	g_free (uri);
+
+	return !g_cancellable_is_cancelled (cancellable);
+}
+
+/**
+ * media_art_process_file:
+ * @process: Media art process object
+ * @type: The type of media
+ * @flags: The options given for how to process the media art
+ * @file: File to be processed
+ * @artist: (allow-none): The artist name @file or %NULL
+ * @title: (allow-none): The title for @file or %NULL
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ * ignore
+ * @error: a #GError location to store the error occurring, or %NULL
+ * to ignore.
+ *
+ * Process @file and check if media art exists and if it is up to date
+ * with @artist and @title provided. Either @artist OR @title can be
+ * %NULL, but they can not both be %NULL.
+ *
+ * NOTE: This function MAY retrieve media art for
+ * @artist and @title combinations. It is not guaranteed and depends
+ * on download services available over DBus at the time.
+ *
+ * In cases where download is unavailable, media_art_process_file()
+ * will only try to procure a cache for possible media art found in
+ * directories surrounding the location of @file. If a buffer or
+ * memory chunk needs to be saved to disk which has been retrieved
+ * from an MP3 (for example), you should use
+ * media_art_process_buffer().
+ *
+ * The modification time (mtime) of @file is checked against the
+ * cached stored for @artist and @title. If the cache is old or
+ * doesn't exist, it will be updated. What this actually does is
+ * update the mtime of the cache (a symlink) on the disk.
+ *
+ * If there is no actual media art stored locally (for example, it's
+ * stored in a directory on a removable device), it is copied locally
+ * (usually to an XDG cache directory).
+ *
+ * If @file is on a removable filesystem, the media art file will be
+ * saved in a cache on the removable file system rather than on the
+ * host machine.
+ *
+ * Returns: %TRUE if @file could be processed or %FALSE if @error is set.
+ *
+ * Since: 0.3.0
+ */
+gboolean
+media_art_process_file (MediaArtProcess       *process,
+                        MediaArtType           type,
+                        MediaArtProcessFlags   flags,
+                        GFile                 *file,
+                        const gchar           *artist,
+                        const gchar           *title,
+                        GCancellable          *cancellable,
+                        GError               **error)
+{
+	gboolean retval;
+
+	g_return_val_if_fail (MEDIA_ART_IS_PROCESS (process), FALSE);
+	g_return_val_if_fail (type > MEDIA_ART_NONE && type < MEDIA_ART_TYPE_COUNT, FALSE);
+	g_return_val_if_fail (G_IS_FILE (file), FALSE);
+	g_return_val_if_fail (artist != NULL || title != NULL, FALSE);
 
-	g_free (cache_art_path);
-	g_free (uri);
+	job_deadline_push (process);
+	retval = process_file_job (process,
+	                           type,
+	                           flags,
+	                           file,
+	                           artist,
+	                           title,
+	                           cancellable,
+	                           error);
+	job_deadline_pop ();
 
-	return !g_cancellable_is_cancelled (cancellable);
+	return retval;
 }
 
 
@@ -1880,13 +3544,67 @@ media_art_process_file_async (MediaArtProcess      *process,
                               GAsyncReadyCallback   callback,
                               gpointer              user_data)
 {
-	GTask *task;
+	media_art_job_unref (media_art_process_file_submit (process,
+	                                                    type,
+	                                                    flags,
+	                                                    file,
+	                                                    artist,
+	                                                    title,
+	                                                    io_priority,
+	                                                    cancellable,
+	                                                    callback,
+	                                                    user_data));
+}
 
-	task = g_task_new (process, cancellable, callback, user_data);
-	g_task_set_task_data (task, process_data_new (type, flags, file, NULL, NULL, 0, NULL, artist, title), (GDestroyNotify) process_data_free);
-	g_task_set_priority (task, io_priority);
-	g_task_run_in_thread (task, process_thread);
-	g_object_unref (task);
+/**
+ * media_art_process_file_submit:
+ * @process: Media art process object
+ * @type: The type of media
+ * @flags: The options given for how to process the media art
+ * @file: File to be processed
+ * @artist: (allow-none): The artist name @file or %NULL
+ * @title: (allow-none): The title for @file or %NULL
+ * @io_priority: the [I/O priority][io-priority] of the request
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ * ignore
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ * request is satisfied
+ * @user_data: (closure): the data to pass to callback function
+ *
+ * Precisely the same operation as media_art_process_file_async(),
+ * but returns a handle which can be used to change the priority of
+ * the request while it is queued, see media_art_job_set_priority().
+ *
+ * Returns: (transfer full): a #MediaArtJob, free with
+ * media_art_job_unref().
+ *
+ * Since: 1.10
+ */
+MediaArtJob *
+media_art_process_file_submit (MediaArtProcess      *process,
+                               MediaArtType          type,
+                               MediaArtProcessFlags  flags,
+                               GFile                *file,
+                               const gchar          *artist,
+                               const gchar          *title,
+                               gint                  io_priority,
+                               GCancellable         *cancellable,
+                               GAsyncReadyCallback   callback,
+                               gpointer              user_data)
+{
+	ProcessData *data = NULL;
+	gchar *readahead_dir = NULL;
+	MediaArtJob *job;
+
+	if (!media_art_process_is_cache_hit (process, type, flags, file, TRUE, artist, title)) {
+		readahead_dir = get_readahead_dir (file);
+		data = process_data_new (PROCESS_KIND_FILE, type, flags, file, NULL, NULL, 0, NULL, artist, title);
+	}
+
+	job = process_data_submit (process, data, readahead_dir, io_priority, cancellable, callback, user_data);
+	g_free (readahead_dir);
+
+	return job;
 }
 
 /**
@@ -2015,13 +3733,71 @@ media_art_process_uri_async (MediaArtProcess      *process,
                              GAsyncReadyCallback   callback,
                              gpointer              user_data)
 {
-	GTask *task;
+	media_art_job_unref (media_art_process_uri_submit (process,
+	                                                   type,
+	                                                   flags,
+	                                                   uri,
+	                                                   artist,
+	                                                   title,
+	                                                   io_priority,
+	                                                   cancellable,
+	                                                   callback,
+	                                                   user_data));
+}
 
-	task = g_task_new (process, cancellable, callback, user_data);
-	g_task_set_task_data (task, process_data_new (type, flags, NULL, uri, NULL, 0, NULL, artist, title), (GDestroyNotify) process_data_free);
-	g_task_set_priority (task, io_priority);
-	g_task_run_in_thread (task, process_thread);
-	g_object_unref (task);
+/**
+ * media_art_process_uri_submit:
+ * @process: Media art process object
+ * @type: The type of media
+ * @flags: The options given for how to process the media art
+ * @uri: A string representing a URI to be processed
+ * @artist: (allow-none): The artist name @file or %NULL
+ * @title: (allow-none): The title for @file or %NULL
+ * @io_priority: the [I/O priority][io-priority] of the request
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ * ignore
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ * request is satisfied
+ * @user_data: (closure): the data to pass to callback function
+ *
+ * Precisely the same operation as media_art_process_uri_async(),
+ * but returns a handle which can be used to change the priority of
+ * the request while it is queued, see media_art_job_set_priority().
+ *
+ * Returns: (transfer full): a #MediaArtJob, free with
+ * media_art_job_unref().
+ *
+ * Since: 1.10
+ */
+MediaArtJob *
+media_art_process_uri_submit (MediaArtProcess      *process,
+                              MediaArtType          type,
+                              MediaArtProcessFlags  flags,
+                              const gchar          *uri,
+                              const gchar          *artist,
+                              const gchar          *title,
+                              gint                  io_priority,
+                              GCancellable         *cancellable,
+                              GAsyncReadyCallback   callback,
+                              gpointer              user_data)
+{
+	ProcessData *data = NULL;
+	gchar *readahead_dir = NULL;
+	MediaArtJob *job;
+	GFile *file;
+
+	file = g_file_new_for_uri (uri);
+
+	if (!media_art_process_is_cache_hit (process, type, flags, file, TRUE, artist, title)) {
+		readahead_dir = get_readahead_dir (file);
+		data = process_data_new (PROCESS_KIND_URI, type, flags, NULL, uri, NULL, 0, NULL, artist, title);
+	}
+
+	job = process_data_submit (process, data, readahead_dir, io_priority, cancellable, callback, user_data);
+	g_free (readahead_dir);
+	g_object_unref (file);
+
+	return job;
 }
 
 /**
@@ -2048,3 +3824,387 @@ media_art_process_uri_finish (MediaArtProcess  *process,
 	return g_task_propagate_boolean (G_TASK (result), error);
 
 }
+
+typedef struct {
+	MediaArtProcess *process;
+	MediaArtType type;
+	MediaArtProcessFlags flags;
+	MediaArtTreePolicy policy;
+	GCancellable *cancellable;
+	GThreadPool *pool;
+	GAsyncQueue *results;
+	gint n_scheduled;
+} TreeWalk;
+
+typedef struct {
+	GFile *folder;
+	gboolean is_album;
+	gboolean processed;
+	GError *error;
+} TreeResult;
+
+/* How many tracks of a folder without usable image files are tried
+ * for embedded media art, the first ones often share it.
+ */
+#define TREE_MAX_TRACKS 4
+
+static void
+tree_walk_schedule (TreeWalk *walk,
+                    GFile    *folder)
+{
+	g_atomic_int_inc (&walk->n_scheduled);
+	g_thread_pool_push (walk->pool, g_object_ref (folder), NULL);
+}
+
+static gchar *
+tree_folder_name (GFile *folder)
+{
+	gchar *basename, *name;
+
+	if (!folder) {
+		return NULL;
+	}
+
+	basename = g_file_get_basename (folder);
+	name = basename ? g_filename_to_utf8 (basename, -1, NULL, NULL, NULL) : NULL;
+	g_free (basename);
+
+	return name;
+}
+
+/* Whether @info is a media file, going by its name. Playlists are
+ * audio/ types too, but also text, which media files are not.
+ */
+static gboolean
+tree_is_media_file (GFileInfo *info)
+{
+	const gchar *content_type;
+	gchar *mime;
+	gboolean is_media;
+
+	content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+
+	if (!content_type) {
+		return FALSE;
+	}
+
+	mime = g_content_type_get_mime_type (content_type);
+	is_media = mime &&
+	           (g_str_has_prefix (mime, "audio/") || g_str_has_prefix (mime, "video/")) &&
+	           !g_content_type_is_a (content_type, "text/plain");
+	g_free (mime);
+
+	return is_media;
+}
+
+/* Looks for media art embedded in @tracks, returning FALSE without
+ * setting @error if there is none.
+ */
+static gboolean
+tree_process_embedded (TreeWalk      *walk,
+                       GPtrArray     *tracks,
+                       const gchar   *artist,
+                       const gchar   *title,
+                       GError       **error)
+{
+	guint i;
+
+	for (i = 0; i < tracks->len; i++) {
+		GFile *track = g_ptr_array_index (tracks, i);
+		GError *local_error = NULL;
+		GBytes *picture;
+		gchar *mime;
+		gboolean retval;
+
+		if (!media_art_job_checkpoint (walk->cancellable, error)) {
+			return FALSE;
+		}
+
+		if (!media_art_embedded_read (track, &picture, &mime, walk->cancellable, &local_error)) {
+			if (local_error) {
+				g_debug ("Could not read embedded media art: %s", local_error->message);
+				g_error_free (local_error);
+			}
+
+			continue;
+		}
+
+		retval = process_buffer_job (walk->process,
+		                             walk->type,
+		                             walk->flags,
+		                             track,
+		                             g_bytes_get_data (picture, NULL),
+		                             g_bytes_get_size (picture),
+		                             mime,
+		                             artist,
+		                             title,
+		                             walk->cancellable,
+		                             error);
+		g_bytes_unref (picture);
+		g_free (mime);
+
+		return retval;
+	}
+
+	return FALSE;
+}
+
+/* Resolves the media art of one album folder, from its image files
+ * if it has any, using the first of @tracks to stand for all the
+ * media files in it, or else from their embedded media art.
+ */
+static gboolean
+tree_process_folder (TreeWalk   *walk,
+                     GFile      *folder,
+                     GPtrArray  *tracks,
+                     GError    **error)
+{
+	GError *local_error = NULL;
+	gchar *artist = NULL;
+	gchar *title;
+	gboolean retval = FALSE;
+
+	title = tree_folder_name (folder);
+
+	if (walk->policy == MEDIA_ART_TREE_POLICY_ARTIST_ALBUM_FOLDERS) {
+		GFile *parent;
+
+		parent = g_file_get_parent (folder);
+		artist = tree_folder_name (parent);
+
+		if (parent) {
+			g_object_unref (parent);
+		}
+	}
+
+	if (!title) {
+		g_set_error (error,
+		             media_art_error_quark (),
+		             MEDIA_ART_ERROR_NO_TITLE,
+		             "Folder name could not be used as a title");
+		return FALSE;
+	}
+
+	job_deadline_push (walk->process);
+
+	/* Also answers rescans from the cache, images or not */
+	retval = process_file_job (walk->process,
+	                           walk->type,
+	                           walk->flags,
+	                           g_ptr_array_index (tracks, 0),
+	                           artist,
+	                           title,
+	                           walk->cancellable,
+	                           &local_error);
+
+	if (!retval && !local_error) {
+		retval = tree_process_embedded (walk, tracks, artist, title, &local_error);
+	}
+
+	job_deadline_pop ();
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+	}
+
+	g_free (artist);
+	g_free (title);
+
+	return retval;
+}
+
+static void
+tree_walk_folder (gpointer data,
+                  gpointer user_data)
+{
+	GFile *folder = data;
+	TreeWalk *walk = user_data;
+	GFileEnumerator *enumerator;
+	TreeResult *result;
+	GPtrArray *tracks;
+	GList *infos, *l;
+
+	result = g_new0 (TreeResult, 1);
+	result->folder = folder;
+
+	if (g_cancellable_set_error_if_cancelled (walk->cancellable, &result->error)) {
+		g_async_queue_push (walk->results, result);
+		return;
+	}
+
+	tracks = g_ptr_array_new_with_free_func (g_object_unref);
+	enumerator = g_file_enumerate_children (folder,
+	                                        G_FILE_ATTRIBUTE_STANDARD_NAME ","
+	                                        G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+	                                        G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+	                                        G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE,
+	                                        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+	                                        walk->cancellable,
+	                                        &result->error);
+
+	while (enumerator &&
+	       (infos = g_file_enumerator_next_files (enumerator,
+	                                              DIR_CHECKPOINT_INTERVAL,
+	                                              walk->cancellable,
+	                                              &result->error)) != NULL) {
+		for (l = infos; l; l = l->next) {
+			GFileInfo *info = l->data;
+			const gchar *name = g_file_info_get_name (info);
+
+			if (g_file_info_get_is_hidden (info)) {
+				continue;
+			}
+
+			if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+				GFile *child;
+
+				/* Subfolders go back to the pool, so
+				 * idle workers pick them up.
+				 */
+				child = g_file_get_child (folder, name);
+				tree_walk_schedule (walk, child);
+				g_object_unref (child);
+			} else if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+			           tracks->len < TREE_MAX_TRACKS &&
+			           tree_is_media_file (info)) {
+				g_ptr_array_add (tracks, g_file_get_child (folder, name));
+			}
+		}
+
+		g_list_free_full (infos, g_object_unref);
+	}
+
+	if (enumerator) {
+		g_object_unref (enumerator);
+	}
+
+	/* Every folder with media files is an album folder, whether
+	 * or not it has media art to find.
+	 */
+	if (!result->error && tracks->len > 0) {
+		result->is_album = TRUE;
+		result->processed = tree_process_folder (walk, folder, tracks, &result->error);
+	}
+
+	g_ptr_array_unref (tracks);
+
+	g_async_queue_push (walk->results, result);
+}
+
+/**
+ * media_art_process_tree:
+ * @process: Media art process object
+ * @type: The type of media
+ * @flags: The options given for how to process the media art
+ * @root: The folder to start from
+ * @policy: How artists and titles are derived from folder names
+ * @func: (scope call) (allow-none): Function called as each album
+ * folder is done, or %NULL
+ * @user_data: (closure): Data to pass to @func
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ * ignore
+ * @error: a #GError location to store the error occurring, or %NULL
+ * to ignore.
+ *
+ * Walks the folder tree below @root and resolves media art for every
+ * album folder in it, that is every folder holding media files, which
+ * are told apart from other files by their names. Each album folder
+ * is processed once, as media_art_process_file() would process any of
+ * its media files, with the artist and title given by @policy. If
+ * that finds no media art, the pictures embedded in the ID3v2 or FLAC
+ * tags of the first few media files are tried, as
+ * media_art_process_buffer() would.
+ *
+ * Folders are listed and processed by a pool of worker threads, one
+ * per processor, so this scales with the machine on large libraries.
+ * @func is called from the calling thread though, once per album
+ * folder, with its result. Errors for single folders are passed to
+ * @func rather than ending the walk. Folders for which no media art
+ * was found are reported too, as not processed; media art in other
+ * tag formats can be passed to media_art_process_buffer() for them.
+ *
+ * This function blocks until the whole tree has been walked.
+ *
+ * Returns: %TRUE if the tree was walked, or %FALSE if @error is set.
+ *
+ * Since: 1.10
+ */
+gboolean
+media_art_process_tree (MediaArtProcess       *process,
+                        MediaArtType           type,
+                        MediaArtProcessFlags   flags,
+                        GFile                 *root,
+                        MediaArtTreePolicy     policy,
+                        MediaArtTreeFunc       func,
+                        gpointer               user_data,
+                        GCancellable          *cancellable,
+                        GError               **error)
+{
+	TreeWalk walk = { 0, };
+	GError *root_error = NULL;
+	guint n_albums = 0, n_done = 0;
+	gint n_received = 0;
+
+	g_return_val_if_fail (MEDIA_ART_IS_PROCESS (process), FALSE);
+	g_return_val_if_fail (type > MEDIA_ART_NONE && type < MEDIA_ART_TYPE_COUNT, FALSE);
+	g_return_val_if_fail (G_IS_FILE (root), FALSE);
+
+	walk.process = process;
+	walk.type = type;
+	walk.flags = flags;
+	walk.policy = policy;
+	walk.cancellable = cancellable;
+	walk.results = g_async_queue_new ();
+	walk.pool = g_thread_pool_new (tree_walk_folder,
+	                               &walk,
+	                               g_get_num_processors (),
+	                               FALSE,
+	                               NULL);
+
+	tree_walk_schedule (&walk, root);
+
+	/* Each folder's subfolders are scheduled before its result is
+	 * pushed, so once every scheduled folder has a result, we are
+	 * done.
+	 */
+	while (n_received < g_atomic_int_get (&walk.n_scheduled)) {
+		TreeResult *result;
+
+		result = g_async_queue_pop (walk.results);
+		n_received++;
+
+		if (result->is_album) {
+			n_albums++;
+
+			if (func) {
+				func (result->folder,
+				      result->processed,
+				      result->error,
+				      ++n_done,
+				      g_atomic_int_get (&walk.n_scheduled) - n_received,
+				      user_data);
+			}
+		} else if (result->folder == root && result->error) {
+			root_error = g_error_copy (result->error);
+		} else if (result->error &&
+		           !g_error_matches (result->error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_debug ("Could not list folder: %s", result->error->message);
+		}
+
+		g_clear_error (&result->error);
+		g_object_unref (result->folder);
+		g_free (result);
+	}
+
+	g_thread_pool_free (walk.pool, FALSE, TRUE);
+	g_async_queue_unref (walk.results);
+
+	g_debug ("Processed %u album folders", n_albums);
+
+	if (root_error) {
+		g_propagate_error (error, root_error);
+		return FALSE;
+	}
+
+	return !g_cancellable_set_error_if_cancelled (cancellable, error);
+}
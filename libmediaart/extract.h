@@ -52,6 +52,8 @@ typedef enum {
  * MediaArtProcessFlags:
  * @MEDIA_ART_PROCESS_FLAGS_NONE: Normal operation.
  * @MEDIA_ART_PROCESS_FLAGS_FORCE: Force media art to be re-saved to disk even if it already exists and the related file or URI has the same modified time (mtime).
+ * @MEDIA_ART_PROCESS_FLAGS_PERCEPTUAL_DEDUP: When an embedded image looks the same as the album's existing media art, but is not byte for byte identical (a different encoder or embedded metadata, for example), link to the existing media art instead of saving another copy. Since: 1.10
+ * @MEDIA_ART_PROCESS_FLAGS_SRGB: Convert images with an embedded colour profile (Adobe RGB or Display P3, for example) to sRGB when they are saved, and leave the profile out. Clients can then show the media art as it is, without colour management. Images are only converted where the image backend supports it. Since: 1.10
  *
  * This type categorized the flags used when processing media art.
  *
@@ -60,8 +62,28 @@ typedef enum {
 typedef enum {
 	MEDIA_ART_PROCESS_FLAGS_NONE   = 0,
 	MEDIA_ART_PROCESS_FLAGS_FORCE  = 1 << 0,
+	MEDIA_ART_PROCESS_FLAGS_PERCEPTUAL_DEDUP = 1 << 1,
+	MEDIA_ART_PROCESS_FLAGS_SRGB = 1 << 2,
 } MediaArtProcessFlags;
 
+/**
+ * MediaArtTreePolicy:
+ * @MEDIA_ART_TREE_POLICY_ALBUM_FOLDERS: Each album folder is named
+ * after its album, the artist is unknown.
+ * @MEDIA_ART_TREE_POLICY_ARTIST_ALBUM_FOLDERS: Each album folder is
+ * named after its album, and sits in a folder named after its
+ * artist, as in "Artist/Album/01 Track.mp3".
+ *
+ * How media_art_process_tree() gets artists and titles for the
+ * folders it finds.
+ *
+ * Since: 1.10
+ */
+typedef enum {
+	MEDIA_ART_TREE_POLICY_ALBUM_FOLDERS,
+	MEDIA_ART_TREE_POLICY_ARTIST_ALBUM_FOLDERS,
+} MediaArtTreePolicy;
+
 /**
  * MediaArtError:
  * @MEDIA_ART_ERROR_NO_STORAGE: Storage information is unknown, we
@@ -75,6 +97,9 @@ typedef enum {
  * XDG_CACHE_HOME directory could not be used to create the
  * 'media-art' subdirectory used for caching media art. This is
  * usually an initiation error.
+ * @MEDIA_ART_ERROR_QUARANTINED: Processing the same source failed
+ * before and it hasn't changed since, so it is not retried yet. Use
+ * %MEDIA_ART_PROCESS_FLAGS_FORCE to retry it anyway. Since: 1.10
  *
  * Enumeration values used in errors returned by the
  * #MediaArtError API.
@@ -86,7 +111,8 @@ typedef enum {
 	MEDIA_ART_ERROR_NO_TITLE,
 	MEDIA_ART_ERROR_SYMLINK_FAILED,
 	MEDIA_ART_ERROR_RENAME_FAILED,
-	MEDIA_ART_ERROR_NO_CACHE_DIR
+	MEDIA_ART_ERROR_NO_CACHE_DIR,
+	MEDIA_ART_ERROR_QUARANTINED
 } MediaArtError;
 
 
@@ -101,9 +127,84 @@ GQuark media_art_error_quark (void) G_GNUC_CONST;
 #define MEDIA_ART_IS_PROCESS_CLASS(c) (G_TYPE_CHECK_CLASS_TYPE ((c),  MEDIA_ART_TYPE_PROCESS))
 #define MEDIA_ART_PROCESS_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), MEDIA_ART_TYPE_PROCESS, MediaArtProcessClass))
 
+#define MEDIA_ART_TYPE_JOB             (media_art_job_get_type())
+
 typedef struct _MediaArtProcess MediaArtProcess;
 typedef struct _MediaArtProcessClass MediaArtProcessClass;
 
+/**
+ * MediaArtJob:
+ *
+ * An opaque handle for a queued or running processing request, as
+ * returned by media_art_process_file_submit() and friends.
+ *
+ * Since: 1.10
+ **/
+typedef struct _MediaArtJob MediaArtJob;
+
+/**
+ * MediaArtTreeFunc:
+ * @folder: the album folder which was processed
+ * @processed: %TRUE if media art was resolved for @folder, %FALSE if
+ * it has none or @error is set
+ * @error: (allow-none): why @folder could not be processed, or %NULL
+ * @n_done: the number of album folders processed so far, including
+ * @folder
+ * @n_pending: the number of folders found so far which are still
+ * being listed or processed
+ * @user_data: (closure): data passed to media_art_process_tree()
+ *
+ * Reports the result for one album folder of
+ * media_art_process_tree(). Folders further down are only found as
+ * their parents are listed, so @n_pending grows during the walk, but
+ * @n_done / (@n_done + @n_pending) makes a fair progress estimate.
+ *
+ * Since: 1.10
+ **/
+typedef void (*MediaArtTreeFunc) (GFile        *folder,
+                                  gboolean      processed,
+                                  const GError *error,
+                                  guint         n_done,
+                                  guint         n_pending,
+                                  gpointer      user_data);
+
+/**
+ * MediaArtResult:
+ * @user_data: the user data the request was made with
+ * @success: what the request's finish function would have returned
+ * @error: (allow-none): why the request failed, or %NULL
+ *
+ * The outcome of one asynchronous request, as delivered to a
+ * #MediaArtBatchFunc.
+ *
+ * Since: 1.10
+ **/
+typedef struct {
+	gpointer user_data;
+	gboolean success;
+	GError *error;
+} MediaArtResult;
+
+/**
+ * MediaArtBatchFunc:
+ * @process: the #MediaArtProcess the requests were made with
+ * @results: (array length=n_results): the results, in the order the
+ * requests completed
+ * @n_results: the number of @results
+ * @user_data: (closure): data passed to
+ * media_art_process_set_batch_func()
+ *
+ * Receives the results of asynchronous requests in batches, see
+ * media_art_process_set_batch_func(). @results and the errors in it
+ * are freed when this returns.
+ *
+ * Since: 1.10
+ **/
+typedef void (*MediaArtBatchFunc) (MediaArtProcess      *process,
+                                   const MediaArtResult *results,
+                                   guint                 n_results,
+                                   gpointer              user_data);
+
 /**
  * MediaArtProcess:
  *
@@ -131,6 +232,13 @@ GType            media_art_process_get_type      (void) G_GNUC_CONST;
 _LIBMEDIAART_EXTERN
 MediaArtProcess *media_art_process_new           (GError               **error);
 _LIBMEDIAART_EXTERN
+void             media_art_process_set_batch_func (MediaArtProcess     *process,
+                                                   guint                max_results,
+                                                   guint                max_delay,
+                                                   MediaArtBatchFunc    func,
+                                                   gpointer             user_data,
+                                                   GDestroyNotify       notify);
+_LIBMEDIAART_EXTERN
 gboolean         media_art_process_uri           (MediaArtProcess       *process,
                                                   MediaArtType           type,
                                                   MediaArtProcessFlags   flags,
@@ -151,6 +259,17 @@ void             media_art_process_uri_async     (MediaArtProcess       *process
                                                   GAsyncReadyCallback    callback,
                                                   gpointer               user_data);
 _LIBMEDIAART_EXTERN
+MediaArtJob *    media_art_process_uri_submit    (MediaArtProcess       *process,
+                                                  MediaArtType           type,
+                                                  MediaArtProcessFlags   flags,
+                                                  const gchar           *uri,
+                                                  const gchar           *artist,
+                                                  const gchar           *title,
+                                                  gint                   io_priority,
+                                                  GCancellable          *cancellable,
+                                                  GAsyncReadyCallback    callback,
+                                                  gpointer               user_data);
+_LIBMEDIAART_EXTERN
 gboolean         media_art_process_uri_finish    (MediaArtProcess       *process,
                                                   GAsyncResult          *result,
                                                   GError               **error);
@@ -175,6 +294,17 @@ void             media_art_process_file_async    (MediaArtProcess       *process
                                                   GAsyncReadyCallback    callback,
                                                   gpointer               user_data);
 _LIBMEDIAART_EXTERN
+MediaArtJob *    media_art_process_file_submit   (MediaArtProcess       *process,
+                                                  MediaArtType           type,
+                                                  MediaArtProcessFlags   flags,
+                                                  GFile                 *file,
+                                                  const gchar           *artist,
+                                                  const gchar           *title,
+                                                  gint                   io_priority,
+                                                  GCancellable          *cancellable,
+                                                  GAsyncReadyCallback    callback,
+                                                  gpointer               user_data);
+_LIBMEDIAART_EXTERN
 gboolean         media_art_process_file_finish   (MediaArtProcess       *process,
                                                   GAsyncResult          *result,
                                                   GError               **error);
@@ -205,10 +335,47 @@ void             media_art_process_buffer_async  (MediaArtProcess       *process
                                                   GAsyncReadyCallback    callback,
                                                   gpointer               user_data);
 _LIBMEDIAART_EXTERN
+MediaArtJob *    media_art_process_buffer_submit (MediaArtProcess       *process,
+                                                  MediaArtType           type,
+                                                  MediaArtProcessFlags   flags,
+                                                  GFile                 *related_file,
+                                                  const guchar          *buffer,
+                                                  gsize                  len,
+                                                  const gchar           *mime,
+                                                  const gchar           *artist,
+                                                  const gchar           *title,
+                                                  gint                   io_priority,
+                                                  GCancellable          *cancellable,
+                                                  GAsyncReadyCallback    callback,
+                                                  gpointer               user_data);
+_LIBMEDIAART_EXTERN
 gboolean         media_art_process_buffer_finish (MediaArtProcess       *process,
                                                   GAsyncResult          *result,
                                                   GError               **error);
 
+_LIBMEDIAART_EXTERN
+gboolean         media_art_process_tree          (MediaArtProcess       *process,
+                                                  MediaArtType           type,
+                                                  MediaArtProcessFlags   flags,
+                                                  GFile                 *root,
+                                                  MediaArtTreePolicy     policy,
+                                                  MediaArtTreeFunc       func,
+                                                  gpointer               user_data,
+                                                  GCancellable          *cancellable,
+                                                  GError               **error);
+
+_LIBMEDIAART_EXTERN
+GType            media_art_job_get_type          (void) G_GNUC_CONST;
+_LIBMEDIAART_EXTERN
+MediaArtJob *    media_art_job_ref               (MediaArtJob           *job);
+_LIBMEDIAART_EXTERN
+void             media_art_job_unref             (MediaArtJob           *job);
+_LIBMEDIAART_EXTERN
+gboolean         media_art_job_set_priority      (MediaArtJob           *job,
+                                                  gint                   io_priority);
+_LIBMEDIAART_EXTERN
+gint             media_art_job_get_priority      (MediaArtJob           *job);
+
 G_END_DECLS
 
 #endif /* __LIBMEDIAART_EXTRACT_H__ */
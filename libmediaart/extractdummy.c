@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include "extractgeneric.h"
+#include "extractprivate.h"
 
 /**
  * SECTION:plugins
@@ -119,3 +120,37 @@ media_art_buffer_to_jpeg (const unsigned char  *buffer,
 {
 	return FALSE;
 }
+
+gboolean
+media_art_file_to_jpeg_cancellable (const gchar                *filename,
+                                    const gchar                *target,
+                                    gboolean                    to_srgb,
+                                    MediaArtPlaceholderPixels  *placeholder,
+                                    GCancellable               *cancellable,
+                                    GError                    **error)
+{
+	return FALSE;
+}
+
+gboolean
+media_art_buffer_to_jpeg_cancellable (const unsigned char        *buffer,
+                                      size_t                      len,
+                                      const gchar                *buffer_mime,
+                                      const gchar                *target,
+                                      gboolean                    to_srgb,
+                                      MediaArtPlaceholderPixels  *placeholder,
+                                      GCancellable               *cancellable,
+                                      GError                    **error)
+{
+	return FALSE;
+}
+
+gboolean
+media_art_file_to_rgb (const gchar  *filename,
+                       gint          width,
+                       gint          height,
+                       guchar       *pixels,
+                       GError      **error)
+{
+	return FALSE;
+}
@@ -22,9 +22,27 @@
 
 #include "config.h"
 
+#include <stdio.h>
+#include <errno.h>
+
+#include <glib/gstdio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
+#ifdef HAVE_LCMS2
+#include <lcms2.h>
+#endif
+
 #include "extractgeneric.h"
+#include "extractprivate.h"
+#include "pool.h"
+
+/* How much we feed the loader between cancellation checks */
+#define LOADER_CHUNK_SIZE (64 * 1024)
+
+typedef struct {
+	FILE *file;
+	GCancellable *cancellable;
+} SaveData;
 
 static gint max_width_in_bytes = 0;
 
@@ -41,51 +59,384 @@ media_art_plugin_shutdown (void)
 {
 }
 
+static gboolean
+save_cb (const gchar  *buf,
+         gsize         count,
+         GError      **error,
+         gpointer      user_data)
+{
+	SaveData *data = user_data;
+
+	/* The encoder calls us once per output block, which is as
+	 * close as we get to a cancellation point inside it.
+	 */
+	if (!media_art_job_checkpoint (data->cancellable, error)) {
+		return FALSE;
+	}
+
+	if (fwrite (buf, 1, count, data->file) != count) {
+		g_set_error (error,
+		             G_IO_ERROR,
+		             g_io_error_from_errno (errno),
+		             "Could not write JPEG data: %s",
+		             g_strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+save_pixbuf (GdkPixbuf     *pixbuf,
+             const gchar   *target,
+             GCancellable  *cancellable,
+             GError       **error)
+{
+	SaveData data;
+	gboolean retval;
+
+	data.cancellable = cancellable;
+	data.file = g_fopen (target, "wb");
+
+	if (!data.file) {
+		g_set_error (error,
+		             G_IO_ERROR,
+		             g_io_error_from_errno (errno),
+		             "Could not open '%s' for writing: %s",
+		             target,
+		             g_strerror (errno));
+		return FALSE;
+	}
+
+	retval = gdk_pixbuf_save_to_callback (pixbuf, save_cb, &data, "jpeg", error, NULL);
+
+	if (fclose (data.file) != 0 && retval) {
+		g_set_error (error,
+		             G_IO_ERROR,
+		             g_io_error_from_errno (errno),
+		             "Could not close '%s': %s",
+		             target,
+		             g_strerror (errno));
+		retval = FALSE;
+	}
+
+	if (!retval) {
+		g_unlink (target);
+	}
+
+	return retval;
+}
+
+/* Converts the pixels of @pixbuf in place from the colour profile the
+ * loader found (PNG, JPEG and TIFF loaders set "icc-profile") to
+ * sRGB. The JPEG encoder is never given the profile, so it is left
+ * out when saving either way.
+ */
+static void
+pixbuf_convert_to_srgb (GdkPixbuf *pixbuf)
+{
+#ifdef HAVE_LCMS2
+	const gchar *icc_base64;
+	cmsHPROFILE src_profile, srgb_profile;
+	cmsHTRANSFORM transform;
+	cmsUInt32Number format;
+	guchar *icc, *row;
+	gsize icc_len;
+	gint width, height, rowstride, y;
+
+	icc_base64 = gdk_pixbuf_get_option (pixbuf, "icc-profile");
+
+	if (!icc_base64) {
+		return;
+	}
+
+	icc = g_base64_decode (icc_base64, &icc_len);
+	src_profile = cmsOpenProfileFromMem (icc, (cmsUInt32Number) icc_len);
+	g_free (icc);
+
+	if (!src_profile) {
+		g_debug ("Could not parse embedded colour profile, not converting to sRGB");
+		return;
+	}
+
+	/* Pixbufs are always RGB, CMYK JPEGs were converted already */
+	if (cmsGetColorSpace (src_profile) != cmsSigRgbData) {
+		cmsCloseProfile (src_profile);
+		return;
+	}
+
+	/* Alpha is left alone as the transform works in place */
+	format = gdk_pixbuf_get_has_alpha (pixbuf) ? TYPE_RGBA_8 : TYPE_RGB_8;
+	srgb_profile = cmsCreate_sRGBProfile ();
+	transform = cmsCreateTransform (src_profile, format,
+	                                srgb_profile, format,
+	                                INTENT_PERCEPTUAL,
+	                                0);
+	cmsCloseProfile (srgb_profile);
+	cmsCloseProfile (src_profile);
+
+	if (!transform) {
+		g_debug ("Could not create transform to sRGB");
+		return;
+	}
+
+	width = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	row = gdk_pixbuf_get_pixels (pixbuf);
+
+	for (y = 0; y < height; y++, row += rowstride) {
+		cmsDoTransform (transform, row, row, width);
+	}
+
+	cmsDeleteTransform (transform);
+#endif
+}
+
+static void
+pixbuf_pool_free_cb (guchar   *pixels,
+                     gpointer  user_data)
+{
+	media_art_pool_free (pixels, GPOINTER_TO_SIZE (user_data));
+}
+
+/* A pixbuf without alpha whose pixels live in pooled memory, which is
+ * given back when the pixbuf is finalized.
+ */
+static GdkPixbuf *
+pixbuf_new_pooled (gint width,
+                   gint height)
+{
+	guchar *pixels;
+	gsize size;
+	gint rowstride;
+
+	rowstride = (width * 3 + 3) & ~3;
+	size = (gsize) rowstride * height;
+	pixels = media_art_pool_alloc (size);
+
+	return gdk_pixbuf_new_from_data (pixels,
+	                                 GDK_COLORSPACE_RGB,
+	                                 FALSE,
+	                                 8,
+	                                 width,
+	                                 height,
+	                                 rowstride,
+	                                 pixbuf_pool_free_cb,
+	                                 GSIZE_TO_POINTER (size));
+}
+
+/* Returns @pixbuf scaled down to @max_width if it is wider (0 for
+ * no limit) and with any alpha flattened onto black like the Qt
+ * backend does, since the JPEG encoder would just drop it. The
+ * pixbuf returned must be unreffed, and is @pixbuf itself if there
+ * was nothing to do.
+ */
+static GdkPixbuf *
+pixbuf_prepare_for_jpeg (GdkPixbuf *pixbuf,
+                         gint       max_width)
+{
+	GdkPixbuf *prepared;
+	gint width, height;
+	gdouble scale;
+
+	width = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
+
+	if (max_width > 0 && width > max_width) {
+		g_debug ("Resizing media art to %d width", max_width);
+
+		scale = max_width / (gdouble) width;
+		width = max_width;
+		height = MAX ((gint) (height * scale), 1);
+	} else if (gdk_pixbuf_get_has_alpha (pixbuf)) {
+		scale = 1.0;
+	} else {
+		return g_object_ref (pixbuf);
+	}
+
+	prepared = pixbuf_new_pooled (width, height);
+
+	if (gdk_pixbuf_get_has_alpha (pixbuf)) {
+		gdk_pixbuf_composite_color (pixbuf, prepared,
+		                            0, 0, width, height,
+		                            0.0, 0.0, scale, scale,
+		                            GDK_INTERP_BILINEAR,
+		                            255,
+		                            0, 0, 256,
+		                            0x000000, 0x000000);
+	} else {
+		gdk_pixbuf_scale (pixbuf, prepared,
+		                  0, 0, width, height,
+		                  0.0, 0.0, scale, scale,
+		                  GDK_INTERP_BILINEAR);
+	}
+
+	return prepared;
+}
+
+/* Copies @pixbuf scaled to exactly @width x @height into @pixels as
+ * packed 8-bit RGB, see media_art_file_to_rgb().
+ */
+static void
+pixbuf_to_rgb (GdkPixbuf *pixbuf,
+               gint       width,
+               gint       height,
+               guchar    *pixels)
+{
+	GdkPixbuf *scaled;
+	const guchar *row;
+	gint n_channels, rowstride;
+	gboolean has_alpha;
+	gint x, y;
+
+	if (gdk_pixbuf_get_width (pixbuf) != width ||
+	    gdk_pixbuf_get_height (pixbuf) != height) {
+		scaled = gdk_pixbuf_scale_simple (pixbuf, width, height, GDK_INTERP_BILINEAR);
+	} else {
+		scaled = g_object_ref (pixbuf);
+	}
+
+	n_channels = gdk_pixbuf_get_n_channels (scaled);
+	rowstride = gdk_pixbuf_get_rowstride (scaled);
+	has_alpha = gdk_pixbuf_get_has_alpha (scaled);
+	row = gdk_pixbuf_get_pixels (scaled);
+
+	for (y = 0; y < height; y++, row += rowstride) {
+		for (x = 0; x < width; x++) {
+			const guchar *p = row + x * n_channels;
+			guint alpha = has_alpha ? p[3] : 255;
+
+			*pixels++ = p[0] * alpha / 255;
+			*pixels++ = p[1] * alpha / 255;
+			*pixels++ = p[2] * alpha / 255;
+		}
+	}
+
+	g_object_unref (scaled);
+}
+
+static void
+pixbuf_to_placeholder (GdkPixbuf                 *pixbuf,
+                       MediaArtPlaceholderPixels *placeholder)
+{
+	if (!placeholder) {
+		return;
+	}
+
+	pixbuf_to_rgb (pixbuf,
+	               MEDIA_ART_PLACEHOLDER_SIZE,
+	               MEDIA_ART_PLACEHOLDER_SIZE,
+	               placeholder->pixels);
+	placeholder->valid = TRUE;
+}
+
+static GdkPixbuf *
+load_pixbuf_from_stream (GInputStream  *stream,
+                         GCancellable  *cancellable,
+                         GError       **error)
+{
+	GdkPixbufLoader *loader;
+	GdkPixbuf *pixbuf = NULL;
+	guchar *buffer;
+	gssize rsize;
+
+	loader = gdk_pixbuf_loader_new ();
+	buffer = media_art_pool_alloc (LOADER_CHUNK_SIZE);
+
+	/* Rather than gdk_pixbuf_new_from_stream(), so the job's
+	 * deadline is honoured between chunks too.
+	 */
+	do {
+		if (!media_art_job_checkpoint (cancellable, error)) {
+			rsize = -1;
+			break;
+		}
+
+		rsize = g_input_stream_read (stream, buffer, LOADER_CHUNK_SIZE, cancellable, error);
+
+		if (rsize > 0 && !gdk_pixbuf_loader_write (loader, buffer, rsize, error)) {
+			rsize = -1;
+		}
+	} while (rsize > 0);
+
+	media_art_pool_free (buffer, LOADER_CHUNK_SIZE);
+
+	if (rsize < 0) {
+		gdk_pixbuf_loader_close (loader, NULL);
+	} else if (gdk_pixbuf_loader_close (loader, error)) {
+		pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+		if (pixbuf) {
+			g_object_ref (pixbuf);
+		} else {
+			g_set_error (error,
+			             GDK_PIXBUF_ERROR,
+			             GDK_PIXBUF_ERROR_FAILED,
+			             "Could not get pixbuf from GdkPixbufLoader");
+		}
+	}
+
+	g_object_unref (loader);
+
+	return pixbuf;
+}
+
 gboolean
 media_art_file_to_jpeg (const gchar  *filename,
                         const gchar  *target,
                         GError      **error)
 {
-	GdkPixbuf *pixbuf;
-	GError *local_error = NULL;
+	return media_art_file_to_jpeg_cancellable (filename, target, FALSE, NULL, NULL, error);
+}
+
+gboolean
+media_art_file_to_jpeg_cancellable (const gchar                *filename,
+                                    const gchar                *target,
+                                    gboolean                    to_srgb,
+                                    MediaArtPlaceholderPixels  *placeholder,
+                                    GCancellable               *cancellable,
+                                    GError                    **error)
+{
+	GdkPixbuf *pixbuf, *prepared;
+	GFile *file;
+	GFileInputStream *stream;
+	gboolean retval;
 
 	/* TODO: Add resizing support */
 
-	pixbuf = gdk_pixbuf_new_from_file (filename, &local_error);
+	file = g_file_new_for_path (filename);
+	stream = g_file_read (file, cancellable, error);
+	g_object_unref (file);
 
-	if (local_error) {
-		g_propagate_error (error, local_error);
+	if (!stream) {
 		return FALSE;
 	}
 
-	gdk_pixbuf_save (pixbuf, target, "jpeg", &local_error, NULL);
-	g_object_unref (pixbuf);
+	pixbuf = load_pixbuf_from_stream (G_INPUT_STREAM (stream), cancellable, error);
+	g_object_unref (stream);
 
-	if (local_error) {
-		g_propagate_error (error, local_error);
+	if (!pixbuf) {
 		return FALSE;
 	}
 
-	return TRUE;
-}
+	/* Before flattening, the profile is only on the loaded one */
+	if (to_srgb) {
+		pixbuf_convert_to_srgb (pixbuf);
+	}
 
-static void
-size_prepared_cb (GdkPixbufLoader *loader,
-                  gint             width,
-                  gint             height,
-                  gpointer         user_data)
-{
-	gfloat scale;
+	prepared = pixbuf_prepare_for_jpeg (pixbuf, 0);
+	g_object_unref (pixbuf);
 
-	if (max_width_in_bytes < 1 || width <= max_width_in_bytes) {
-		return;
-	}
+	retval = save_pixbuf (prepared, target, cancellable, error);
 
-	g_debug ("Resizing media art to %d width", max_width_in_bytes);
+	if (retval) {
+		pixbuf_to_placeholder (prepared, placeholder);
+	}
 
-	scale = width / (gfloat) max_width_in_bytes;
+	g_object_unref (prepared);
 
-	gdk_pixbuf_loader_set_size (loader, (gint) (width / scale), (gint) (height / scale));
+	return retval;
 }
 
 gboolean
@@ -94,48 +445,84 @@ media_art_buffer_to_jpeg (const unsigned char  *buffer,
                           const gchar          *buffer_mime,
                           const gchar          *target,
                           GError              **error)
+{
+	return media_art_buffer_to_jpeg_cancellable (buffer, len, buffer_mime, target, FALSE, NULL, NULL, error);
+}
+
+gboolean
+media_art_buffer_to_jpeg_cancellable (const unsigned char        *buffer,
+                                      size_t                      len,
+                                      const gchar                *buffer_mime,
+                                      const gchar                *target,
+                                      gboolean                    to_srgb,
+                                      MediaArtPlaceholderPixels  *placeholder,
+                                      GCancellable               *cancellable,
+                                      GError                    **error)
 {
 	GError *local_error = NULL;
+	MediaArtJpegCheck check;
+	size_t valid_len;
 
 	if (max_width_in_bytes < 0) {
 		g_debug ("Not saving album art from buffer, disabled in config");
 		return TRUE;
 	}
 
-	/* FF D8 FF are the three first bytes of JPeg images */
+#ifndef HAVE_LCMS2
+	/* Nothing to convert with, better keep the profile than
+	 * decode the JPEG only to lose it.
+	 */
+	to_srgb = FALSE;
+#endif
+
+	/* Only JPEGs which are structurally sound (or merely cut
+	 * short) are stored as they are, anything else is decoded so
+	 * that it fails here rather than in every client.
+	 */
 	if (max_width_in_bytes == 0 &&
 	    (g_strcmp0 (buffer_mime, "image/jpeg") == 0 ||
 	     g_strcmp0 (buffer_mime, "JPG") == 0) &&
-	    (buffer && len > 2 && buffer[0] == 0xff && buffer[1] == 0xd8 && buffer[2] == 0xff)) {
+	    !(to_srgb && media_art_jpeg_has_icc_profile (buffer, len)) &&
+	    (check = media_art_jpeg_check (buffer, len, &valid_len)) != MEDIA_ART_JPEG_INVALID) {
 		g_debug ("Saving album art using raw data as uri:'%s'", target);
-		if (!g_file_set_contents (target, (const gchar *) buffer, (gssize) len, error)) {
+		if (!media_art_job_checkpoint (cancellable, error)) {
+			return FALSE;
+		}
+
+		if (!media_art_jpeg_save (buffer, valid_len, check, target, error)) {
 			return FALSE;
 		}
 	} else {
-		GdkPixbuf *pixbuf;
+		GdkPixbuf *pixbuf, *prepared;
 		GdkPixbufLoader *loader;
+		gsize offset;
 
 		g_debug ("Saving album art using GdkPixbufLoader for uri:'%s' (max width:%d)",
 		         target,
 		         max_width_in_bytes);
 
 		loader = gdk_pixbuf_loader_new ();
-		if (max_width_in_bytes > 0) {
-			g_signal_connect (loader,
-			                  "size-prepared",
-			                  G_CALLBACK (size_prepared_cb),
-			                  NULL);
-		}
 
-		if (!gdk_pixbuf_loader_write (loader, buffer, len, &local_error)) {
-			g_warning ("Could not write with GdkPixbufLoader when setting media art, %s",
-			           local_error ? local_error->message : "no error given");
+		for (offset = 0; offset < len; offset += LOADER_CHUNK_SIZE) {
+			gsize chunk = MIN (len - offset, LOADER_CHUNK_SIZE);
 
-			g_propagate_error (error, local_error);
-			gdk_pixbuf_loader_close (loader, NULL);
-			g_object_unref (loader);
+			if (!media_art_job_checkpoint (cancellable, error)) {
+				gdk_pixbuf_loader_close (loader, NULL);
+				g_object_unref (loader);
 
-			return FALSE;
+				return FALSE;
+			}
+
+			if (!gdk_pixbuf_loader_write (loader, buffer + offset, chunk, &local_error)) {
+				g_warning ("Could not write with GdkPixbufLoader when setting media art, %s",
+				           local_error ? local_error->message : "no error given");
+
+				g_propagate_error (error, local_error);
+				gdk_pixbuf_loader_close (loader, NULL);
+				g_object_unref (loader);
+
+				return FALSE;
+			}
 		}
 
 		pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
@@ -143,25 +530,45 @@ media_art_buffer_to_jpeg (const unsigned char  *buffer,
 		if (pixbuf == NULL) {
 			g_warning ("Could not get pixbuf from GdkPixbufLoader when setting media art");
 
-			/* FIXME: Set error here */
+			/* Closing tells what was wrong with the data */
+			if (gdk_pixbuf_loader_close (loader, error)) {
+				g_set_error (error,
+				             GDK_PIXBUF_ERROR,
+				             GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+				             "Could not get pixbuf from GdkPixbufLoader");
+			}
 
-			gdk_pixbuf_loader_close (loader, NULL);
 			g_object_unref (loader);
 
 			return FALSE;
 		}
 
-		if (!gdk_pixbuf_save (pixbuf, target, "jpeg", &local_error, NULL)) {
-			g_warning ("Could not save GdkPixbuf when setting media art, %s",
-			           local_error ? local_error->message : "no error given");
+		if (to_srgb) {
+			pixbuf_convert_to_srgb (pixbuf);
+		}
+
+		/* Scaled here rather than by the loader, so that the
+		 * copy we encode from comes from the pool.
+		 */
+		prepared = pixbuf_prepare_for_jpeg (pixbuf, max_width_in_bytes);
+
+		if (!save_pixbuf (prepared, target, cancellable, &local_error)) {
+			if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+				g_warning ("Could not save GdkPixbuf when setting media art, %s",
+				           local_error ? local_error->message : "no error given");
+			}
 
 			g_propagate_error (error, local_error);
+			g_object_unref (prepared);
 			gdk_pixbuf_loader_close (loader, NULL);
 			g_object_unref (loader);
 
 			return FALSE;
 		}
 
+		pixbuf_to_placeholder (prepared, placeholder);
+		g_object_unref (prepared);
+
 		if (!gdk_pixbuf_loader_close (loader, &local_error)) {
 			g_warning ("Could not close GdkPixbufLoader when setting media art, %s",
 			           local_error ? local_error->message : "no error given");
@@ -176,3 +583,27 @@ media_art_buffer_to_jpeg (const unsigned char  *buffer,
 
 	return TRUE;
 }
+
+gboolean
+media_art_file_to_rgb (const gchar  *filename,
+                       gint          width,
+                       gint          height,
+                       guchar       *pixels,
+                       GError      **error)
+{
+	GdkPixbuf *pixbuf;
+
+	/* Loaders which support it (JPEG does) decode straight at a
+	 * reduced size here, so this is much cheaper than a full load.
+	 */
+	pixbuf = gdk_pixbuf_new_from_file_at_scale (filename, width, height, FALSE, error);
+
+	if (!pixbuf) {
+		return FALSE;
+	}
+
+	pixbuf_to_rgb (pixbuf, width, height, pixels);
+	g_object_unref (pixbuf);
+
+	return TRUE;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LIBMEDIAART_EXTRACTPRIVATE_H__
+#define __LIBMEDIAART_EXTRACTPRIVATE_H__
+
+#include <gio/gio.h>
+
+#include "placeholder.h"
+
+G_BEGIN_DECLS
+
+/* A placeholder sized RGB copy of the image a backend decoded, so
+ * the placeholder of what it saved can be made without decoding
+ * that again. Left invalid for JPEGs stored as they are.
+ */
+typedef struct {
+	gboolean valid;
+	guchar pixels[MEDIA_ART_PLACEHOLDER_SIZE * MEDIA_ART_PLACEHOLDER_SIZE * 3];
+} MediaArtPlaceholderPixels;
+
+/* Internal variants of the plugin API which give up as soon as
+ * @cancellable is triggered. Nothing is left at @target when they
+ * fail. With @to_srgb, images with a colour profile are converted
+ * to sRGB and saved without it (MEDIA_ART_PROCESS_FLAGS_SRGB).
+ * @placeholder, if not %NULL, is filled in when the image had to
+ * be decoded.
+ */
+gboolean  media_art_file_to_jpeg_cancellable   (const gchar                *filename,
+                                                const gchar                *target,
+                                                gboolean                    to_srgb,
+                                                MediaArtPlaceholderPixels  *placeholder,
+                                                GCancellable               *cancellable,
+                                                GError                    **error);
+gboolean  media_art_buffer_to_jpeg_cancellable (const unsigned char        *buffer,
+                                                size_t                      len,
+                                                const gchar                *buffer_mime,
+                                                const gchar                *target,
+                                                gboolean                    to_srgb,
+                                                MediaArtPlaceholderPixels  *placeholder,
+                                                GCancellable               *cancellable,
+                                                GError                    **error);
+
+/* Decodes @filename scaled to exactly @width x @height, ignoring
+ * its aspect ratio, into @pixels as packed 8-bit RGB. Transparent
+ * areas come out black, like they do in the JPEGs we save.
+ */
+gboolean  media_art_file_to_rgb                (const gchar          *filename,
+                                                gint                  width,
+                                                gint                  height,
+                                                guchar               *pixels,
+                                                GError              **error);
+
+gboolean  media_art_job_checkpoint             (GCancellable         *cancellable,
+                                                GError              **error);
+
+typedef enum {
+	MEDIA_ART_JPEG_INVALID,
+	MEDIA_ART_JPEG_TRUNCATED,
+	MEDIA_ART_JPEG_VALID
+} MediaArtJpegCheck;
+
+/* For the backends to decide whether a JPEG buffer can be stored
+ * without decoding it, see extract.c.
+ */
+MediaArtJpegCheck media_art_jpeg_check         (const unsigned char  *buffer,
+                                                size_t                len,
+                                                size_t               *valid_len);
+gboolean  media_art_jpeg_save                  (const unsigned char  *buffer,
+                                                size_t                valid_len,
+                                                MediaArtJpegCheck     check,
+                                                const gchar          *target,
+                                                GError              **error);
+gboolean  media_art_jpeg_has_icc_profile       (const unsigned char  *buffer,
+                                                size_t                len);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_EXTRACTPRIVATE_H__ */
@@ -29,11 +29,23 @@
 #include <QCoreApplication>
 #include <QColor>
 #include <QPainter>
+#include <QtGlobal>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QColorSpace>
+#define HAVE_QCOLORSPACE 1
+#endif
 
 #include <glib.h>
 
 #include <stdlib.h>
 
+#include "extractprivate.h"
+#include "pool.h"
+
+/* How much we read between cancellation checks */
+#define READ_CHUNK_SIZE (64 * 1024)
+
 G_BEGIN_DECLS
 
 static QCoreApplication *app = NULL;
@@ -66,10 +78,127 @@ media_art_plugin_shutdown (void)
 	// delete app;
 }
 
+/* Saves @image as a JPEG, painted over black first if it has an
+ * alpha channel. The flattened copy is drawn in a pooled buffer.
+ */
+static gboolean
+save_image (const QImage  &image,
+            const gchar   *target,
+            GError       **error)
+{
+	gboolean retval;
+
+	if (!image.hasAlphaChannel ()) {
+		retval = image.save (QString (target), "jpeg");
+	} else {
+		gsize stride = (gsize) image.width () * 4;
+		gsize size = stride * image.height ();
+		uchar *data = (uchar *) media_art_pool_alloc (size);
+
+		{
+			QImage flat (data, image.width (), image.height (), (int) stride, QImage::Format_RGB32);
+			flat.fill (QColor (Qt::black).rgb ());
+
+			QPainter painter (&flat);
+			painter.drawImage (0, 0, image);
+			painter.end ();
+
+			retval = flat.save (QString (target), "jpeg");
+		}
+
+		media_art_pool_free (data, size);
+	}
+
+	if (!retval) {
+		g_set_error (error,
+		             G_IO_ERROR,
+		             G_IO_ERROR_FAILED,
+		             "Could not save media art to '%s'",
+		             target);
+	}
+
+	return retval;
+}
+
+/* Copies @image into @pixels as packed 8-bit RGB, painted over black
+ * first like save_image() does, see media_art_file_to_rgb().
+ */
+static void
+image_to_rgb (const QImage &image,
+              guchar       *pixels)
+{
+	QImage flat (image.size (), QImage::Format_RGB32);
+	flat.fill (QColor (Qt::black).rgb ());
+
+	QPainter painter (&flat);
+	painter.drawImage (0, 0, image);
+	painter.end ();
+
+	for (gint y = 0; y < flat.height (); y++) {
+		for (gint x = 0; x < flat.width (); x++) {
+			QRgb rgb = flat.pixel (x, y);
+
+			*pixels++ = qRed (rgb);
+			*pixels++ = qGreen (rgb);
+			*pixels++ = qBlue (rgb);
+		}
+	}
+}
+
+static void
+image_to_placeholder (const QImage              &image,
+                      MediaArtPlaceholderPixels *placeholder)
+{
+	if (!placeholder) {
+		return;
+	}
+
+	image_to_rgb (image.scaled (MEDIA_ART_PLACEHOLDER_SIZE,
+	                            MEDIA_ART_PLACEHOLDER_SIZE,
+	                            Qt::IgnoreAspectRatio,
+	                            Qt::SmoothTransformation),
+	              placeholder->pixels);
+	placeholder->valid = TRUE;
+}
+
+/* Converts @image from its embedded colour profile to sRGB, and drops
+ * the profile so that the JPEG writer doesn't embed one either.
+ */
+static void
+image_convert_to_srgb (QImage &image)
+{
+#ifdef HAVE_QCOLORSPACE
+	QColorSpace srgb (QColorSpace::SRgb);
+
+	if (!image.colorSpace ().isValid ()) {
+		return;
+	}
+
+	if (image.colorSpace () != srgb) {
+		image.convertToColorSpace (srgb);
+	}
+
+	image.setColorSpace (QColorSpace ());
+#else
+	Q_UNUSED (image);
+#endif
+}
+
 gboolean
 media_art_file_to_jpeg (const gchar  *filename,
                         const gchar  *target,
                         GError      **error)
+{
+	return media_art_file_to_jpeg_cancellable (filename, target, FALSE, NULL, NULL, error);
+}
+
+gboolean
+media_art_file_to_jpeg_cancellable (const gchar                *filename,
+                                    const gchar                *target,
+                                    gboolean                    to_srgb,
+                                    MediaArtPlaceholderPixels  *placeholder,
+                                    GCancellable               *cancellable,
+                                    GError                    **error)
 {
 	if (max_width_in_bytes < 0) {
 		g_debug ("Not saving album art from file, disabled in config");
@@ -77,7 +206,6 @@ media_art_file_to_jpeg (const gchar  *filename,
 	}
 
 	/* TODO: Add resizing support */
-	/* TODO: Add error reporting */
 
 	QFile file (filename);
 
@@ -86,32 +214,71 @@ media_art_file_to_jpeg (const gchar  *filename,
 		return FALSE;
 	}
 
-	QByteArray array = file.readAll ();
-	QBuffer buffer (&array);
+	gsize size = (gsize) MAX (file.size (), 0);
+	gsize n_read = 0;
+	char *data;
 
-	buffer.open (QIODevice::ReadOnly);
+	/* Read into a pooled buffer rather than growing a QByteArray */
+	data = (char *) media_art_pool_alloc (MAX (size, 1));
 
-	QImageReader reader (&buffer);
+	while (n_read < size) {
+		if (!media_art_job_checkpoint (cancellable, error)) {
+			media_art_pool_free (data, MAX (size, 1));
+			return FALSE;
+		}
 
-	if (!reader.canRead ()) {
+		qint64 r = file.read (data + n_read, MIN (size - n_read, (gsize) READ_CHUNK_SIZE));
+
+		if (r <= 0) {
+			break;
+		}
+
+		n_read += r;
+	}
+
+	QImage image1;
+	gboolean readable;
+
+	{
+		QByteArray array = QByteArray::fromRawData (data, (int) n_read);
+		QBuffer buffer (&array);
+
+		buffer.open (QIODevice::ReadOnly);
+
+		QImageReader reader (&buffer);
+
+		readable = reader.canRead ();
+
+		if (readable) {
+			image1 = reader.read ();
+		}
+	}
+
+	media_art_pool_free (data, MAX (size, 1));
+
+	if (!readable) {
 		g_message ("Could not get QImageReader from file: '%s', reader.canRead was FALSE",
 		           filename);
 		return FALSE;
 	}
 
-	QImage image1;
-	image1 = reader.read ();
-
-	if (image1.hasAlphaChannel ()) {
-		QImage image2 (image1.size(), QImage::Format_RGB32);
-		image2.fill (QColor(Qt::black).rgb());
-		QPainter painter (&image2);
-		painter.drawImage (0, 0, image1);
-		image2.save (QString (target), "jpeg");
-	} else {
-		image1.save (QString (target), "jpeg");
+	/* QImageReader can't be interrupted, so check again before
+	 * spending time on the encode.
+	 */
+	if (!media_art_job_checkpoint (cancellable, error)) {
+		return FALSE;
+	}
+
+	if (to_srgb) {
+		image_convert_to_srgb (image1);
 	}
 
+	if (!save_image (image1, target, error)) {
+		return FALSE;
+	}
+
+	image_to_placeholder (image1, placeholder);
+
 	return TRUE;
 }
 
@@ -122,18 +289,52 @@ media_art_buffer_to_jpeg (const unsigned char  *buffer,
                           const gchar          *target,
                           GError              **error)
 {
+	return media_art_buffer_to_jpeg_cancellable (buffer, len, buffer_mime, target, FALSE, NULL, NULL, error);
+}
+
+gboolean
+media_art_buffer_to_jpeg_cancellable (const unsigned char        *buffer,
+                                      size_t                      len,
+                                      const gchar                *buffer_mime,
+                                      const gchar                *target,
+                                      gboolean                    to_srgb,
+                                      MediaArtPlaceholderPixels  *placeholder,
+                                      GCancellable               *cancellable,
+                                      GError                    **error)
+{
+	if (!media_art_job_checkpoint (cancellable, error)) {
+		return FALSE;
+	}
+
+	MediaArtJpegCheck check = MEDIA_ART_JPEG_INVALID;
+	size_t valid_len = 0;
+
 	if (max_width_in_bytes < 0) {
 		g_debug ("Not saving album art from buffer, disabled in config");
 		return TRUE;
 	}
 
-	/* FF D8 FF are the three first bytes of JPeg images */
+	/* Only JPEGs which are structurally sound (or merely cut
+	 * short) are stored as they are, anything else is decoded so
+	 * that it fails here rather than in every client.
+	 */
+#ifndef HAVE_QCOLORSPACE
+	/* Nothing to convert with, better keep the profile than
+	 * decode the JPEG only to lose it.
+	 */
+	to_srgb = FALSE;
+#endif
+
 	if (max_width_in_bytes == 0 &&
 	    (g_strcmp0 (buffer_mime, "image/jpeg") == 0 ||
 	     g_strcmp0 (buffer_mime, "JPG") == 0) &&
-	    (buffer && len > 2 && buffer[0] == 0xff && buffer[1] == 0xd8 && buffer[2] == 0xff)) {
+	    !(to_srgb && media_art_jpeg_has_icc_profile (buffer, len))) {
+		check = media_art_jpeg_check (buffer, len, &valid_len);
+	}
+
+	if (check != MEDIA_ART_JPEG_INVALID) {
 		g_debug ("Saving album art using raw data as uri:'%s'", target);
-		if (!g_file_set_contents (target, (const gchar*) buffer, (gssize) len, error)) {
+		if (!media_art_jpeg_save (buffer, valid_len, check, target, error)) {
 			return FALSE;
 		}
 	} else {
@@ -141,9 +342,9 @@ media_art_buffer_to_jpeg (const unsigned char  *buffer,
 		QByteArray array;
 
 		/* TODO: Add resizing support */
-		/* TODO: Add error reporting */
 
-		array = QByteArray ((const char *) buffer, (int) len);
+		/* The reader only reads from it, no need for a copy */
+		array = QByteArray::fromRawData ((const char *) buffer, (int) len);
 
 		QBuffer qbuffer (&array);
 		qbuffer.open (QIODevice::ReadOnly);
@@ -166,20 +367,68 @@ media_art_buffer_to_jpeg (const unsigned char  *buffer,
 		QImage image1;
 		image1 = reader->read ();
 
-		if (image1.hasAlphaChannel ()) {
-			QImage image2 (image1.size(), QImage::Format_RGB32);
-			image2.fill (QColor(Qt::black).rgb());
-			QPainter painter (&image2);
-			painter.drawImage (0, 0, image1);
-			image2.save (QString (target), "jpeg");
-		} else {
-			image1.save (QString (target), "jpeg");
+		if (!media_art_job_checkpoint (cancellable, error)) {
+			delete reader;
+			return FALSE;
+		}
+
+		if (image1.isNull ()) {
+			g_set_error (error,
+			             G_IO_ERROR,
+			             G_IO_ERROR_INVALID_DATA,
+			             "Could not read media art from buffer, %s",
+			             reader->errorString ().toUtf8 ().constData ());
+			delete reader;
+			return FALSE;
 		}
 
 		delete reader;
+
+		if (to_srgb) {
+			image_convert_to_srgb (image1);
+		}
+
+		if (!save_image (image1, target, error)) {
+			return FALSE;
+		}
+
+		image_to_placeholder (image1, placeholder);
 	}
 
 	return TRUE;
 }
 
+gboolean
+media_art_file_to_rgb (const gchar  *filename,
+                       gint          width,
+                       gint          height,
+                       guchar       *pixels,
+                       GError      **error)
+{
+	QImageReader reader ((QString (filename)));
+
+	/* Lets the JPEG plugin decode at a reduced size */
+	reader.setScaledSize (QSize (width, height));
+
+	QImage image1 = reader.read ();
+
+	if (image1.isNull ()) {
+		g_set_error (error,
+		             G_IO_ERROR,
+		             G_IO_ERROR_INVALID_DATA,
+		             "Could not read image '%s': %s",
+		             filename,
+		             reader.errorString ().toUtf8 ().constData ());
+		return FALSE;
+	}
+
+	if (image1.size () != QSize (width, height)) {
+		image1 = image1.scaled (width, height);
+	}
+
+	image_to_rgb (image1, pixels);
+
+	return TRUE;
+}
+
 G_END_DECLS
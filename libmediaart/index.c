@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/file.h>
+
+#include <glib/gstdio.h>
+
+#include "index.h"
+
+/* Lookup tables kept next to the media art cache, in
+ * $XDG_CACHE_HOME/media-art/.index/. Each table is a directory of
+ * symlinks named after the MD5 of whatever is being looked up, and
+ * pointing to the basename of a cache entry, which keeps every
+ * mapping one readlink() away and needs no locking: links are
+ * replaced atomically with rename().
+ *
+ * The media art cache spec doesn't know about .index, and clients
+ * listing the cache skip dot files already.
+ *
+ * The "uri" table is the exception: a symlink for every media file
+ * ever processed would be hundreds of thousands of inodes on a large
+ * collection, most of them pointing at a few thousand albums. It is
+ * split into buckets instead, files named after the first characters
+ * of the keys they hold, with a "<key> <basename>" line per key.
+ * Buckets are replaced with rename() under the flock() of
+ * .index/uri.lock, so readers need no locking either.
+ */
+
+#define INDEX_DIR_NAME ".index"
+
+#define INDEX_URI_TABLE        "uri"
+#define INDEX_URI_BUCKET_CHARS 3 /* 4096 buckets */
+
+gchar *
+media_art_index_get_dir (const gchar *subdir)
+{
+	return g_build_filename (g_get_user_cache_dir (),
+	                         "media-art",
+	                         INDEX_DIR_NAME,
+	                         subdir,
+	                         NULL);
+}
+
+gchar *
+_media_art_index_get_key (const gchar *str)
+{
+	return g_compute_checksum_for_string (G_CHECKSUM_MD5, str, -1);
+}
+
+static gchar *
+index_get_link_path (const gchar *subdir,
+                     const gchar *key)
+{
+	return g_build_filename (g_get_user_cache_dir (),
+	                         "media-art",
+	                         INDEX_DIR_NAME,
+	                         subdir,
+	                         key,
+	                         NULL);
+}
+
+/* Stores @value (which may not contain slashes) under @subdir/@key,
+ * as the target of a symlink. Returns FALSE if that could not be
+ * done, for callers which care.
+ */
+gboolean
+_media_art_index_set_value (const gchar *subdir,
+                            const gchar *key,
+                            const gchar *value)
+{
+	gchar *link_path, *tmp_path, *current;
+	gboolean retval = FALSE;
+	gint result;
+
+	link_path = index_get_link_path (subdir, key);
+
+	/* Rewriting the same value is the common case on rescans */
+	current = g_file_read_link (link_path, NULL);
+
+	if (g_strcmp0 (current, value) == 0) {
+		g_free (current);
+		g_free (link_path);
+		return TRUE;
+	}
+
+	g_free (current);
+
+	tmp_path = g_strdup_printf ("%s.%08x", link_path, g_random_int ());
+
+	result = symlink (value, tmp_path);
+
+	if (result != 0 && errno == ENOENT) {
+		gchar *dir;
+
+		/* First entry in this table */
+		dir = media_art_index_get_dir (subdir);
+		g_mkdir_with_parents (dir, 0770);
+		g_free (dir);
+
+		result = symlink (value, tmp_path);
+	}
+
+	if (result != 0) {
+		g_debug ("Could not create index link '%s': %s",
+		         tmp_path, g_strerror (errno));
+		goto out;
+	}
+
+	if (g_rename (tmp_path, link_path) != 0) {
+		g_debug ("Could not rename index link '%s' to '%s': %s",
+		         tmp_path, link_path, g_strerror (errno));
+		g_unlink (tmp_path);
+		goto out;
+	}
+
+	retval = TRUE;
+
+out:
+	g_free (tmp_path);
+	g_free (link_path);
+
+	return retval;
+}
+
+gchar *
+_media_art_index_get_value (const gchar *subdir,
+                            const gchar *key)
+{
+	gchar *link_path, *value;
+
+	link_path = index_get_link_path (subdir, key);
+	value = g_file_read_link (link_path, NULL);
+	g_free (link_path);
+
+	return value;
+}
+
+void
+_media_art_index_remove_value (const gchar *subdir,
+                               const gchar *key)
+{
+	gchar *link_path;
+
+	link_path = index_get_link_path (subdir, key);
+	g_unlink (link_path);
+	g_free (link_path);
+}
+
+/* Points @subdir/@key at @cache_path, which must be inside the
+ * media art cache.
+ */
+gboolean
+media_art_index_set_link (const gchar *subdir,
+                          const gchar *key,
+                          const gchar *cache_path)
+{
+	gchar *basename;
+	gboolean retval;
+
+	basename = g_path_get_basename (cache_path);
+	retval = _media_art_index_set_value (subdir, key, basename);
+	g_free (basename);
+
+	return retval;
+}
+
+/* Takes @target, the basename of a cache entry as stored in a
+ * table, and returns the entry's path if it still exists.
+ */
+static gchar *
+index_get_cache_path (gchar *target)
+{
+	gchar *cache_path;
+
+	if (!target) {
+		return NULL;
+	}
+
+	/* Only ever a basename, anything else was not written by us */
+	if (strchr (target, G_DIR_SEPARATOR) != NULL) {
+		g_free (target);
+		return NULL;
+	}
+
+	cache_path = g_build_filename (g_get_user_cache_dir (),
+	                               "media-art",
+	                               target,
+	                               NULL);
+	g_free (target);
+
+	if (!g_file_test (cache_path, G_FILE_TEST_EXISTS)) {
+		g_free (cache_path);
+		return NULL;
+	}
+
+	return cache_path;
+}
+
+/* Returns the cache entry @subdir/@key points at, if it still
+ * exists.
+ */
+gchar *
+media_art_index_get_link (const gchar *subdir,
+                          const gchar *key)
+{
+	return index_get_cache_path (_media_art_index_get_value (subdir, key));
+}
+
+static gchar *
+index_uri_get_bucket_path (const gchar *key)
+{
+	gchar *bucket, *path;
+
+	bucket = g_strndup (key, INDEX_URI_BUCKET_CHARS);
+	path = index_get_link_path (INDEX_URI_TABLE, bucket);
+	g_free (bucket);
+
+	return path;
+}
+
+/* Returns the line of @contents holding @key, without its newline,
+ * or %NULL if there is none.
+ */
+static const gchar *
+index_uri_bucket_find (const gchar *contents,
+                       const gchar *key,
+                       gsize       *line_len)
+{
+	const gchar *line, *end;
+	gsize key_len;
+
+	key_len = strlen (key);
+
+	for (line = contents; *line; line = *end ? end + 1 : end) {
+		end = strchr (line, '\n');
+
+		if (!end) {
+			end = line + strlen (line);
+		}
+
+		if ((gsize) (end - line) > key_len + 1 &&
+		    strncmp (line, key, key_len) == 0 &&
+		    line[key_len] == ' ') {
+			*line_len = end - line;
+			return line;
+		}
+	}
+
+	return NULL;
+}
+
+static gchar *
+index_uri_bucket_get (const gchar *contents,
+                      const gchar *key)
+{
+	const gchar *line;
+	gsize line_len, key_len;
+
+	if (!contents) {
+		return NULL;
+	}
+
+	line = index_uri_bucket_find (contents, key, &line_len);
+
+	if (!line) {
+		return NULL;
+	}
+
+	key_len = strlen (key);
+
+	return g_strndup (line + key_len + 1, line_len - key_len - 1);
+}
+
+/* Replaces @path with @contents, like g_file_set_contents() minus
+ * the fsync(), which an index that can be rebuilt does not need.
+ */
+static void
+index_uri_bucket_write (const gchar *path,
+                        GString     *contents)
+{
+	gchar *tmp_path;
+	gssize written;
+	gint fd;
+
+	tmp_path = g_strdup_printf ("%s.%08x", path, g_random_int ());
+	fd = g_open (tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+
+	if (fd < 0) {
+		g_debug ("Could not create index bucket '%s': %s",
+		         tmp_path, g_strerror (errno));
+		g_free (tmp_path);
+		return;
+	}
+
+	written = write (fd, contents->str, contents->len);
+	close (fd);
+
+	if (written != (gssize) contents->len) {
+		g_debug ("Could not write index bucket '%s'", tmp_path);
+		g_unlink (tmp_path);
+	} else if (g_rename (tmp_path, path) != 0) {
+		g_debug ("Could not rename index bucket '%s' to '%s': %s",
+		         tmp_path, path, g_strerror (errno));
+		g_unlink (tmp_path);
+	}
+
+	g_free (tmp_path);
+}
+
+/* Returns the locked lock file, to close() when done, or -1 if it
+ * could not be opened, in which case we go ahead unlocked.
+ */
+static gint
+index_uri_lock (void)
+{
+	gchar *dir, *path;
+	gint fd;
+
+	dir = media_art_index_get_dir (INDEX_URI_TABLE);
+	g_mkdir_with_parents (dir, 0770);
+	g_free (dir);
+
+	path = media_art_index_get_dir (INDEX_URI_TABLE ".lock");
+	fd = g_open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+
+	if (fd < 0) {
+		g_debug ("Could not open index lock '%s': %s",
+		         path, g_strerror (errno));
+		g_free (path);
+		return -1;
+	}
+
+	g_free (path);
+
+	while (flock (fd, LOCK_EX) != 0 && errno == EINTR)
+		;
+
+	return fd;
+}
+
+void
+_media_art_index_set_uri (const gchar *uri,
+                          const gchar *cache_path)
+{
+	gchar *key, *basename, *bucket_path, *current;
+	gchar *contents = NULL;
+	const gchar *line;
+	GString *updated;
+	gsize line_len;
+	gint lock_fd;
+
+	key = _media_art_index_get_key (uri);
+	basename = g_path_get_basename (cache_path);
+	bucket_path = index_uri_get_bucket_path (key);
+
+	/* Rewriting the same value is the common case on rescans */
+	g_file_get_contents (bucket_path, &contents, NULL, NULL);
+	current = index_uri_bucket_get (contents, key);
+
+	if (g_strcmp0 (current, basename) == 0) {
+		goto out;
+	}
+
+	lock_fd = index_uri_lock ();
+
+	/* Someone may have replaced it meanwhile */
+	g_clear_pointer (&contents, g_free);
+	g_file_get_contents (bucket_path, &contents, NULL, NULL);
+
+	updated = g_string_new (NULL);
+
+	if (contents) {
+		line = index_uri_bucket_find (contents, key, &line_len);
+
+		if (line) {
+			g_string_append_len (updated, contents, line - contents);
+			line += line_len;
+			g_string_append (updated, *line ? line + 1 : line);
+		} else {
+			g_string_append (updated, contents);
+		}
+	}
+
+	g_string_append_printf (updated, "%s %s\n", key, basename);
+	index_uri_bucket_write (bucket_path, updated);
+	g_string_free (updated, TRUE);
+
+	if (lock_fd >= 0) {
+		close (lock_fd);
+	}
+
+out:
+	g_free (current);
+	g_free (contents);
+	g_free (bucket_path);
+	g_free (basename);
+	g_free (key);
+}
+
+gchar *
+media_art_index_lookup_uri (const gchar *uri)
+{
+	gchar *key, *bucket_path;
+	gchar *contents = NULL;
+	gchar *target;
+
+	key = _media_art_index_get_key (uri);
+	bucket_path = index_uri_get_bucket_path (key);
+
+	g_file_get_contents (bucket_path, &contents, NULL, NULL);
+	target = index_uri_bucket_get (contents, key);
+
+	g_free (contents);
+	g_free (bucket_path);
+	g_free (key);
+
+	return index_get_cache_path (target);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LIBMEDIAART_INDEX_H__
+#define __LIBMEDIAART_INDEX_H__
+
+#include <glib.h>
+
+#include "mediaart-macros.h"
+
+G_BEGIN_DECLS
+
+gchar   *media_art_index_get_dir       (const gchar *subdir);
+_LIBMEDIAART_EXTERN
+gchar   *_media_art_index_get_key      (const gchar *str);
+
+_LIBMEDIAART_EXTERN
+gboolean _media_art_index_set_value    (const gchar *subdir,
+                                        const gchar *key,
+                                        const gchar *value);
+_LIBMEDIAART_EXTERN
+gchar   *_media_art_index_get_value    (const gchar *subdir,
+                                        const gchar *key);
+_LIBMEDIAART_EXTERN
+void     _media_art_index_remove_value (const gchar *subdir,
+                                        const gchar *key);
+
+gboolean media_art_index_set_link      (const gchar *subdir,
+                                        const gchar *key,
+                                        const gchar *cache_path);
+gchar   *media_art_index_get_link      (const gchar *subdir,
+                                        const gchar *key);
+
+_LIBMEDIAART_EXTERN
+void     _media_art_index_set_uri      (const gchar *uri,
+                                        const gchar *cache_path);
+gchar   *media_art_index_lookup_uri    (const gchar *uri);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_INDEX_H__ */
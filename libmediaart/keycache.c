@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include "keycache.h"
+
+/* The set of heuristic keys (see get_heuristic_for_parent_path() in
+ * extract.c) a MediaArtProcess has already found media art for.
+ *
+ * Each instance has a private, unbounded one by default. With the
+ * MediaArtProcess:shared-cache property, instances share a single
+ * process-wide cache instead, which exists as long as one of them
+ * does, and which forgets its least recently used keys beyond
+ * KEY_CACHE_SHARED_MAX_SIZE.
+ */
+
+#define KEY_CACHE_SHARED_MAX_SIZE (4 * 1024 * 1024)
+
+/* Rough cost of an entry besides its key: hash table slot, list link
+ * and malloc() headers.
+ */
+#define KEY_CACHE_ENTRY_OVERHEAD  (8 * sizeof (gpointer))
+
+struct _MediaArtKeyCache {
+	gint ref_count;
+	gboolean shared;
+
+	GMutex lock;
+	GHashTable *keys;
+	/* Most recently used first, owns the keys */
+	GQueue lru;
+	gsize size;
+	gsize max_size;
+};
+
+static GMutex shared_lock;
+static MediaArtKeyCache *shared_cache;
+
+static gsize
+key_cache_entry_size (const gchar *key)
+{
+	return strlen (key) + 1 + KEY_CACHE_ENTRY_OVERHEAD;
+}
+
+static void
+key_cache_free (MediaArtKeyCache *cache)
+{
+	g_hash_table_unref (cache->keys);
+	g_queue_foreach (&cache->lru, (GFunc) g_free, NULL);
+	g_queue_clear (&cache->lru);
+	g_mutex_clear (&cache->lock);
+	g_slice_free (MediaArtKeyCache, cache);
+}
+
+/*
+ * media_art_key_cache_new:
+ * @max_size: the memory the cache may use in bytes, or 0 for no limit
+ */
+MediaArtKeyCache *
+media_art_key_cache_new (gsize max_size)
+{
+	MediaArtKeyCache *cache;
+
+	cache = g_slice_new0 (MediaArtKeyCache);
+	cache->ref_count = 1;
+	cache->max_size = max_size;
+	cache->keys = g_hash_table_new (g_str_hash, g_str_equal);
+	g_queue_init (&cache->lru);
+	g_mutex_init (&cache->lock);
+
+	return cache;
+}
+
+/* Returns a reference to the process-wide cache, creating it if no
+ * one holds one.
+ */
+MediaArtKeyCache *
+media_art_key_cache_get_shared (void)
+{
+	MediaArtKeyCache *cache;
+
+	g_mutex_lock (&shared_lock);
+
+	if (shared_cache) {
+		cache = media_art_key_cache_ref (shared_cache);
+	} else {
+		cache = media_art_key_cache_new (KEY_CACHE_SHARED_MAX_SIZE);
+		cache->shared = TRUE;
+		shared_cache = cache;
+	}
+
+	g_mutex_unlock (&shared_lock);
+
+	return cache;
+}
+
+MediaArtKeyCache *
+media_art_key_cache_ref (MediaArtKeyCache *cache)
+{
+	g_atomic_int_inc (&cache->ref_count);
+
+	return cache;
+}
+
+void
+media_art_key_cache_unref (MediaArtKeyCache *cache)
+{
+	if (!cache->shared) {
+		if (g_atomic_int_dec_and_test (&cache->ref_count)) {
+			key_cache_free (cache);
+		}
+
+		return;
+	}
+
+	/* Not to be handed out again by get_shared() while we free it */
+	g_mutex_lock (&shared_lock);
+
+	if (g_atomic_int_dec_and_test (&cache->ref_count)) {
+		if (shared_cache == cache) {
+			shared_cache = NULL;
+		}
+
+		key_cache_free (cache);
+	}
+
+	g_mutex_unlock (&shared_lock);
+}
+
+gboolean
+media_art_key_cache_lookup (MediaArtKeyCache *cache,
+                            const gchar      *key)
+{
+	GList *link;
+
+	g_mutex_lock (&cache->lock);
+
+	link = g_hash_table_lookup (cache->keys, key);
+
+	if (link && cache->max_size > 0) {
+		g_queue_unlink (&cache->lru, link);
+		g_queue_push_head_link (&cache->lru, link);
+	}
+
+	g_mutex_unlock (&cache->lock);
+
+	return link != NULL;
+}
+
+void
+media_art_key_cache_insert (MediaArtKeyCache *cache,
+                            const gchar      *key)
+{
+	gchar *copy;
+
+	g_mutex_lock (&cache->lock);
+
+	if (g_hash_table_contains (cache->keys, key)) {
+		g_mutex_unlock (&cache->lock);
+		return;
+	}
+
+	copy = g_strdup (key);
+	g_queue_push_head (&cache->lru, copy);
+	g_hash_table_insert (cache->keys, copy, cache->lru.head);
+	cache->size += key_cache_entry_size (copy);
+
+	while (cache->max_size > 0 &&
+	       cache->size > cache->max_size &&
+	       cache->lru.length > 1) {
+		gchar *oldest;
+
+		oldest = g_queue_pop_tail (&cache->lru);
+		g_hash_table_remove (cache->keys, oldest);
+		cache->size -= key_cache_entry_size (oldest);
+		g_free (oldest);
+	}
+
+	g_mutex_unlock (&cache->lock);
+}
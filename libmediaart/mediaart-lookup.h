@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LIBMEDIAART_LOOKUP_H__
+#define __LIBMEDIAART_LOOKUP_H__
+
+/* Cache lookup API only, as provided by libmediaart-lookup-2.0 */
+
+#define __LIBMEDIAART_INSIDE__
+
+#include <libmediaart/cache.h>
+
+#undef __LIBMEDIAART_INSIDE__
+
+#endif /* __LIBMEDIAART_LOOKUP_H__ */
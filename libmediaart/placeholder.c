@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "index.h"
+#include "placeholder.h"
+
+/* Placeholders for cached media art, for views to paint before (or
+ * instead of) decoding the real thing: a BlurHash string
+ * (https://blurha.sh) and the average colour of the image.
+ *
+ * They are computed when media art is processed, from a small RGB
+ * rendering of the cached file, and kept in the "placeholder" index
+ * table as "RRGGBB-<mtime>-<blurhash>", keyed by the basename of the
+ * cache entry. The mtime tells whether the entry changed since.
+ */
+
+#define PLACEHOLDER_X_COMPONENTS 4
+#define PLACEHOLDER_Y_COMPONENTS 3
+
+static const gchar base83_chars[] =
+	"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"abcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
+
+static void
+base83_append (GString *str,
+               guint    value,
+               guint    length)
+{
+	guint divisor = 1;
+	guint i;
+
+	for (i = 1; i < length; i++) {
+		divisor *= 83;
+	}
+
+	for (i = 0; i < length; i++) {
+		g_string_append_c (str, base83_chars[(value / divisor) % 83]);
+		divisor /= 83;
+	}
+}
+
+static gdouble
+srgb_to_linear (guchar value)
+{
+	gdouble v = value / 255.0;
+
+	return v <= 0.04045 ? v / 12.92 : pow ((v + 0.055) / 1.055, 2.4);
+}
+
+static guint
+linear_to_srgb (gdouble value)
+{
+	gdouble v = CLAMP (value, 0.0, 1.0);
+
+	if (v <= 0.0031308) {
+		return (guint) (v * 12.92 * 255 + 0.5);
+	}
+
+	return (guint) ((1.055 * pow (v, 1 / 2.4) - 0.055) * 255 + 0.5);
+}
+
+static gdouble
+sign_pow (gdouble value,
+          gdouble exp)
+{
+	return copysign (pow (fabs (value), exp), value);
+}
+
+/* Encodes the @size x @size RGB image in @pixels, and returns its
+ * average colour in @color.
+ */
+static gchar *
+placeholder_encode (const guchar *pixels,
+                    guint         size,
+                    guint32      *color)
+{
+	gdouble factors[PLACEHOLDER_Y_COMPONENTS][PLACEHOLDER_X_COMPONENTS][3];
+	gdouble max_value = 1, actual_max = 0;
+	gdouble *linear;
+	GString *str;
+	guint i, j, x, y, c;
+
+	/* Linear light, once, rather than per component */
+	linear = g_new (gdouble, size * size * 3);
+
+	for (i = 0; i < size * size * 3; i++) {
+		linear[i] = srgb_to_linear (pixels[i]);
+	}
+
+	for (j = 0; j < PLACEHOLDER_Y_COMPONENTS; j++) {
+		for (i = 0; i < PLACEHOLDER_X_COMPONENTS; i++) {
+			gdouble sum[3] = { 0, 0, 0 };
+			gdouble scale;
+
+			for (y = 0; y < size; y++) {
+				gdouble basis_y = cos (G_PI * j * y / size);
+
+				for (x = 0; x < size; x++) {
+					gdouble basis = basis_y * cos (G_PI * i * x / size);
+					const gdouble *p = &linear[(y * size + x) * 3];
+
+					for (c = 0; c < 3; c++) {
+						sum[c] += basis * p[c];
+					}
+				}
+			}
+
+			scale = (i == 0 && j == 0 ? 1.0 : 2.0) / (size * size);
+
+			for (c = 0; c < 3; c++) {
+				factors[j][i][c] = sum[c] * scale;
+
+				if (i != 0 || j != 0) {
+					actual_max = MAX (actual_max, fabs (factors[j][i][c]));
+				}
+			}
+		}
+	}
+
+	g_free (linear);
+
+	str = g_string_sized_new (6 + 2 * PLACEHOLDER_X_COMPONENTS * PLACEHOLDER_Y_COMPONENTS);
+
+	base83_append (str,
+	               (PLACEHOLDER_X_COMPONENTS - 1) + (PLACEHOLDER_Y_COMPONENTS - 1) * 9,
+	               1);
+
+	if (PLACEHOLDER_X_COMPONENTS * PLACEHOLDER_Y_COMPONENTS > 1) {
+		gint quantised_max;
+
+		quantised_max = CLAMP ((gint) floor (actual_max * 166 - 0.5), 0, 82);
+		max_value = (quantised_max + 1) / 166.0;
+		base83_append (str, quantised_max, 1);
+	} else {
+		base83_append (str, 0, 1);
+	}
+
+	/* The DC component is the average colour */
+	*color = (linear_to_srgb (factors[0][0][0]) << 16) |
+	         (linear_to_srgb (factors[0][0][1]) << 8) |
+	         linear_to_srgb (factors[0][0][2]);
+	base83_append (str, *color, 4);
+
+	for (j = 0; j < PLACEHOLDER_Y_COMPONENTS; j++) {
+		for (i = 0; i < PLACEHOLDER_X_COMPONENTS; i++) {
+			guint quantised[3];
+
+			if (i == 0 && j == 0) {
+				continue;
+			}
+
+			for (c = 0; c < 3; c++) {
+				gdouble v = sign_pow (factors[j][i][c] / max_value, 0.5) * 9 + 9.5;
+
+				quantised[c] = CLAMP ((gint) floor (v), 0, 18);
+			}
+
+			base83_append (str, quantised[0] * 19 * 19 + quantised[1] * 19 + quantised[2], 2);
+		}
+	}
+
+	return g_string_free (str, FALSE);
+}
+
+static gboolean
+placeholder_parse (const gchar  *value,
+                   gchar       **blurhash,
+                   guint32      *color,
+                   guint64      *mtime)
+{
+	guint32 parsed_color;
+	guint64 parsed_mtime;
+	gint offset = 0;
+
+	if (!value ||
+	    sscanf (value, "%6x-%" G_GUINT64_FORMAT "-%n", &parsed_color, &parsed_mtime, &offset) != 2 ||
+	    offset == 0 || value[offset] == '\0') {
+		return FALSE;
+	}
+
+	if (blurhash) {
+		*blurhash = g_strdup (value + offset);
+	}
+
+	if (color) {
+		*color = parsed_color;
+	}
+
+	if (mtime) {
+		*mtime = parsed_mtime;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+placeholder_get_mtime (const gchar *path,
+                       guint64     *mtime)
+{
+	GStatBuf st;
+
+	if (g_stat (path, &st) != 0) {
+		return FALSE;
+	}
+
+	*mtime = st.st_mtime;
+
+	return TRUE;
+}
+
+/* Whether the placeholder of @path was made from what is there now,
+ * to spare decoding it again.
+ */
+gboolean
+_media_art_placeholder_is_current (const gchar *path)
+{
+	gchar *key, *value;
+	guint64 mtime, stored_mtime;
+	gboolean retval;
+
+	if (!placeholder_get_mtime (path, &mtime)) {
+		return FALSE;
+	}
+
+	key = g_path_get_basename (path);
+	value = _media_art_index_get_value ("placeholder", key);
+	retval = placeholder_parse (value, NULL, NULL, &stored_mtime) &&
+	         stored_mtime == mtime;
+	g_free (value);
+	g_free (key);
+
+	return retval;
+}
+
+/*
+ * _media_art_placeholder_store:
+ * @path: a path in the media art cache
+ * @pixels: the image at @path as MEDIA_ART_PLACEHOLDER_SIZE pixels
+ * square of packed 8-bit RGB
+ */
+void
+_media_art_placeholder_store (const gchar  *path,
+                              const guchar *pixels)
+{
+	gchar *key, *value, *blurhash;
+	guint64 mtime;
+	guint32 color;
+
+	if (!placeholder_get_mtime (path, &mtime)) {
+		return;
+	}
+
+	blurhash = placeholder_encode (pixels, MEDIA_ART_PLACEHOLDER_SIZE, &color);
+
+	key = g_path_get_basename (path);
+	value = g_strdup_printf ("%06x-%" G_GUINT64_FORMAT "-%s",
+	                         color,
+	                         mtime,
+	                         blurhash);
+	_media_art_index_set_value ("placeholder", key, value);
+
+	g_free (value);
+	g_free (key);
+	g_free (blurhash);
+}
+
+void
+media_art_placeholder_remove (const gchar *path)
+{
+	gchar *key;
+
+	key = g_path_get_basename (path);
+	_media_art_index_remove_value ("placeholder", key);
+	g_free (key);
+}
+
+/* Finds the placeholder of @path, if it is still current */
+gboolean
+media_art_placeholder_lookup (const gchar  *path,
+                              gchar       **blurhash,
+                              guint32      *color)
+{
+	gchar *key, *value, *parsed_blurhash = NULL;
+	guint64 mtime, stored_mtime;
+	guint32 parsed_color;
+	gboolean retval;
+
+	key = g_path_get_basename (path);
+	value = _media_art_index_get_value ("placeholder", key);
+	g_free (key);
+
+	retval = placeholder_parse (value, &parsed_blurhash, &parsed_color, &stored_mtime) &&
+	         placeholder_get_mtime (path, &mtime) &&
+	         stored_mtime == mtime;
+	g_free (value);
+
+	if (!retval) {
+		g_free (parsed_blurhash);
+		return FALSE;
+	}
+
+	if (blurhash) {
+		*blurhash = parsed_blurhash;
+	} else {
+		g_free (parsed_blurhash);
+	}
+
+	if (color) {
+		*color = parsed_color;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __LIBMEDIAART_PLACEHOLDER_H__
+#define __LIBMEDIAART_PLACEHOLDER_H__
+
+#include <glib.h>
+
+#include "mediaart-macros.h"
+
+G_BEGIN_DECLS
+
+/* Size of the RGB image _media_art_placeholder_store() expects */
+#define MEDIA_ART_PLACEHOLDER_SIZE 32
+
+_LIBMEDIAART_EXTERN
+gboolean _media_art_placeholder_is_current (const gchar   *path);
+_LIBMEDIAART_EXTERN
+void     _media_art_placeholder_store      (const gchar   *path,
+                                            const guchar  *pixels);
+void     media_art_placeholder_remove      (const gchar   *path);
+
+gboolean media_art_placeholder_lookup      (const gchar   *path,
+                                            gchar        **blurhash,
+                                            guint32       *color);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_PLACEHOLDER_H__ */
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "pool.h"
+
+/* Large buffers (file contents, pixel data, I/O chunks) used while
+ * decoding and encoding media art, kept for the next job instead of
+ * going back to the kernel: glibc serves allocations this big with
+ * mmap() and munmap(), so every job would fault its buffers in again.
+ *
+ * Buffers come in power-of-two size classes between POOL_MIN_SHIFT
+ * and POOL_MAX_SHIFT, anything bigger is left to g_malloc(). The big
+ * classes ask for transparent huge pages where the kernel has them.
+ *
+ * The pool is kept as long as a MediaArtProcess exists. It holds at
+ * most POOL_CLASS_MAX_FREE buffers per class and POOL_MAX_CACHED
+ * bytes in all, drops buffers which went unused for POOL_IDLE_TIME,
+ * and keeps one buffer per class at most once the job queue drains.
+ * A trimmer thread runs while buffers are cached, so idle ones are
+ * dropped even if no job comes along afterwards.
+ */
+
+#define POOL_MIN_SHIFT       16 /* 64 KiB */
+#define POOL_MAX_SHIFT       26 /* 64 MiB */
+#define POOL_N_CLASSES       (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_CLASS_SIZE(i)   ((gsize) 1 << ((i) + POOL_MIN_SHIFT))
+
+#define POOL_CLASS_MAX_FREE  2
+#define POOL_MAX_CACHED      (32 * 1024 * 1024)
+#define POOL_IDLE_TIME       (30 * G_TIME_SPAN_SECOND)
+
+#define POOL_HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
+typedef struct {
+	gpointer mem;
+	gint64 released;
+} PoolSlot;
+
+typedef struct {
+	/* Oldest first */
+	PoolSlot free[POOL_CLASS_MAX_FREE];
+	guint n_free;
+} PoolClass;
+
+static GMutex pool_lock;
+static GCond pool_cond;
+static gboolean pool_trimmer_running;
+static guint pool_users;
+static gsize pool_cached;
+static PoolClass pool_classes[POOL_N_CLASSES];
+
+static gint
+pool_get_class (gsize size)
+{
+	gint i;
+
+	for (i = 0; i < POOL_N_CLASSES; i++) {
+		if (size <= POOL_CLASS_SIZE (i)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static gpointer
+pool_map (gsize size)
+{
+	gpointer mem;
+
+	mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (mem == MAP_FAILED) {
+		g_error ("%s: failed to allocate %" G_GSIZE_FORMAT " bytes",
+		         G_STRLOC, size);
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (size >= POOL_HUGE_PAGE_SIZE) {
+		madvise (mem, size, MADV_HUGEPAGE);
+	}
+#endif
+
+	return mem;
+}
+
+/* Drops the oldest free buffers of each class until at most
+ * @max_free are left, and any which were released before @before.
+ * Called with pool_lock held.
+ */
+static void
+pool_trim_locked (guint  max_free,
+                  gint64 before)
+{
+	gint i;
+
+	for (i = 0; i < POOL_N_CLASSES; i++) {
+		PoolClass *class = &pool_classes[i];
+		guint n = 0;
+
+		while (n < class->n_free &&
+		       (class->n_free - n > max_free ||
+		        class->free[n].released < before)) {
+			munmap (class->free[n].mem, POOL_CLASS_SIZE (i));
+			pool_cached -= POOL_CLASS_SIZE (i);
+			n++;
+		}
+
+		if (n > 0) {
+			class->n_free -= n;
+			memmove (class->free, class->free + n, class->n_free * sizeof (PoolSlot));
+		}
+	}
+}
+
+/* When the least recently used free buffer was released, called
+ * with pool_lock held and buffers cached.
+ */
+static gint64
+pool_get_oldest_locked (void)
+{
+	gint64 oldest = G_MAXINT64;
+	gint i;
+
+	for (i = 0; i < POOL_N_CLASSES; i++) {
+		if (pool_classes[i].n_free > 0) {
+			oldest = MIN (oldest, pool_classes[i].free[0].released);
+		}
+	}
+
+	return oldest;
+}
+
+static gpointer
+pool_trimmer_thread (gpointer user_data)
+{
+	g_mutex_lock (&pool_lock);
+
+	while (pool_users > 0 && pool_cached > 0) {
+		g_cond_wait_until (&pool_cond, &pool_lock,
+		                   pool_get_oldest_locked () + POOL_IDLE_TIME);
+		pool_trim_locked (POOL_CLASS_MAX_FREE, g_get_monotonic_time () - POOL_IDLE_TIME);
+	}
+
+	pool_trimmer_running = FALSE;
+	g_mutex_unlock (&pool_lock);
+
+	return NULL;
+}
+
+/* Held by each MediaArtProcess */
+void
+media_art_pool_ref (void)
+{
+	g_mutex_lock (&pool_lock);
+	pool_users++;
+	g_mutex_unlock (&pool_lock);
+}
+
+void
+media_art_pool_unref (void)
+{
+	g_mutex_lock (&pool_lock);
+
+	g_assert (pool_users > 0);
+
+	if (--pool_users == 0) {
+		pool_trim_locked (0, G_MAXINT64);
+		g_cond_signal (&pool_cond);
+	}
+
+	g_mutex_unlock (&pool_lock);
+}
+
+/* Returns a buffer of at least @size bytes, with undefined contents,
+ * to be given back with media_art_pool_free() and the same @size.
+ */
+gpointer
+media_art_pool_alloc (gsize size)
+{
+	PoolClass *class;
+	gpointer mem = NULL;
+	gint i;
+
+	i = pool_get_class (size);
+
+	if (i < 0) {
+		return g_malloc (size);
+	}
+
+	class = &pool_classes[i];
+
+	g_mutex_lock (&pool_lock);
+
+	pool_trim_locked (POOL_CLASS_MAX_FREE, g_get_monotonic_time () - POOL_IDLE_TIME);
+
+	/* The most recently used one is the likeliest to be warm */
+	if (class->n_free > 0) {
+		mem = class->free[--class->n_free].mem;
+		pool_cached -= POOL_CLASS_SIZE (i);
+	}
+
+	g_mutex_unlock (&pool_lock);
+
+	if (!mem) {
+		mem = pool_map (POOL_CLASS_SIZE (i));
+	}
+
+	return mem;
+}
+
+void
+media_art_pool_free (gpointer mem,
+                     gsize    size)
+{
+	PoolClass *class;
+	gint64 now;
+	gint i;
+
+	if (!mem) {
+		return;
+	}
+
+	i = pool_get_class (size);
+
+	if (i < 0) {
+		g_free (mem);
+		return;
+	}
+
+	class = &pool_classes[i];
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&pool_lock);
+
+	pool_trim_locked (POOL_CLASS_MAX_FREE, now - POOL_IDLE_TIME);
+
+	if (pool_users > 0 &&
+	    class->n_free < POOL_CLASS_MAX_FREE &&
+	    pool_cached + POOL_CLASS_SIZE (i) <= POOL_MAX_CACHED) {
+		class->free[class->n_free].mem = mem;
+		class->free[class->n_free].released = now;
+		class->n_free++;
+		pool_cached += POOL_CLASS_SIZE (i);
+		mem = NULL;
+
+		if (!pool_trimmer_running) {
+			pool_trimmer_running = TRUE;
+			g_thread_unref (g_thread_new ("mediaart-pool", pool_trimmer_thread, NULL));
+		}
+	}
+
+	g_mutex_unlock (&pool_lock);
+
+	if (mem) {
+		munmap (mem, POOL_CLASS_SIZE (i));
+	}
+}
+
+/* Called when there is no more work queued */
+void
+media_art_pool_trim (void)
+{
+	g_mutex_lock (&pool_lock);
+	pool_trim_locked (1, g_get_monotonic_time () - POOL_IDLE_TIME);
+	g_mutex_unlock (&pool_lock);
+}
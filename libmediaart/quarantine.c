@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "extract.h"
+#include "index.h"
+#include "quarantine.h"
+
+/* Sources which failed to process, so that rescans don't read and
+ * decode the same broken covers every time. They are kept in the
+ * "failures" index table, keyed by the MD5 of the source, as
+ *
+ *   <mtime>-<failures>-<retry after>-<code>-<domain>
+ *
+ * A source is not retried before its backoff runs out, which doubles
+ * with each failure, or before it changes (its mtime differs). Images
+ * found next to media files are sources of their own, so replacing a
+ * broken cover lifts the quarantine of every track using it.
+ * MEDIA_ART_PROCESS_FLAGS_FORCE ignores the table.
+ */
+
+/* 6 hours, doubling up to 32 days */
+#define QUARANTINE_BACKOFF_MIN (6 * 60 * 60)
+#define QUARANTINE_BACKOFF_MAX_SHIFT 7
+
+typedef struct {
+	guint64 mtime;
+	guint failures;
+	gint64 retry_after;
+	gint code;
+	gchar domain[64];
+} QuarantineEntry;
+
+static gboolean
+quarantine_lookup (const gchar     *key,
+                   QuarantineEntry *entry)
+{
+	gchar *value;
+	gboolean retval;
+
+	value = _media_art_index_get_value ("failures", key);
+
+	if (!value) {
+		return FALSE;
+	}
+
+	retval = sscanf (value,
+	                 "%" G_GUINT64_FORMAT "-%u-%" G_GINT64_FORMAT "-%d-%63s",
+	                 &entry->mtime,
+	                 &entry->failures,
+	                 &entry->retry_after,
+	                 &entry->code,
+	                 entry->domain) == 5;
+	g_free (value);
+
+	return retval;
+}
+
+/* Failures which say nothing about the source. Permissions and
+ * read-only file systems are mostly about the cache directory, and
+ * go away when that is fixed.
+ */
+static gboolean
+quarantine_is_transient (const GError *reason)
+{
+	return g_error_matches (reason, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+	       g_error_matches (reason, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+	       g_error_matches (reason, G_IO_ERROR, G_IO_ERROR_NO_SPACE) ||
+	       g_error_matches (reason, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED) ||
+	       g_error_matches (reason, G_IO_ERROR, G_IO_ERROR_READ_ONLY) ||
+	       g_error_matches (reason, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED) ||
+	       g_error_matches (reason, media_art_error_quark (), MEDIA_ART_ERROR_NO_CACHE_DIR) ||
+	       g_error_matches (reason, media_art_error_quark (), MEDIA_ART_ERROR_NO_TITLE) ||
+	       g_error_matches (reason, media_art_error_quark (), MEDIA_ART_ERROR_QUARANTINED);
+}
+
+/* Returns FALSE, with MEDIA_ART_ERROR_QUARANTINED, if @source failed
+ * at this @mtime before and its backoff hasn't run out yet.
+ */
+gboolean
+media_art_quarantine_check (const gchar  *source,
+                            guint64       mtime,
+                            GError      **error)
+{
+	QuarantineEntry entry;
+	gchar *key;
+	gint64 now;
+	gboolean found;
+
+	key = _media_art_index_get_key (source);
+	found = quarantine_lookup (key, &entry);
+	g_free (key);
+
+	if (!found || entry.mtime != mtime) {
+		return TRUE;
+	}
+
+	now = g_get_real_time () / G_USEC_PER_SEC;
+
+	if (now >= entry.retry_after) {
+		g_debug ("Retrying '%s' after %u failures", source, entry.failures);
+		return TRUE;
+	}
+
+	g_set_error (error,
+	             media_art_error_quark (),
+	             MEDIA_ART_ERROR_QUARANTINED,
+	             "Not retrying '%s' for another %" G_GINT64_FORMAT " seconds, "
+	             "it failed %u times (%s, code %d)",
+	             source,
+	             entry.retry_after - now,
+	             entry.failures,
+	             entry.domain,
+	             entry.code);
+
+	return FALSE;
+}
+
+/* Records that @source at @mtime failed with @reason */
+void
+media_art_quarantine_add (const gchar  *source,
+                          guint64       mtime,
+                          const GError *reason)
+{
+	QuarantineEntry entry;
+	const gchar *domain;
+	gchar *key, *value;
+	guint failures = 1;
+	gint64 backoff;
+
+	if (!reason || quarantine_is_transient (reason)) {
+		return;
+	}
+
+	key = _media_art_index_get_key (source);
+
+	if (quarantine_lookup (key, &entry) && entry.mtime == mtime) {
+		failures = entry.failures + 1;
+	}
+
+	backoff = (gint64) QUARANTINE_BACKOFF_MIN << MIN (failures - 1, QUARANTINE_BACKOFF_MAX_SHIFT);
+
+	/* Quark names have no slashes, but keep them short */
+	domain = g_quark_to_string (reason->domain);
+
+	value = g_strdup_printf ("%" G_GUINT64_FORMAT "-%u-%" G_GINT64_FORMAT "-%d-%.63s",
+	                         mtime,
+	                         failures,
+	                         g_get_real_time () / G_USEC_PER_SEC + backoff,
+	                         reason->code,
+	                         domain);
+
+	g_debug ("Quarantining '%s' for %" G_GINT64_FORMAT " seconds after %u failures: %s",
+	         source,
+	         backoff,
+	         failures,
+	         reason->message);
+
+	_media_art_index_set_value ("failures", key, value);
+
+	g_free (value);
+	g_free (key);
+}
+
+void
+media_art_quarantine_remove (const gchar *source)
+{
+	gchar *key;
+
+	key = _media_art_index_get_key (source);
+	_media_art_index_remove_value ("failures", key);
+	g_free (key);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __LIBMEDIAART_QUARANTINE_H__
+#define __LIBMEDIAART_QUARANTINE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean media_art_quarantine_check  (const gchar   *source,
+                                      guint64        mtime,
+                                      GError       **error);
+void     media_art_quarantine_add    (const gchar   *source,
+                                      guint64        mtime,
+                                      const GError  *reason);
+void     media_art_quarantine_remove (const gchar   *source);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_QUARANTINE_H__ */
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "readahead.h"
+
+/* Hints to the kernel that we are about to read something, so the
+ * I/O overlaps with whatever the calling job is busy with. All of
+ * this is best effort: failures are ignored, and without
+ * posix_fadvise() the file hints do nothing at all.
+ */
+
+/* Stop looking at a directory after this many entries, it is most
+ * likely not an album directory.
+ */
+#define READAHEAD_DIR_MAX_ENTRIES 256
+
+/* Paths we hinted recently, to avoid doing it again for every track
+ * of the same album, or every redraw of the same screenful. Past a
+ * few seconds the page cache may well have dropped them again, so
+ * they are forgotten and hinted anew.
+ */
+#define READAHEAD_RECENT_MAX 256
+#define READAHEAD_RECENT_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+typedef struct {
+	gboolean is_dir;
+	GPtrArray *paths;
+} ReadaheadRequest;
+
+typedef struct {
+	gchar *path;
+	gint64 time;
+} ReadaheadRecentEntry;
+
+/* Newest at the head. Files and directories are kept apart, so a
+ * busy scan can't push out what a view just prefetched.
+ */
+typedef struct {
+	GQueue queue;
+	GHashTable *set;
+} ReadaheadRecent;
+
+static GMutex readahead_lock;
+static GThreadPool *readahead_pool = NULL;
+static ReadaheadRecent readahead_recent_files = { G_QUEUE_INIT, NULL };
+static ReadaheadRecent readahead_recent_dirs = { G_QUEUE_INIT, NULL };
+
+void
+_media_art_readahead_file (const gchar *path)
+{
+#ifdef HAVE_POSIX_FADVISE
+	int fd;
+
+	fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+
+	if (fd < 0) {
+		return;
+	}
+
+	posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+	close (fd);
+#endif
+}
+
+/* Lists @dirname, which pulls its entries into the dentry cache for
+ * the heuristic, and hints every image in it since one of them is
+ * likely to be picked.
+ */
+void
+media_art_readahead_dir_images (const gchar *dirname)
+{
+	const gchar *name;
+	guint n_entries = 0;
+	GDir *dir;
+
+	dir = g_dir_open (dirname, 0, NULL);
+
+	if (!dir) {
+		return;
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL &&
+	       n_entries++ < READAHEAD_DIR_MAX_ENTRIES) {
+		gchar *name_strdown, *path;
+
+		name_strdown = g_ascii_strdown (name, -1);
+
+		if (g_str_has_suffix (name_strdown, "jpeg") ||
+		    g_str_has_suffix (name_strdown, "jpg") ||
+		    g_str_has_suffix (name_strdown, "png")) {
+			path = g_build_filename (dirname, name, NULL);
+			_media_art_readahead_file (path);
+			g_free (path);
+		}
+
+		g_free (name_strdown);
+	}
+
+	g_dir_close (dir);
+}
+
+static void
+readahead_thread (gpointer data,
+                  gpointer user_data)
+{
+	ReadaheadRequest *request = data;
+	guint i;
+
+	for (i = 0; i < request->paths->len; i++) {
+		const gchar *path = g_ptr_array_index (request->paths, i);
+
+		if (request->is_dir) {
+			media_art_readahead_dir_images (path);
+		} else {
+			_media_art_readahead_file (path);
+		}
+	}
+
+	g_ptr_array_unref (request->paths);
+	g_slice_free (ReadaheadRequest, request);
+}
+
+static void
+readahead_recent_drop_oldest (ReadaheadRecent *recent)
+{
+	ReadaheadRecentEntry *entry;
+
+	entry = g_queue_pop_tail (&recent->queue);
+	g_hash_table_remove (recent->set, entry->path);
+	g_free (entry->path);
+	g_slice_free (ReadaheadRecentEntry, entry);
+}
+
+/* Must be called with readahead_lock held. Returns FALSE if @path
+ * was hinted recently.
+ */
+static gboolean
+readahead_remember (ReadaheadRecent *recent,
+                    const gchar     *path)
+{
+	ReadaheadRecentEntry *entry;
+	gint64 now;
+
+	if (!recent->set) {
+		recent->set = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	now = g_get_monotonic_time ();
+
+	while ((entry = g_queue_peek_tail (&recent->queue)) != NULL &&
+	       now - entry->time > READAHEAD_RECENT_TIMEOUT) {
+		readahead_recent_drop_oldest (recent);
+	}
+
+	if (g_hash_table_contains (recent->set, path)) {
+		return FALSE;
+	}
+
+	entry = g_slice_new (ReadaheadRecentEntry);
+	entry->path = g_strdup (path);
+	entry->time = now;
+	g_queue_push_head (&recent->queue, entry);
+	g_hash_table_insert (recent->set, entry->path, entry);
+
+	if (recent->queue.length > READAHEAD_RECENT_MAX) {
+		readahead_recent_drop_oldest (recent);
+	}
+
+	return TRUE;
+}
+
+static void
+readahead_queue (gboolean            is_dir,
+                 const gchar * const *paths,
+                 guint               n_paths)
+{
+	ReadaheadRecent *recent;
+	ReadaheadRequest *request = NULL;
+	guint i;
+
+	g_mutex_lock (&readahead_lock);
+
+	recent = is_dir ? &readahead_recent_dirs : &readahead_recent_files;
+
+	for (i = 0; i < n_paths; i++) {
+		if (!paths[i] || !readahead_remember (recent, paths[i])) {
+			continue;
+		}
+
+		if (!request) {
+			request = g_slice_new (ReadaheadRequest);
+			request->is_dir = is_dir;
+			request->paths = g_ptr_array_new_with_free_func (g_free);
+		}
+
+		g_ptr_array_add (request->paths, g_strdup (paths[i]));
+	}
+
+	if (request) {
+		if (!readahead_pool) {
+			/* One thread is enough, this is about keeping
+			 * the disk busy, not the CPU.
+			 */
+			readahead_pool = g_thread_pool_new (readahead_thread,
+			                                    NULL,
+			                                    1,
+			                                    FALSE,
+			                                    NULL);
+		}
+
+		g_thread_pool_push (readahead_pool, request, NULL);
+	}
+
+	g_mutex_unlock (&readahead_lock);
+}
+
+/* Hints @dirname from a background thread. */
+void
+_media_art_readahead_queue_dir (const gchar *dirname)
+{
+	readahead_queue (TRUE, &dirname, 1);
+}
+
+/* Hints @paths from a background thread, as one batch. */
+void
+media_art_readahead_queue_files (const gchar * const *paths,
+                                 guint               n_paths)
+{
+	readahead_queue (FALSE, paths, n_paths);
+}
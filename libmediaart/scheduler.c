@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "pool.h"
+#include "readahead.h"
+#include "scheduler.h"
+
+/* Jobs submitted through the *_async() and *_submit() calls wait in a
+ * binary heap ordered by I/O priority (then submission order), so a
+ * queued job can be moved in O(log n) when its priority changes. A
+ * thread pool runs them; every submission pushes one token into the
+ * pool, and whichever worker takes a token runs the job at the top of
+ * the heap at that moment.
+ */
+
+#define SCHEDULER_MAX_THREADS 8
+
+/* How many of the jobs waiting at the top of the heap get their
+ * inputs hinted each time a worker starts a job.
+ */
+#define SCHEDULER_READAHEAD_JOBS 4
+
+struct _MediaArtJob {
+	gint ref_count;
+
+	/* Protected by the scheduler lock */
+	gint priority;
+	guint64 seq;
+	gint heap_index;
+	GTask *task;
+	GTaskThreadFunc func;
+	gchar *readahead_dir;
+
+	/* For jobs without a task, see media_art_scheduler_submit_detached() */
+	GObject *source_object;
+	gpointer task_data;
+	GDestroyNotify task_data_destroy;
+	GCancellable *cancellable;
+};
+
+typedef struct {
+	GMutex lock;
+	GPtrArray *heap;
+	guint64 next_seq;
+	GThreadPool *pool;
+} MediaArtScheduler;
+
+static void scheduler_worker (gpointer data,
+                              gpointer user_data);
+
+G_DEFINE_BOXED_TYPE (MediaArtJob, media_art_job, media_art_job_ref, media_art_job_unref)
+
+static MediaArtScheduler *
+scheduler_get (void)
+{
+	static MediaArtScheduler *scheduler = NULL;
+
+	if (g_once_init_enter (&scheduler)) {
+		MediaArtScheduler *s;
+		guint n_threads;
+
+		n_threads = CLAMP (g_get_num_processors (), 2, SCHEDULER_MAX_THREADS);
+
+		s = g_new0 (MediaArtScheduler, 1);
+		g_mutex_init (&s->lock);
+		s->heap = g_ptr_array_new ();
+		s->pool = g_thread_pool_new (scheduler_worker,
+		                             s,
+		                             n_threads,
+		                             FALSE,
+		                             NULL);
+
+		g_once_init_leave (&scheduler, s);
+	}
+
+	return scheduler;
+}
+
+static inline gboolean
+job_before (MediaArtJob *a,
+            MediaArtJob *b)
+{
+	if (a->priority != b->priority) {
+		return a->priority < b->priority;
+	}
+
+	return a->seq < b->seq;
+}
+
+static inline void
+heap_set (GPtrArray   *heap,
+          guint        index,
+          MediaArtJob *job)
+{
+	g_ptr_array_index (heap, index) = job;
+	job->heap_index = index;
+}
+
+static void
+heap_sift_up (GPtrArray *heap,
+              guint      index)
+{
+	MediaArtJob *job = g_ptr_array_index (heap, index);
+
+	while (index > 0) {
+		guint parent = (index - 1) / 2;
+		MediaArtJob *parent_job = g_ptr_array_index (heap, parent);
+
+		if (!job_before (job, parent_job)) {
+			break;
+		}
+
+		heap_set (heap, index, parent_job);
+		index = parent;
+	}
+
+	heap_set (heap, index, job);
+}
+
+static void
+heap_sift_down (GPtrArray *heap,
+                guint      index)
+{
+	MediaArtJob *job = g_ptr_array_index (heap, index);
+
+	while (TRUE) {
+		guint child = 2 * index + 1;
+		MediaArtJob *child_job;
+
+		if (child >= heap->len) {
+			break;
+		}
+
+		if (child + 1 < heap->len &&
+		    job_before (g_ptr_array_index (heap, child + 1),
+		                g_ptr_array_index (heap, child))) {
+			child++;
+		}
+
+		child_job = g_ptr_array_index (heap, child);
+
+		if (!job_before (child_job, job)) {
+			break;
+		}
+
+		heap_set (heap, index, child_job);
+		index = child;
+	}
+
+	heap_set (heap, index, job);
+}
+
+static MediaArtJob *
+heap_pop (GPtrArray *heap)
+{
+	MediaArtJob *top, *last;
+
+	if (heap->len == 0) {
+		return NULL;
+	}
+
+	top = g_ptr_array_index (heap, 0);
+	last = g_ptr_array_remove_index_fast (heap, heap->len - 1);
+
+	if (last != top) {
+		heap_set (heap, 0, last);
+		heap_sift_down (heap, 0);
+	}
+
+	top->heap_index = -1;
+
+	return top;
+}
+
+static void
+scheduler_worker (gpointer data,
+                  gpointer user_data)
+{
+	MediaArtScheduler *scheduler = user_data;
+	MediaArtJob *job;
+	GTaskThreadFunc func = NULL;
+	GTask *task = NULL;
+	GObject *source_object = NULL;
+	gpointer task_data = NULL;
+	GDestroyNotify task_data_destroy = NULL;
+	GCancellable *cancellable = NULL;
+	gboolean idle;
+
+	g_mutex_lock (&scheduler->lock);
+	job = heap_pop (scheduler->heap);
+
+	if (job) {
+		guint i;
+
+		task = job->task;
+		func = job->func;
+		source_object = job->source_object;
+		task_data = job->task_data;
+		task_data_destroy = job->task_data_destroy;
+		cancellable = job->cancellable;
+		job->task = NULL;
+		job->func = NULL;
+		job->source_object = NULL;
+		job->task_data = NULL;
+		job->task_data_destroy = NULL;
+		job->cancellable = NULL;
+
+		/* While this job runs, get the disk started on the
+		 * ones likely to follow. The top of the heap is not
+		 * sorted, but close enough for a hint.
+		 */
+		for (i = 0; i < MIN (scheduler->heap->len, SCHEDULER_READAHEAD_JOBS); i++) {
+			MediaArtJob *next = g_ptr_array_index (scheduler->heap, i);
+
+			if (next->readahead_dir) {
+				_media_art_readahead_queue_dir (next->readahead_dir);
+				g_clear_pointer (&next->readahead_dir, g_free);
+			}
+		}
+
+		g_clear_pointer (&job->readahead_dir, g_free);
+	}
+
+	g_mutex_unlock (&scheduler->lock);
+
+	if (!job) {
+		return;
+	}
+
+	if (task) {
+		func (task,
+		      g_task_get_source_object (task),
+		      g_task_get_task_data (task),
+		      g_task_get_cancellable (task));
+
+		g_object_unref (task);
+	} else {
+		func (NULL, source_object, task_data, cancellable);
+
+		if (task_data_destroy) {
+			task_data_destroy (task_data);
+		}
+
+		g_object_unref (source_object);
+		g_clear_object (&cancellable);
+	}
+
+	media_art_job_unref (job);
+
+	g_mutex_lock (&scheduler->lock);
+	idle = scheduler->heap->len == 0;
+	g_mutex_unlock (&scheduler->lock);
+
+	/* Keep what the next burst of work needs, not more */
+	if (idle) {
+		media_art_pool_trim ();
+	}
+}
+
+static MediaArtJob *
+job_new (gint io_priority)
+{
+	MediaArtJob *job;
+
+	job = g_slice_new0 (MediaArtJob);
+	job->ref_count = 1;
+	job->priority = io_priority;
+	job->heap_index = -1;
+
+	return job;
+}
+
+MediaArtJob *
+media_art_job_new_finished (gint io_priority)
+{
+	return job_new (io_priority);
+}
+
+static void
+scheduler_push (MediaArtScheduler *scheduler,
+                MediaArtJob       *job)
+{
+	g_mutex_lock (&scheduler->lock);
+	job->seq = scheduler->next_seq++;
+	g_ptr_array_add (scheduler->heap, job);
+	job->heap_index = scheduler->heap->len - 1;
+	heap_sift_up (scheduler->heap, job->heap_index);
+
+	/* Jobs which go straight to the front would run before the
+	 * next worker gets to hint them, so hint them now; the rest
+	 * wait for scheduler_worker() to get near them.
+	 */
+	if (job->readahead_dir && job->heap_index < SCHEDULER_READAHEAD_JOBS) {
+		_media_art_readahead_queue_dir (job->readahead_dir);
+		g_clear_pointer (&job->readahead_dir, g_free);
+	}
+
+	g_mutex_unlock (&scheduler->lock);
+
+	/* The worker owns the queue's reference */
+	g_thread_pool_push (scheduler->pool, GINT_TO_POINTER (1), NULL);
+}
+
+/* Queues @func to run for @task in a worker thread, as
+ * g_task_run_in_thread() would. @readahead_dir, if given, is the
+ * directory the job will look into, to be hinted ahead of time.
+ * Returns a new reference to the job.
+ */
+MediaArtJob *
+media_art_scheduler_submit (GTask           *task,
+                            GTaskThreadFunc  func,
+                            const gchar     *readahead_dir,
+                            gint             io_priority)
+{
+	MediaArtJob *job;
+
+	job = job_new (io_priority);
+	job->task = g_object_ref (task);
+	job->func = func;
+	job->readahead_dir = g_strdup (readahead_dir);
+
+	scheduler_push (scheduler_get (), job);
+
+	return media_art_job_ref (job);
+}
+
+/* The same, for jobs which report their result some other way than
+ * through a GTask (which costs a main loop dispatch each): @func is
+ * given a %NULL task, and @task_data is freed once it returns.
+ */
+MediaArtJob *
+media_art_scheduler_submit_detached (GObject         *source_object,
+                                     gpointer         task_data,
+                                     GDestroyNotify   task_data_destroy,
+                                     GCancellable    *cancellable,
+                                     GTaskThreadFunc  func,
+                                     const gchar     *readahead_dir,
+                                     gint             io_priority)
+{
+	MediaArtJob *job;
+
+	job = job_new (io_priority);
+	job->source_object = g_object_ref (source_object);
+	job->task_data = task_data;
+	job->task_data_destroy = task_data_destroy;
+	job->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+	job->func = func;
+	job->readahead_dir = g_strdup (readahead_dir);
+
+	scheduler_push (scheduler_get (), job);
+
+	return media_art_job_ref (job);
+}
+
+/**
+ * media_art_job_ref:
+ * @job: a #MediaArtJob
+ *
+ * Increases the reference count of @job.
+ *
+ * Returns: (transfer full): @job
+ *
+ * Since: 1.10
+ */
+MediaArtJob *
+media_art_job_ref (MediaArtJob *job)
+{
+	g_return_val_if_fail (job != NULL, NULL);
+
+	g_atomic_int_inc (&job->ref_count);
+
+	return job;
+}
+
+/**
+ * media_art_job_unref:
+ * @job: a #MediaArtJob
+ *
+ * Decreases the reference count of @job, freeing it when it drops
+ * to zero. Dropping the last reference you hold does not cancel the
+ * job, use the #GCancellable given when submitting it for that.
+ *
+ * Since: 1.10
+ */
+void
+media_art_job_unref (MediaArtJob *job)
+{
+	g_return_if_fail (job != NULL);
+
+	if (g_atomic_int_dec_and_test (&job->ref_count)) {
+		g_free (job->readahead_dir);
+		g_slice_free (MediaArtJob, job);
+	}
+}
+
+/**
+ * media_art_job_set_priority:
+ * @job: a #MediaArtJob
+ * @io_priority: the new [I/O priority][io-priority]
+ *
+ * Changes the priority of a queued job, moving it ahead of (or
+ * behind) other queued jobs accordingly. Use this, for example, when
+ * the user opens an album whose art is still queued behind a library
+ * scan.
+ *
+ * Jobs which are already running or finished are left alone, their
+ * priority included, as there is nothing left to reorder.
+ *
+ * Returns: %TRUE if @job was still queued and its priority changed,
+ * %FALSE if it had already started.
+ *
+ * Since: 1.10
+ */
+gboolean
+media_art_job_set_priority (MediaArtJob *job,
+                            gint         io_priority)
+{
+	MediaArtScheduler *scheduler;
+	gint old_priority;
+	gboolean queued;
+
+	g_return_val_if_fail (job != NULL, FALSE);
+
+	scheduler = scheduler_get ();
+
+	g_mutex_lock (&scheduler->lock);
+
+	queued = job->heap_index >= 0;
+
+	if (queued) {
+		old_priority = job->priority;
+		job->priority = io_priority;
+
+		if (io_priority < old_priority) {
+			heap_sift_up (scheduler->heap, job->heap_index);
+		} else if (io_priority > old_priority) {
+			heap_sift_down (scheduler->heap, job->heap_index);
+		}
+	}
+
+	g_mutex_unlock (&scheduler->lock);
+
+	return queued;
+}
+
+/**
+ * media_art_job_get_priority:
+ * @job: a #MediaArtJob
+ *
+ * Returns: the current [I/O priority][io-priority] of @job.
+ *
+ * Since: 1.10
+ */
+gint
+media_art_job_get_priority (MediaArtJob *job)
+{
+	MediaArtScheduler *scheduler;
+	gint priority;
+
+	g_return_val_if_fail (job != NULL, G_PRIORITY_DEFAULT);
+
+	scheduler = scheduler_get ();
+
+	g_mutex_lock (&scheduler->lock);
+	priority = job->priority;
+	g_mutex_unlock (&scheduler->lock);
+
+	return priority;
+}
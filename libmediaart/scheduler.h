@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LIBMEDIAART_SCHEDULER_H__
+#define __LIBMEDIAART_SCHEDULER_H__
+
+#include <gio/gio.h>
+
+#include "extract.h"
+
+G_BEGIN_DECLS
+
+MediaArtJob *media_art_scheduler_submit          (GTask           *task,
+                                                  GTaskThreadFunc  func,
+                                                  const gchar     *readahead_dir,
+                                                  gint             io_priority);
+MediaArtJob *media_art_scheduler_submit_detached (GObject         *source_object,
+                                                  gpointer         task_data,
+                                                  GDestroyNotify   task_data_destroy,
+                                                  GCancellable    *cancellable,
+                                                  GTaskThreadFunc  func,
+                                                  const gchar     *readahead_dir,
+                                                  gint             io_priority);
+MediaArtJob *media_art_job_new_finished          (gint             io_priority);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_SCHEDULER_H__ */
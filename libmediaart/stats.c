@@ -0,0 +1,768 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/* For F_OFD_SETLKW */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include "bloom.h"
+#include "index.h"
+#include "placeholder.h"
+#include "stats.h"
+
+/* Counters describing the media art cache, kept in
+ * $XDG_CACHE_HOME/media-art/.index/stats so they survive the process
+ * and are shared with other users of the cache. Every change to the
+ * cache made through libmediaart adjusts them under an flock(), and
+ * they are only recounted from the directory when the file is missing
+ * or from another version, or by media_art_cache_gc().
+ *
+ * To know how many symlinks a removed entry leaves dangling, the
+ * number of links to each entry is kept in the "links" index table,
+ * which is only changed under the same flock().
+ *
+ * Counters are adjusted by comparing an entry before and after it is
+ * written, so two jobs writing the same entry at once would both see
+ * it missing and count it twice. Entries are hashed into slots which
+ * are held from _media_art_stats_change_begin() to _end(): threads of
+ * this process wait on stats_busy, other processes on a lock of the
+ * slot's byte in the stats file, where open file description locks
+ * are available.
+ */
+
+#define STATS_SLOTS 4096
+
+#define STATS_MAGIC   0x5453414d /* "MAST" */
+#define STATS_VERSION 1
+
+/* Leftovers of jobs which died before renaming their output */
+#define STATS_TEMP_SUFFIX  "-tmp"
+#define STATS_TEMP_MAX_AGE (60 * 60)
+
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint64 entries;
+	guint64 bytes;
+	guint64 links;
+	guint64 orphans;
+	gint64 last_gc_time;
+} StatsRecord;
+
+typedef struct {
+	gint64 entries;
+	gint64 bytes;
+	gint64 links;
+	gint64 orphans;
+} StatsDelta;
+
+static GMutex stats_busy_lock;
+static GCond stats_busy_cond;
+static GHashTable *stats_busy = NULL;
+
+static gchar *
+stats_get_cache_dir (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "media-art", NULL);
+}
+
+static gboolean
+stats_link_target_exists (const gchar *path,
+                          const gchar *target)
+{
+	gchar *dir, *resolved;
+	gboolean exists;
+
+	if (g_path_is_absolute (target)) {
+		return g_file_test (target, G_FILE_TEST_EXISTS);
+	}
+
+	dir = g_path_get_dirname (path);
+	resolved = g_build_filename (dir, target, NULL);
+	exists = g_file_test (resolved, G_FILE_TEST_EXISTS);
+	g_free (resolved);
+	g_free (dir);
+
+	return exists;
+}
+
+static gint64
+link_count_get (const gchar *name)
+{
+	gchar *value;
+	gint64 count;
+
+	value = _media_art_index_get_value ("links", name);
+	count = value ? g_ascii_strtoll (value, NULL, 10) : 0;
+	g_free (value);
+
+	return count;
+}
+
+static void
+link_count_set (const gchar *name,
+                gint64       count)
+{
+	gchar *value;
+
+	if (count <= 0) {
+		_media_art_index_remove_value ("links", name);
+		return;
+	}
+
+	value = g_strdup_printf ("%" G_GINT64_FORMAT, count);
+	_media_art_index_set_value ("links", name, value);
+	g_free (value);
+}
+
+static void
+link_count_add (const gchar *target,
+                gint         n)
+{
+	gchar *name;
+
+	name = g_path_get_basename (target);
+	link_count_set (name, link_count_get (name) + n);
+	g_free (name);
+}
+
+/* Forgets the links to @path, returning how many there were */
+static gint64
+link_count_take (const gchar *path)
+{
+	gchar *name;
+	gint64 count;
+
+	name = g_path_get_basename (path);
+	count = link_count_get (name);
+	link_count_set (name, 0);
+	g_free (name);
+
+	return count;
+}
+
+static gint
+stats_open (GError **error)
+{
+	gchar *path;
+	gint fd;
+
+	/* Not a table, but index_get_dir() gives us the right path */
+	path = media_art_index_get_dir ("stats");
+
+	fd = g_open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+
+	if (fd < 0 && errno == ENOENT) {
+		gchar *dir;
+
+		dir = g_path_get_dirname (path);
+		g_mkdir_with_parents (dir, 0770);
+		g_free (dir);
+
+		fd = g_open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+	}
+
+	if (fd < 0) {
+		g_set_error (error,
+		             G_IO_ERROR,
+		             g_io_error_from_errno (errno),
+		             "Could not open media art cache statistics '%s': %s",
+		             path,
+		             g_strerror (errno));
+		g_free (path);
+
+		return -1;
+	}
+
+	g_free (path);
+
+	return fd;
+}
+
+static gint
+stats_open_locked (GError **error)
+{
+	gint fd;
+
+	fd = stats_open (error);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	while (flock (fd, LOCK_EX) != 0 && errno == EINTR)
+		;
+
+	return fd;
+}
+
+static gboolean
+stats_read (gint         fd,
+            StatsRecord *record)
+{
+	return pread (fd, record, sizeof (StatsRecord), 0) == sizeof (StatsRecord) &&
+	       record->magic == STATS_MAGIC &&
+	       record->version == STATS_VERSION;
+}
+
+static void
+stats_write (gint               fd,
+             const StatsRecord *record)
+{
+	if (pwrite (fd, record, sizeof (StatsRecord), 0) != sizeof (StatsRecord)) {
+		g_debug ("Could not write media art cache statistics: %s",
+		         g_strerror (errno));
+	}
+}
+
+static void
+stats_clear_link_counts (void)
+{
+	const gchar *name;
+	gchar *dirname;
+	GDir *dir;
+
+	dirname = media_art_index_get_dir ("links");
+	dir = g_dir_open (dirname, 0, NULL);
+
+	if (dir) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			_media_art_index_remove_value ("links", name);
+		}
+
+		g_dir_close (dir);
+	}
+
+	g_free (dirname);
+}
+
+/* Recounts @record from the cache directory, which is the slow path
+ * the counters exist to avoid. With @prune, dangling symlinks and
+ * stale temporary files are removed as well.
+ */
+static gboolean
+stats_count (StatsRecord   *record,
+             gboolean       prune,
+             GCancellable  *cancellable,
+             GError       **error)
+{
+	GHashTableIter iter;
+	GHashTable *link_counts;
+	gpointer key, value;
+	const gchar *name;
+	gchar *dirname;
+	GDir *dir;
+	gint64 now;
+	guint n = 0;
+
+	record->magic = STATS_MAGIC;
+	record->version = STATS_VERSION;
+	record->entries = record->bytes = 0;
+	record->links = record->orphans = 0;
+
+	dirname = stats_get_cache_dir ();
+	dir = g_dir_open (dirname, 0, error);
+
+	if (!dir) {
+		g_free (dirname);
+		return FALSE;
+	}
+
+	link_counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	now = g_get_real_time () / G_USEC_PER_SEC;
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		GStatBuf st;
+		gchar *path;
+
+		/* Not media art, see index.c */
+		if (name[0] == '.') {
+			continue;
+		}
+
+		if (++n % 64 == 0 &&
+		    g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			g_hash_table_unref (link_counts);
+			g_dir_close (dir);
+			g_free (dirname);
+
+			return FALSE;
+		}
+
+		path = g_build_filename (dirname, name, NULL);
+
+		if (g_lstat (path, &st) != 0) {
+			g_free (path);
+			continue;
+		}
+
+		if (S_ISLNK (st.st_mode)) {
+			gchar *target;
+
+			target = g_file_read_link (path, NULL);
+
+			if (target && stats_link_target_exists (path, target)) {
+				gchar *target_name;
+				gpointer count;
+
+				target_name = g_path_get_basename (target);
+				count = g_hash_table_lookup (link_counts, target_name);
+				g_hash_table_insert (link_counts,
+				                     target_name,
+				                     GINT_TO_POINTER (GPOINTER_TO_INT (count) + 1));
+				record->links++;
+			} else if (prune && g_unlink (path) == 0) {
+				g_debug ("Removed dangling media art link '%s'", path);
+			} else {
+				record->links++;
+				record->orphans++;
+			}
+
+			g_free (target);
+		} else if (S_ISREG (st.st_mode)) {
+			if (prune &&
+			    g_str_has_suffix (name, STATS_TEMP_SUFFIX) &&
+			    st.st_mtime < now - STATS_TEMP_MAX_AGE &&
+			    g_unlink (path) == 0) {
+				g_debug ("Removed stale media art temporary file '%s'", path);
+			} else {
+				record->entries++;
+				record->bytes += st.st_size;
+			}
+		}
+
+		g_free (path);
+	}
+
+	g_dir_close (dir);
+	g_free (dirname);
+
+	stats_clear_link_counts ();
+
+	g_hash_table_iter_init (&iter, link_counts);
+
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		link_count_set (key, GPOINTER_TO_INT (value));
+	}
+
+	g_hash_table_unref (link_counts);
+
+	return TRUE;
+}
+
+static void
+stats_add (guint64 *counter,
+           gint64   delta)
+{
+	if (delta < 0 && (guint64) -delta > *counter) {
+		/* Something changed the cache behind our back,
+		 * media_art_cache_gc() puts this right.
+		 */
+		*counter = 0;
+	} else {
+		*counter += delta;
+	}
+}
+
+/* @fd is the locked stats file, or -1 if it could not be opened */
+static void
+stats_apply (gint              fd,
+             const StatsDelta *delta)
+{
+	StatsRecord record;
+
+	if (fd < 0 ||
+	    (delta->entries == 0 && delta->bytes == 0 &&
+	     delta->links == 0 && delta->orphans == 0)) {
+		return;
+	}
+
+	if (stats_read (fd, &record)) {
+		stats_add (&record.entries, delta->entries);
+		stats_add (&record.bytes, delta->bytes);
+		stats_add (&record.links, delta->links);
+		stats_add (&record.orphans, delta->orphans);
+		stats_write (fd, &record);
+	} else {
+		/* Counting from scratch already sees the change */
+		record.last_gc_time = 0;
+
+		if (stats_count (&record, FALSE, NULL, NULL)) {
+			stats_write (fd, &record);
+		}
+	}
+}
+
+static void
+stats_entry_stat (MediaArtStatsEntry *entry)
+{
+	entry->existed = g_lstat (entry->path, &entry->st) == 0;
+	entry->link_target = NULL;
+	entry->link_dangling = FALSE;
+
+	if (entry->existed && S_ISLNK (entry->st.st_mode)) {
+		entry->link_target = g_file_read_link (entry->path, NULL);
+		entry->link_dangling = !entry->link_target ||
+			!stats_link_target_exists (entry->path, entry->link_target);
+	}
+}
+
+static void
+stats_entry_account (const MediaArtStatsEntry *entry,
+                     gint                      sign,
+                     StatsDelta               *delta)
+{
+	if (!entry->existed) {
+		return;
+	}
+
+	if (S_ISLNK (entry->st.st_mode)) {
+		delta->links += sign;
+
+		if (entry->link_dangling) {
+			delta->orphans += sign;
+		}
+	} else if (S_ISREG (entry->st.st_mode)) {
+		delta->entries += sign;
+		delta->bytes += sign * (gint64) entry->st.st_size;
+	}
+}
+
+static gboolean
+stats_entry_is_file (const MediaArtStatsEntry *entry)
+{
+	return entry->existed && S_ISREG (entry->st.st_mode);
+}
+
+static void
+stats_entry_begin (MediaArtStatsEntry *entry,
+                   const gchar        *path)
+{
+	entry->path = g_strdup (path);
+	stats_entry_stat (entry);
+}
+
+/* Must be called with the stats file locked, see stats_apply().
+ * Returns whether the path exists now, and leaves it to be freed.
+ */
+static gboolean
+stats_entry_end (MediaArtStatsEntry *entry,
+                 gint                fd)
+{
+	MediaArtStatsEntry now;
+	StatsDelta delta = { 0, };
+
+	now.path = entry->path;
+	stats_entry_stat (&now);
+
+	stats_entry_account (entry, -1, &delta);
+	stats_entry_account (&now, 1, &delta);
+
+	if (g_strcmp0 (entry->link_target, now.link_target) != 0) {
+		if (entry->link_target && !entry->link_dangling) {
+			link_count_add (entry->link_target, -1);
+		}
+
+		if (now.link_target && !now.link_dangling) {
+			link_count_add (now.link_target, 1);
+		}
+	}
+
+	if (stats_entry_is_file (entry) && !stats_entry_is_file (&now)) {
+		delta.orphans += link_count_take (entry->path);
+	}
+
+	stats_apply (fd, &delta);
+
+	if (entry->existed && !now.existed) {
+		media_art_placeholder_remove (entry->path);
+	}
+
+	g_free (now.link_target);
+	g_free (entry->link_target);
+	entry->link_target = NULL;
+
+	return now.existed;
+}
+
+static gboolean
+stats_slots_busy (const MediaArtStatsChange *change)
+{
+	guint i;
+
+	for (i = 0; i < change->n_slots; i++) {
+		if (g_hash_table_contains (stats_busy, GUINT_TO_POINTER (change->slots[i]))) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+#ifdef HAVE_OFD_LOCKS
+
+static void
+stats_slot_lock (gint  fd,
+                 guint slot)
+{
+	struct flock lock = { 0, };
+
+	lock.l_type = F_WRLCK;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = sizeof (StatsRecord) + slot;
+	lock.l_len = 1;
+
+	while (fcntl (fd, F_OFD_SETLKW, &lock) != 0 && errno == EINTR)
+		;
+}
+
+#endif /* HAVE_OFD_LOCKS */
+
+/*
+ * _media_art_stats_change_begin:
+ * @change: an uninitialized change
+ * @path: (allow-none): a path in the media art cache
+ * @other_path: (allow-none): another path in the media art cache
+ *
+ * Waits until no one else is writing @path or @other_path, then
+ * remembers what is there before they are written or removed, for
+ * _media_art_stats_change_end() to account for the difference.
+ */
+void
+_media_art_stats_change_begin (MediaArtStatsChange *change,
+                               const gchar         *path,
+                               const gchar         *other_path)
+{
+	const gchar *paths[2] = { path, other_path };
+	guint i, j;
+
+	memset (change, 0, sizeof (MediaArtStatsChange));
+	change->lock_fd = -1;
+
+	for (i = 0; i < G_N_ELEMENTS (paths); i++) {
+		guint slot;
+
+		if (!paths[i]) {
+			continue;
+		}
+
+		slot = g_str_hash (paths[i]) % STATS_SLOTS;
+
+		/* Sorted and unique, so everyone locks in the same order */
+		for (j = 0; j < change->n_slots && change->slots[j] < slot; j++)
+			;
+
+		if (j < change->n_slots && change->slots[j] == slot) {
+			continue;
+		}
+
+		memmove (&change->slots[j + 1],
+		         &change->slots[j],
+		         (change->n_slots - j) * sizeof (guint));
+		change->slots[j] = slot;
+		change->n_slots++;
+	}
+
+	if (change->n_slots == 0) {
+		return;
+	}
+
+	g_mutex_lock (&stats_busy_lock);
+
+	if (!stats_busy) {
+		stats_busy = g_hash_table_new (NULL, NULL);
+	}
+
+	while (stats_slots_busy (change)) {
+		g_cond_wait (&stats_busy_cond, &stats_busy_lock);
+	}
+
+	for (i = 0; i < change->n_slots; i++) {
+		g_hash_table_add (stats_busy, GUINT_TO_POINTER (change->slots[i]));
+	}
+
+	g_mutex_unlock (&stats_busy_lock);
+
+#ifdef HAVE_OFD_LOCKS
+	change->lock_fd = stats_open (NULL);
+
+	if (change->lock_fd >= 0) {
+		for (i = 0; i < change->n_slots; i++) {
+			stats_slot_lock (change->lock_fd, change->slots[i]);
+		}
+	}
+#endif /* HAVE_OFD_LOCKS */
+
+	for (i = 0; i < G_N_ELEMENTS (paths); i++) {
+		if (paths[i]) {
+			stats_entry_begin (&change->entries[change->n_entries++], paths[i]);
+		}
+	}
+
+	media_art_bloom_stamp (&change->bloom_stamp);
+}
+
+void
+_media_art_stats_change_end (MediaArtStatsChange *change)
+{
+	const gchar *paths[2];
+	gboolean exists[2];
+	guint i;
+	gint fd;
+
+	if (change->n_slots == 0) {
+		return;
+	}
+
+	fd = stats_open_locked (NULL);
+
+	for (i = 0; i < change->n_entries; i++) {
+		paths[i] = change->entries[i].path;
+		exists[i] = stats_entry_end (&change->entries[i], fd);
+	}
+
+	if (fd >= 0) {
+		close (fd);
+	}
+
+	/* In one go, the second path isn't somebody else's change */
+	media_art_bloom_update (paths, exists, change->n_entries, &change->bloom_stamp);
+
+	for (i = 0; i < change->n_entries; i++) {
+		g_free (change->entries[i].path);
+		change->entries[i].path = NULL;
+	}
+
+	/* Releases the slot locks too */
+	if (change->lock_fd >= 0) {
+		close (change->lock_fd);
+	}
+
+	g_mutex_lock (&stats_busy_lock);
+
+	for (i = 0; i < change->n_slots; i++) {
+		g_hash_table_remove (stats_busy, GUINT_TO_POINTER (change->slots[i]));
+	}
+
+	g_cond_broadcast (&stats_busy_cond);
+	g_mutex_unlock (&stats_busy_lock);
+
+	change->n_entries = 0;
+	change->n_slots = 0;
+	change->lock_fd = -1;
+}
+
+/* g_unlink(), keeping the statistics up to date */
+gint
+media_art_stats_unlink (const gchar *path)
+{
+	MediaArtStatsChange change;
+	gint result;
+
+	_media_art_stats_change_begin (&change, path, NULL);
+	result = g_unlink (path);
+	_media_art_stats_change_end (&change);
+
+	return result;
+}
+
+gboolean
+media_art_stats_get (MediaArtCacheStats  *stats,
+                     GError             **error)
+{
+	StatsRecord record;
+	gchar *dirname;
+	gint fd;
+
+	memset (stats, 0, sizeof (MediaArtCacheStats));
+
+	/* No cache, nothing to count, and nothing to create either */
+	dirname = stats_get_cache_dir ();
+
+	if (!g_file_test (dirname, G_FILE_TEST_IS_DIR)) {
+		g_free (dirname);
+		return TRUE;
+	}
+
+	g_free (dirname);
+
+	fd = stats_open_locked (error);
+
+	if (fd < 0) {
+		return FALSE;
+	}
+
+	if (!stats_read (fd, &record)) {
+		record.last_gc_time = 0;
+
+		if (!stats_count (&record, FALSE, NULL, error)) {
+			close (fd);
+			return FALSE;
+		}
+
+		stats_write (fd, &record);
+	}
+
+	close (fd);
+
+	stats->entries = record.entries;
+	stats->bytes = record.bytes;
+	stats->links = record.links;
+	stats->orphans = record.orphans;
+	stats->last_gc_time = record.last_gc_time;
+
+	return TRUE;
+}
+
+gboolean
+media_art_stats_gc (GCancellable  *cancellable,
+                    GError       **error)
+{
+	StatsRecord record;
+	gint fd;
+
+	fd = stats_open_locked (error);
+
+	if (fd < 0) {
+		return FALSE;
+	}
+
+	if (!stats_count (&record, TRUE, cancellable, error)) {
+		close (fd);
+		return FALSE;
+	}
+
+	record.last_gc_time = g_get_real_time () / G_USEC_PER_SEC;
+	stats_write (fd, &record);
+	close (fd);
+
+	/* Forget what was removed since */
+	media_art_bloom_rebuild ();
+
+	return TRUE;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LIBMEDIAART_STATS_H__
+#define __LIBMEDIAART_STATS_H__
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "bloom.h"
+#include "cache.h"
+
+G_BEGIN_DECLS
+
+/* What was at a cache path before a job touched it */
+typedef struct {
+	gchar *path;
+	gboolean existed;
+	GStatBuf st;
+	gchar *link_target;
+	gboolean link_dangling;
+} MediaArtStatsEntry;
+
+/* A write of up to two cache paths, and the locks held meanwhile */
+typedef struct {
+	MediaArtStatsEntry entries[2];
+	guint n_entries;
+	guint slots[2];
+	guint n_slots;
+	gint lock_fd;
+	MediaArtBloomStamp bloom_stamp;
+} MediaArtStatsChange;
+
+_LIBMEDIAART_EXTERN
+void     _media_art_stats_change_begin (MediaArtStatsChange  *change,
+                                        const gchar          *path,
+                                        const gchar          *other_path);
+_LIBMEDIAART_EXTERN
+void     _media_art_stats_change_end   (MediaArtStatsChange  *change);
+
+gint     media_art_stats_unlink        (const gchar          *path);
+
+gboolean media_art_stats_get           (MediaArtCacheStats   *stats,
+                                        GError              **error);
+gboolean media_art_stats_gc            (GCancellable         *cancellable,
+                                        GError              **error);
+
+G_END_DECLS
+
+#endif /* __LIBMEDIAART_STATS_H__ */
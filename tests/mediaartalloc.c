@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#include "mediaartalloc.h"
+
+/* Counts heap allocations made by the calling thread between
+ * alloc_counter_start() and alloc_counter_stop().
+ *
+ * GLib routes g_malloc() and friends (and g_slice since 2.76)
+ * through the system allocator and no longer honours
+ * g_mem_set_vtable(), so the only reliable way to see every
+ * allocation made by the library is to interpose the libc entry
+ * points in the test executable itself. This is only done where
+ * glibc exports its __libc_* implementations; elsewhere the counters
+ * stay at zero and alloc_counter_available() returns %FALSE.
+ *
+ * alloc_counter_start_with_stacks() additionally records a backtrace
+ * for the first MAX_STACKS allocations so that a test exceeding its
+ * allocation budget can show where the extra allocations came from.
+ */
+
+#ifdef HAVE_LIBC_MALLOC
+
+extern void *__libc_malloc   (size_t size);
+extern void *__libc_calloc   (size_t nmemb,
+                              size_t size);
+extern void *__libc_realloc  (void   *ptr,
+                              size_t  size);
+extern void *__libc_memalign (size_t  alignment,
+                              size_t  size);
+extern void  __libc_free     (void   *ptr);
+
+#define MAX_STACKS 256
+#define MAX_FRAMES 24
+
+typedef struct {
+	size_t size;
+	gint n_frames;
+	void *frames[MAX_FRAMES];
+} AllocStack;
+
+static __thread gboolean counting;
+static __thread gboolean recording;
+static __thread gboolean in_hook;
+static __thread AllocCounterStats counters;
+
+/* Only ever written by the single thread that is recording */
+static AllocStack stacks[MAX_STACKS];
+static guint n_stacks;
+
+static inline void
+account_alloc (size_t size)
+{
+	if (!counting || in_hook) {
+		return;
+	}
+
+	counters.allocs++;
+	counters.bytes += size;
+
+#ifdef HAVE_EXECINFO_H
+	if (recording && n_stacks < MAX_STACKS) {
+		AllocStack *stack = &stacks[n_stacks++];
+
+		/* backtrace() may allocate itself */
+		in_hook = TRUE;
+		stack->size = size;
+		stack->n_frames = backtrace (stack->frames, MAX_FRAMES);
+		in_hook = FALSE;
+	}
+#endif
+}
+
+void *
+malloc (size_t size)
+{
+	account_alloc (size);
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb,
+        size_t size)
+{
+	account_alloc (nmemb * size);
+	return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+	account_alloc (size);
+	return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+	account_alloc (size);
+	return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment,
+               size_t size)
+{
+	account_alloc (size);
+	return __libc_memalign (alignment, size);
+}
+
+int
+posix_memalign (void   **memptr,
+                size_t   alignment,
+                size_t   size)
+{
+	void *ptr;
+
+	account_alloc (size);
+	ptr = __libc_memalign (alignment, size);
+	if (!ptr) {
+		return ENOMEM;
+	}
+
+	*memptr = ptr;
+	return 0;
+}
+
+void
+free (void *ptr)
+{
+	if (ptr && counting) {
+		counters.frees++;
+	}
+
+	__libc_free (ptr);
+}
+
+gboolean
+alloc_counter_available (void)
+{
+	return TRUE;
+}
+
+void
+alloc_counter_start (void)
+{
+	counters.allocs = 0;
+	counters.frees = 0;
+	counters.bytes = 0;
+	recording = FALSE;
+	counting = TRUE;
+}
+
+void
+alloc_counter_start_with_stacks (void)
+{
+#ifdef HAVE_EXECINFO_H
+	void *frames[1];
+
+	/* The first call loads the unwinder, get that out of the way */
+	backtrace (frames, 1);
+#endif
+
+	n_stacks = 0;
+	alloc_counter_start ();
+	recording = TRUE;
+}
+
+void
+alloc_counter_stop (AllocCounterStats *stats)
+{
+	counting = FALSE;
+	recording = FALSE;
+
+	if (stats) {
+		*stats = counters;
+	}
+}
+
+void
+alloc_counter_print_stacks (void)
+{
+#ifdef HAVE_EXECINFO_H
+	guint i;
+
+	for (i = 0; i < n_stacks; i++) {
+		fprintf (stderr, "Allocation %u (%" G_GSIZE_FORMAT " bytes):\n",
+		         i + 1, (gsize) stacks[i].size);
+		fflush (stderr);
+		backtrace_symbols_fd (stacks[i].frames, stacks[i].n_frames, STDERR_FILENO);
+	}
+
+	if (counters.allocs > n_stacks) {
+		fprintf (stderr, "(%" G_GUINT64_FORMAT " more allocations not recorded)\n",
+		         counters.allocs - n_stacks);
+	}
+#else
+	fprintf (stderr, "(allocation stacks are not available on this platform)\n");
+#endif
+}
+
+#else /* HAVE_LIBC_MALLOC */
+
+gboolean
+alloc_counter_available (void)
+{
+	return FALSE;
+}
+
+void
+alloc_counter_start (void)
+{
+}
+
+void
+alloc_counter_start_with_stacks (void)
+{
+}
+
+void
+alloc_counter_stop (AllocCounterStats *stats)
+{
+	if (stats) {
+		stats->allocs = 0;
+		stats->frees = 0;
+		stats->bytes = 0;
+	}
+}
+
+void
+alloc_counter_print_stacks (void)
+{
+}
+
+#endif /* HAVE_LIBC_MALLOC */
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2026, The libmediaart authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib-object.h>
+
+#include <libmediaart/mediaart.h>
+
+#include "mediaartalloc.h"
+
+/* Microbenchmarks for the cache key primitives. Each benchmark runs
+ * one function over a corpus of inputs until --min-time has elapsed
+ * and reports the average cost of a single call. Run with --json to
+ * get machine readable output suitable for comparing two builds.
+ */
+
+typedef void (*BenchFunc) (const gchar *input);
+
+typedef struct {
+	const gchar *name;
+	BenchFunc func;
+} Benchmark;
+
+typedef struct {
+	const gchar *name;
+	const gchar * const *inputs;
+} Corpus;
+
+typedef struct {
+	gchar *name;
+	guint64 iterations;
+	gdouble ns_per_op;
+	gdouble allocs_per_op;
+	gdouble bytes_per_op;
+} BenchResult;
+
+static const gchar *ascii_inputs[] = {
+	"Sgt. Pepper's Lonely Hearts Club Band",
+	"The Dark Side of the Moon",
+	"Live at *WEMBLEY* dude!",
+	"Nevermind",
+	"Kind of Blue (Legacy Edition)",
+	"cool album [CD1]",
+	"  OK   Computer  ",
+	"Random Access Memories",
+	NULL
+};
+
+static const gchar *cjk_inputs[] = {
+	"無罪モラトリアム",
+	"東京事変 (Live Tour 2012)",
+	"風の谷のナウシカ サウンドトラック",
+	"가요톱텐 [Disc 2]",
+	"最後の晩餐　〜Remastered〜",
+	"周杰倫 七里香",
+	NULL
+};
+
+static gchar **nested_inputs;
+
+static gint min_time_ms = 200;
+static gboolean json_output = FALSE;
+static gchar *filter = NULL;
+
+static GOptionEntry entries[] = {
+	{ "min-time", 't', 0, G_OPTION_ARG_INT, &min_time_ms,
+	  "Minimum time to run each benchmark for, in milliseconds", "MS" },
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &json_output,
+	  "Print results as JSON", NULL },
+	{ "filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+	  "Only run benchmarks whose name contains FILTER", "FILTER" },
+	{ NULL }
+};
+
+static gchar **
+nested_inputs_new (void)
+{
+	GPtrArray *inputs;
+	guint i;
+
+	inputs = g_ptr_array_new ();
+
+	for (i = 1; i <= 4; i++) {
+		GString *str;
+		guint j;
+
+		str = g_string_new ("The Very Long Title");
+
+		for (j = 0; j < i * 8; j++) {
+			g_string_append_printf (str,
+			                        " (Disc %u [Remaster {Deluxe <Bonus %u>}]) and more",
+			                        j, j);
+		}
+
+		g_string_append (str, " trailing (unbalanced [brackets");
+		g_ptr_array_add (inputs, g_string_free (str, FALSE));
+	}
+
+	g_ptr_array_add (inputs, NULL);
+
+	return (gchar **) g_ptr_array_free (inputs, FALSE);
+}
+
+static void
+bench_strip (const gchar *input)
+{
+	g_free (media_art_strip_invalid_entities (input));
+}
+
+static void
+bench_get_file (const gchar *input)
+{
+	GFile *file = NULL;
+
+	media_art_get_file (input, input, "album", &file);
+	g_object_unref (file);
+}
+
+static void
+bench_get_path (const gchar *input)
+{
+	gchar *path = NULL;
+
+	media_art_get_path (input, input, "album", &path);
+	g_free (path);
+}
+
+static guint64
+run_iterations (BenchFunc             func,
+                const gchar * const  *inputs,
+                guint64               iterations)
+{
+	gint64 start;
+	guint64 i;
+	guint j = 0;
+
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < iterations; i++) {
+		func (inputs[j++]);
+
+		if (inputs[j] == NULL) {
+			j = 0;
+		}
+	}
+
+	return (guint64) (g_get_monotonic_time () - start);
+}
+
+static void
+run_benchmark (const Benchmark *bench,
+               const Corpus    *corpus,
+               BenchResult     *result)
+{
+	AllocCounterStats stats;
+	guint64 iterations = 1;
+	guint64 elapsed_us;
+
+	/* Warm up caches and any one-time initialisation inside GLib */
+	run_iterations (bench->func, corpus->inputs, 16);
+
+	/* Double the iteration count until a run takes long enough to
+	 * give a stable average.
+	 */
+	for (;;) {
+		alloc_counter_start ();
+		elapsed_us = run_iterations (bench->func, corpus->inputs, iterations);
+		alloc_counter_stop (&stats);
+
+		if (elapsed_us >= (guint64) min_time_ms * 1000 ||
+		    iterations >= G_MAXUINT64 / 2) {
+			break;
+		}
+
+		iterations *= 2;
+	}
+
+	result->name = g_strdup_printf ("%s/%s", bench->name, corpus->name);
+	result->iterations = iterations;
+	result->ns_per_op = (elapsed_us * 1000.0) / iterations;
+	result->allocs_per_op = (gdouble) stats.allocs / iterations;
+	result->bytes_per_op = (gdouble) stats.bytes / iterations;
+}
+
+static void
+print_text (GArray *results)
+{
+	guint i;
+
+	for (i = 0; i < results->len; i++) {
+		BenchResult *result = &g_array_index (results, BenchResult, i);
+
+		if (alloc_counter_available ()) {
+			g_print ("%-24s %10" G_GUINT64_FORMAT " iterations %12.1f ns/op %8.1f allocs/op %10.1f B/op\n",
+			         result->name,
+			         result->iterations,
+			         result->ns_per_op,
+			         result->allocs_per_op,
+			         result->bytes_per_op);
+		} else {
+			g_print ("%-24s %10" G_GUINT64_FORMAT " iterations %12.1f ns/op\n",
+			         result->name,
+			         result->iterations,
+			         result->ns_per_op);
+		}
+	}
+}
+
+static void
+print_json (GArray *results)
+{
+	guint i;
+
+	g_print ("{\n");
+	g_print ("  \"version\": \"%s\",\n", LIBMEDIAART_VERSION);
+	g_print ("  \"allocation_tracking\": %s,\n",
+	         alloc_counter_available () ? "true" : "false");
+	g_print ("  \"benchmarks\": [\n");
+
+	for (i = 0; i < results->len; i++) {
+		BenchResult *result = &g_array_index (results, BenchResult, i);
+
+		g_print ("    {\n");
+		g_print ("      \"name\": \"%s\",\n", result->name);
+		g_print ("      \"iterations\": %" G_GUINT64_FORMAT ",\n", result->iterations);
+		g_print ("      \"ns_per_op\": %.3f,\n", result->ns_per_op);
+
+		if (alloc_counter_available ()) {
+			g_print ("      \"allocs_per_op\": %.3f,\n", result->allocs_per_op);
+			g_print ("      \"bytes_per_op\": %.3f\n", result->bytes_per_op);
+		} else {
+			g_print ("      \"allocs_per_op\": null,\n");
+			g_print ("      \"bytes_per_op\": null\n");
+		}
+
+		g_print ("    }%s\n", i + 1 < results->len ? "," : "");
+	}
+
+	g_print ("  ]\n");
+	g_print ("}\n");
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GArray *results;
+	guint i, j;
+
+	const Benchmark benchmarks[] = {
+		{ "strip", bench_strip },
+		{ "get_file", bench_get_file },
+		{ "get_path", bench_get_path },
+	};
+
+	context = g_option_context_new ("- benchmark libmediaart cache primitives");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	nested_inputs = nested_inputs_new ();
+
+	{
+		const Corpus corpora[] = {
+			{ "ascii", ascii_inputs },
+			{ "cjk", cjk_inputs },
+			{ "nested", (const gchar * const *) nested_inputs },
+		};
+
+		results = g_array_new (FALSE, TRUE, sizeof (BenchResult));
+
+		for (i = 0; i < G_N_ELEMENTS (benchmarks); i++) {
+			for (j = 0; j < G_N_ELEMENTS (corpora); j++) {
+				BenchResult result = { 0, };
+				gchar *name;
+
+				name = g_strdup_printf ("%s/%s", benchmarks[i].name, corpora[j].name);
+
+				if (filter && !strstr (name, filter)) {
+					g_free (name);
+					continue;
+				}
+
+				g_free (name);
+
+				run_benchmark (&benchmarks[i], &corpora[j], &result);
+				g_array_append_val (results, result);
+			}
+		}
+	}
+
+	if (json_output) {
+		print_json (results);
+	} else {
+		print_text (results);
+	}
+
+	for (i = 0; i < results->len; i++) {
+		g_free (g_array_index (results, BenchResult, i).name);
+	}
+
+	g_array_free (results, TRUE);
+	g_strfreev (nested_inputs);
+	g_free (filter);
+
+	return EXIT_SUCCESS;
+}
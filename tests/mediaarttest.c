@@ -21,6 +21,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <utime.h>
 
 #include <glib-object.h>
 #include <glib/gstdio.h>
@@ -186,6 +188,18 @@ test_mediaart_location_path (void)
 	g_free (path);
 }
 
+static void
+test_mediaart_prefetch (void)
+{
+	const gchar *artists[] = { "Artist", "Artist", NULL, "Other" };
+	const gchar *titles[] = { "Title", "Title", "Lanedo", NULL };
+
+	/* Nothing is cached for these, which is fine */
+	media_art_prefetch ("album", artists, titles, G_N_ELEMENTS (titles));
+	media_art_prefetch ("album", NULL, titles, G_N_ELEMENTS (titles));
+	media_art_prefetch (NULL, NULL, NULL, 0);
+}
+
 static void
 test_mediaart_process_new (void)
 {
@@ -207,6 +221,88 @@ test_mediaart_process_new (void)
 	g_object_unref (process);
 }
 
+static void
+test_mediaart_process_job_timeout (void)
+{
+	MediaArtProcess *process;
+	GError *error = NULL;
+	guint timeout = 0;
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	g_object_get (process, "job-timeout", &timeout, NULL);
+	g_assert_cmpuint (timeout, ==, 0);
+
+	g_object_set (process, "job-timeout", 1500, NULL);
+	g_object_get (process, "job-timeout", &timeout, NULL);
+	g_assert_cmpuint (timeout, ==, 1500);
+
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_shared_cache (void)
+{
+	MediaArtProcess *process, *first, *second;
+	GError *error = NULL;
+	GFile *file;
+	gchar *path;
+	gboolean shared = TRUE;
+	gboolean success;
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	g_object_get (process, "shared-cache", &shared, NULL);
+	g_assert_false (shared);
+	g_object_unref (process);
+
+	first = g_initable_new (MEDIA_ART_TYPE_PROCESS, NULL, &error, "shared-cache", TRUE, NULL);
+	g_assert_no_error (error);
+	second = g_initable_new (MEDIA_ART_TYPE_PROCESS, NULL, &error, "shared-cache", TRUE, NULL);
+	g_assert_no_error (error);
+
+	g_object_get (second, "shared-cache", &shared, NULL);
+	g_assert_true (shared);
+
+	path = g_test_build_filename (G_TEST_DIST, "543249_King-Kilo---Radium.mp3", NULL);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	success = media_art_process_file (first,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  file,
+	                                  "King Kilo", /* artist */
+	                                  "Radium",    /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	/* The cache outlives the instance which filled it */
+	g_object_unref (first);
+
+	success = media_art_process_file (second,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  file,
+	                                  "King Kilo", /* artist */
+	                                  "Radium",    /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("King Kilo", "Radium", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_object_unref (file);
+	g_object_unref (second);
+}
+
 static void
 test_mediaart_remove_cb (GObject      *source_object,
                          GAsyncResult *result,
@@ -299,6 +395,428 @@ test_mediaart_process_file (void)
 	g_object_unref (process);
 }
 
+static void
+test_mediaart_process_file_cache_hit_cb (GObject      *source_object,
+                                         GAsyncResult *result,
+                                         gpointer      user_data)
+{
+	GError *error = NULL;
+	gboolean success;
+
+	success = media_art_process_file_finish (MEDIA_ART_PROCESS (source_object), result, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_mediaart_process_file_cache_hit (void)
+{
+	MediaArtProcess *process;
+	GMainLoop *ml;
+	GFile *cover, *track;
+	GError *error = NULL;
+	struct utimbuf times = { 0, 0 };
+	gchar *dir, *path, *uri;
+	gchar *contents = NULL;
+	gchar *expected = NULL;
+	gchar *out_path = NULL;
+	gsize length = 0;
+	gboolean success;
+	guint i;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+	cover = g_file_new_for_path (path);
+	g_free (path);
+
+	/* A track older than any media art, which is up to date for it */
+	dir = g_dir_make_tmp ("mediaart-hit-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	path = g_build_filename (dir, "01 Track.mp3", NULL);
+	g_file_set_contents (path, "", 0, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (g_utime (path, &times), ==, 0);
+	track = g_file_new_for_path (path);
+	uri = g_file_get_uri (track);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    cover,
+	                                    (const guchar *) contents,
+	                                    length,
+	                                    "image/png",
+	                                    "Lanedo", /* artist */
+	                                    "Hit",    /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+	g_assert_false (media_art_get_path_for_uri (uri, NULL));
+
+	/* Answered without a worker, and still remembered for the track */
+	ml = g_main_loop_new (NULL, FALSE);
+
+	media_art_process_file_async (process,
+	                              MEDIA_ART_ALBUM,
+	                              MEDIA_ART_PROCESS_FLAGS_NONE,
+	                              track,
+	                              "Lanedo", /* artist */
+	                              "Hit",    /* title */
+	                              G_PRIORITY_DEFAULT,
+	                              NULL,
+	                              test_mediaart_process_file_cache_hit_cb,
+	                              ml);
+
+	g_main_loop_run (ml);
+	g_main_loop_unref (ml);
+
+	/* The index is written by a low priority job, give it a moment */
+	for (i = 0; i < 500 && !media_art_get_path_for_uri (uri, NULL); i++) {
+		g_usleep (10 * 1000);
+	}
+
+	media_art_get_path ("Lanedo", "Hit", "album", &expected);
+	g_assert_true (media_art_get_path_for_uri (uri, &out_path));
+	g_assert_cmpstr (out_path, ==, expected);
+
+	success = media_art_remove ("Lanedo", "Hit", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	path = g_file_get_path (track);
+	g_unlink (path);
+	g_free (path);
+	g_rmdir (dir);
+
+	g_free (out_path);
+	g_free (expected);
+	g_free (uri);
+	g_free (contents);
+	g_free (dir);
+	g_object_unref (track);
+	g_object_unref (cover);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_file_remote (void)
+{
+	MediaArtProcess *process;
+	GError *error = NULL;
+	GFile *file;
+	gchar *out_path = NULL;
+	gboolean success;
+
+	/* resource:// is not native, like the GVfs backends */
+	file = g_file_new_for_uri ("resource:///org/gnome/libmediaart/test/remote/track.mp3");
+	g_assert_false (g_file_is_native (file));
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	success = media_art_process_file (process,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  file,
+	                                  "Remote",    /* artist */
+	                                  "Folder",    /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	/* Found cover.png next to it, and converted it */
+	media_art_get_path ("Remote", "Folder", "album", &out_path);
+	g_assert_true (g_file_test (out_path, G_FILE_TEST_EXISTS));
+
+	success = media_art_remove ("Remote", "Folder", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_free (out_path);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+typedef struct {
+	guint n_processed;
+	guint n_without_art;
+	guint n_done;
+} TestTreeCounts;
+
+static void
+test_mediaart_process_tree_cb (GFile        *folder,
+                               gboolean      processed,
+                               const GError *error,
+                               guint         n_done,
+                               guint         n_pending,
+                               gpointer      user_data)
+{
+	TestTreeCounts *counts = user_data;
+	gchar *basename;
+
+	g_assert_no_error ((GError *) error);
+
+	basename = g_file_get_basename (folder);
+
+	if (processed) {
+		g_assert_true (g_str_equal (basename, "Tree Album") ||
+		               g_str_equal (basename, "Embedded") ||
+		               g_str_equal (basename, "Flac"));
+		counts->n_processed++;
+	} else {
+		g_assert_cmpstr (basename, ==, "Other");
+		counts->n_without_art++;
+	}
+
+	g_free (basename);
+
+	g_assert_cmpuint (n_done, ==, counts->n_done + 1);
+	counts->n_done = n_done;
+}
+
+/* An ID3v2.3 tag holding @picture as the front cover */
+static GByteArray *
+test_build_id3_tag (const gchar *picture,
+                    gsize        length)
+{
+	static const guchar apic_header[] = "\0image/png\0\3";
+	GByteArray *tag;
+	guint32 frame_size, tag_size;
+	guchar size[4];
+
+	/* Encoding, MIME type, picture type, empty description */
+	frame_size = sizeof (apic_header) + length;
+	tag_size = 10 + frame_size;
+
+	tag = g_byte_array_new ();
+	g_byte_array_append (tag, (const guchar *) "ID3\3\0\0", 6);
+	size[0] = (tag_size >> 21) & 0x7f;
+	size[1] = (tag_size >> 14) & 0x7f;
+	size[2] = (tag_size >> 7) & 0x7f;
+	size[3] = tag_size & 0x7f;
+	g_byte_array_append (tag, size, 4);
+
+	g_byte_array_append (tag, (const guchar *) "APIC", 4);
+	size[0] = frame_size >> 24;
+	size[1] = frame_size >> 16;
+	size[2] = frame_size >> 8;
+	size[3] = frame_size;
+	g_byte_array_append (tag, size, 4);
+	g_byte_array_append (tag, (const guchar *) "\0\0", 2);
+	g_byte_array_append (tag, apic_header, sizeof (apic_header));
+	g_byte_array_append (tag, (const guchar *) picture, length);
+
+	return tag;
+}
+
+static void
+test_append_uint32_be (GByteArray *array,
+                       guint32     value)
+{
+	guchar bytes[4];
+
+	bytes[0] = value >> 24;
+	bytes[1] = value >> 16;
+	bytes[2] = value >> 8;
+	bytes[3] = value;
+	g_byte_array_append (array, bytes, 4);
+}
+
+/* FLAC metadata holding @picture as the front cover, after a
+ * PICTURE block too short for the MIME type length it claims.
+ */
+static GByteArray *
+test_build_flac_tag (const gchar *picture,
+                     gsize        length)
+{
+	static const guchar short_block[] = {
+		0x06, 0x00, 0x00, 0x08,
+		0x00, 0x00, 0x00, 0x03, 0xff, 0xff, 0xff, 0xf0
+	};
+	GByteArray *tag;
+	guint32 block_size;
+
+	/* Picture type, MIME type, empty description, dimensions,
+	 * then the picture.
+	 */
+	block_size = 4 + 4 + 9 + 4 + 16 + 4 + length;
+
+	tag = g_byte_array_new ();
+	g_byte_array_append (tag, (const guchar *) "fLaC", 4);
+	g_byte_array_append (tag, short_block, sizeof (short_block));
+
+	test_append_uint32_be (tag, 0x86000000 | block_size);
+	test_append_uint32_be (tag, 3);
+	test_append_uint32_be (tag, 9);
+	g_byte_array_append (tag, (const guchar *) "image/png", 9);
+	test_append_uint32_be (tag, 0);
+	test_append_uint32_be (tag, 0);
+	test_append_uint32_be (tag, 0);
+	test_append_uint32_be (tag, 0);
+	test_append_uint32_be (tag, 0);
+	test_append_uint32_be (tag, length);
+	g_byte_array_append (tag, (const guchar *) picture, length);
+
+	return tag;
+}
+
+/* Removes @path and everything below it */
+static void
+test_remove_tree (const gchar *path)
+{
+	const gchar *name;
+	GDir *dir;
+
+	dir = g_dir_open (path, 0, NULL);
+
+	if (dir) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			gchar *child;
+
+			child = g_build_filename (path, name, NULL);
+			test_remove_tree (child);
+			g_free (child);
+		}
+
+		g_dir_close (dir);
+		g_rmdir (path);
+	} else {
+		g_unlink (path);
+	}
+}
+
+static void
+test_mediaart_process_tree_write (const gchar  *dir,
+                                  const gchar  *name,
+                                  const gchar  *contents,
+                                  gsize         length)
+{
+	GError *error = NULL;
+	gchar *path;
+
+	g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+	path = g_build_filename (dir, name, NULL);
+	g_file_set_contents (path, contents, length, &error);
+	g_assert_no_error (error);
+	g_free (path);
+}
+
+static void
+test_mediaart_process_tree (void)
+{
+	MediaArtProcess *process;
+	TestTreeCounts counts = { 0, };
+	GError *error = NULL;
+	GByteArray *tag;
+	GFile *root;
+	gchar *root_path, *dir, *cover;
+	gchar *contents = NULL;
+	gchar *out_path = NULL;
+	gsize length = 0;
+	gboolean success;
+
+	/* Tree Artist/Tree Album has a cover, Embedded and Flac have
+	 * one in their track's tags, Other has none and Extras has no
+	 * tracks.
+	 */
+	root_path = g_dir_make_tmp ("mediaart-tree-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	cover = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (cover, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_free (cover);
+
+	dir = g_build_filename (root_path, "Tree Artist", "Tree Album", NULL);
+	test_mediaart_process_tree_write (dir, "cover.png", contents, length);
+	test_mediaart_process_tree_write (dir, "01 Track.mp3", "", 0);
+	g_free (dir);
+
+	tag = test_build_id3_tag (contents, length);
+	dir = g_build_filename (root_path, "Tree Artist", "Embedded", NULL);
+	test_mediaart_process_tree_write (dir, "01 Track.mp3", (const gchar *) tag->data, tag->len);
+	g_byte_array_unref (tag);
+	g_free (dir);
+
+	tag = test_build_flac_tag (contents, length);
+	dir = g_build_filename (root_path, "Tree Artist", "Flac", NULL);
+	test_mediaart_process_tree_write (dir, "01 Track.flac", (const gchar *) tag->data, tag->len);
+	g_byte_array_unref (tag);
+	g_free (dir);
+
+	dir = g_build_filename (root_path, "Tree Artist", "Other", NULL);
+	test_mediaart_process_tree_write (dir, "01 Track.mp3", "", 0);
+	g_free (dir);
+
+	dir = g_build_filename (root_path, "Tree Artist", "Extras", NULL);
+	test_mediaart_process_tree_write (dir, "notes.txt", "", 0);
+	test_mediaart_process_tree_write (dir, "album.cue", "", 0);
+	test_mediaart_process_tree_write (dir, "rip.log", "", 0);
+	g_free (dir);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	root = g_file_new_for_path (root_path);
+	success = media_art_process_tree (process,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  root,
+	                                  MEDIA_ART_TREE_POLICY_ARTIST_ALBUM_FOLDERS,
+	                                  test_mediaart_process_tree_cb,
+	                                  &counts,
+	                                  NULL,
+	                                  &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+	g_assert_cmpuint (counts.n_processed, ==, 3);
+	g_assert_cmpuint (counts.n_without_art, ==, 1);
+	g_assert_cmpuint (counts.n_done, ==, 4);
+
+	media_art_get_path ("Tree Artist", "Tree Album", "album", &out_path);
+	g_assert_true (g_file_test (out_path, G_FILE_TEST_EXISTS));
+	g_free (out_path);
+
+	media_art_get_path ("Tree Artist", "Embedded", "album", &out_path);
+	g_assert_true (g_file_test (out_path, G_FILE_TEST_EXISTS));
+	g_free (out_path);
+
+	media_art_get_path ("Tree Artist", "Flac", "album", &out_path);
+	g_assert_true (g_file_test (out_path, G_FILE_TEST_EXISTS));
+	g_free (out_path);
+
+	success = media_art_remove ("Tree Artist", "Tree Album", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Tree Artist", "Embedded", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Tree Artist", "Flac", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	test_remove_tree (root_path);
+	g_assert_false (g_file_test (root_path, G_FILE_TEST_EXISTS));
+
+	g_free (contents);
+	g_free (root_path);
+	g_object_unref (root);
+	g_object_unref (process);
+}
+
 static void
 test_mediaart_process_buffer_cb (GObject      *source_object,
                                  GAsyncResult *result,
@@ -310,6 +828,7 @@ test_mediaart_process_buffer_cb (GObject      *source_object,
 	gchar *expected;
 	gchar *out_path = NULL;
 	gchar *out_uri = NULL;
+	gchar *uri;
 	gboolean success;
 
 	success = media_art_process_buffer_finish (MEDIA_ART_PROCESS (source_object), result, &error);
@@ -319,6 +838,7 @@ test_mediaart_process_buffer_cb (GObject      *source_object,
 	/* Check cache exists */
 	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
 	file = g_file_new_for_path (path);
+	uri = g_file_get_uri (file);
 
 	media_art_get_path ("Lanedo", /* artist / title */
 	                    NULL,     /* album */
@@ -339,11 +859,16 @@ test_mediaart_process_buffer_cb (GObject      *source_object,
 	 */
 	g_assert (g_file_test (out_path, G_FILE_TEST_EXISTS) == TRUE);
 
+	/* The same entry can be found from the related file alone */
+	g_assert_true (media_art_get_path_for_uri (uri, &out_uri));
+	g_assert_cmpstr (out_uri, ==, expected);
+
 	test_mediaart_remove ("Lanedo", NULL, user_data);
 
 	g_free (out_path);
 	g_free (out_uri);
 	g_free (expected);
+	g_free (uri);
 }
 
 static void
@@ -414,6 +939,1225 @@ test_mediaart_process_buffer (void)
 	g_object_unref (process);
 }
 
+static void
+test_mediaart_process_file_submit (void)
+{
+	MediaArtProcess *process;
+	MediaArtJob *job;
+	GMainLoop *ml;
+	GError *error = NULL;
+	GFile *file;
+	gchar *path;
+
+	path = g_test_build_filename (G_TEST_DIST, "543249_King-Kilo---Radium.mp3", NULL);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	ml = g_main_loop_new (NULL, FALSE);
+
+	job = media_art_process_file_submit (process,
+	                                     MEDIA_ART_ALBUM,
+	                                     MEDIA_ART_PROCESS_FLAGS_FORCE,
+	                                     file,
+	                                     "King Kilo", /* artist */
+	                                     "Radium",    /* title */
+	                                     G_PRIORITY_LOW,
+	                                     NULL,
+	                                     test_mediaart_process_file_cb,
+	                                     ml);
+	g_assert_nonnull (job);
+	g_assert_cmpint (media_art_job_get_priority (job), ==, G_PRIORITY_LOW);
+
+	/* Unless a worker picked it up already */
+	if (media_art_job_set_priority (job, G_PRIORITY_HIGH)) {
+		g_assert_cmpint (media_art_job_get_priority (job), ==, G_PRIORITY_HIGH);
+	}
+
+	g_main_loop_run (ml);
+	g_main_loop_unref (ml);
+
+	/* Changing a finished job is harmless, and does nothing */
+	g_assert_false (media_art_job_set_priority (job, G_PRIORITY_DEFAULT));
+	g_assert_cmpint (media_art_job_get_priority (job), !=, G_PRIORITY_DEFAULT);
+	media_art_job_unref (job);
+
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_buffer_async_cb (GObject      *source_object,
+                                       GAsyncResult *result,
+                                       gpointer      user_data)
+{
+	GError *error = NULL;
+	gchar *out_path = NULL;
+	gboolean success;
+
+	success = media_art_process_buffer_finish (MEDIA_ART_PROCESS (source_object), result, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	media_art_get_path ("Lanedo", "Async", NULL, &out_path);
+	g_assert_true (g_file_test (out_path, G_FILE_TEST_EXISTS));
+	g_free (out_path);
+
+	test_mediaart_remove ("Lanedo", "Async", user_data);
+}
+
+static void
+test_mediaart_process_buffer_async (void)
+{
+	MediaArtProcess *process;
+	GMainLoop *ml;
+	GFile *file;
+	GError *error = NULL;
+	gchar *dir, *path;
+	gchar *contents = NULL;
+	gsize length = 0;
+
+	/* The related file sits in a folder without any images, so
+	 * the art can only come from the buffer itself.
+	 */
+	dir = g_dir_make_tmp ("mediaart-buffer-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	path = g_build_filename (dir, "01 Track.mp3", NULL);
+	g_file_set_contents (path, "", 0, &error);
+	g_assert_no_error (error);
+	file = g_file_new_for_path (path);
+
+	g_free (path);
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	ml = g_main_loop_new (NULL, FALSE);
+
+	media_art_process_buffer_async (process,
+	                                MEDIA_ART_ALBUM,
+	                                MEDIA_ART_PROCESS_FLAGS_FORCE,
+	                                file,
+	                                (const guchar *) contents,
+	                                length,
+	                                "image/png",
+	                                "Lanedo", /* artist */
+	                                "Async",  /* title */
+	                                G_PRIORITY_DEFAULT,
+	                                NULL,
+	                                test_mediaart_process_buffer_async_cb,
+	                                ml);
+
+	g_main_loop_run (ml);
+	g_main_loop_unref (ml);
+
+	path = g_file_get_path (file);
+	g_unlink (path);
+	g_free (path);
+	g_rmdir (dir);
+
+	g_free (contents);
+	g_free (dir);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_buffer_cache_hit_cb (GObject      *source_object,
+                                           GAsyncResult *result,
+                                           gpointer      user_data)
+{
+	GError *error = NULL;
+	gboolean success;
+
+	success = media_art_process_buffer_finish (MEDIA_ART_PROCESS (source_object), result, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	test_mediaart_remove ("Lanedo", NULL, user_data);
+}
+
+static void
+test_mediaart_process_buffer_cache_hit (void)
+{
+	MediaArtProcess *process;
+	GMainLoop *ml;
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gchar *out_path = NULL;
+	unsigned char *buffer = NULL;
+	size_t length = 0;
+	gboolean success;
+	GStatBuf before, after;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, (gchar**) &buffer, &length, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    buffer,
+	                                    length,
+	                                    "image/png",
+	                                    NULL,        /* album */
+	                                    "Lanedo",    /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	media_art_get_path ("Lanedo", NULL, NULL, &out_path);
+	g_assert_cmpint (g_stat (out_path, &before), ==, 0);
+
+	/* The cache is fresh now, so this is answered without
+	 * touching the (deliberately bogus) buffer.
+	 */
+	ml = g_main_loop_new (NULL, FALSE);
+
+	media_art_process_buffer_async (process,
+	                                MEDIA_ART_ALBUM,
+	                                MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                file,
+	                                (const guchar *) "bogus",
+	                                5,
+	                                "image/png",
+	                                NULL,        /* album */
+	                                "Lanedo",    /* title */
+	                                G_PRIORITY_DEFAULT,
+	                                NULL,
+	                                test_mediaart_process_buffer_cache_hit_cb,
+	                                ml);
+
+	g_assert_cmpint (g_stat (out_path, &after), ==, 0);
+	g_assert_cmpint (before.st_size, ==, after.st_size);
+
+	g_main_loop_run (ml);
+	g_main_loop_unref (ml);
+
+	g_free (out_path);
+	g_free (buffer);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_buffer_dedup (void)
+{
+	MediaArtProcess *process;
+	GFile *file;
+	GError *error = NULL;
+	GString *retagged;
+	gchar *path;
+	gchar *album_path = NULL;
+	gchar *artist_path = NULL;
+	gchar *remaster_path = NULL;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gboolean success;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    (const guchar *) contents,
+	                                    length,
+	                                    "image/png",
+	                                    "Lanedo",    /* artist */
+	                                    "Dedup",     /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+	g_free (contents);
+
+	/* The same cover again, with a comment inserted after the
+	 * SOI marker so the MD5 sums no longer match.
+	 */
+	media_art_get_path (NULL, "Dedup", "album", &album_path);
+	g_file_get_contents (album_path, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (length, >, 2);
+
+	retagged = g_string_new_len (contents, 2);
+	g_string_append_len (retagged, "\xff\xfe\x00\x09" "comment", 11);
+	g_string_append_len (retagged, contents + 2, length - 2);
+	g_free (contents);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_PERCEPTUAL_DEDUP,
+	                                    file,
+	                                    (const guchar *) retagged->str,
+	                                    retagged->len,
+	                                    "image/jpeg",
+	                                    "Lanedo Remastered", /* artist */
+	                                    "Dedup",             /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	media_art_get_path ("Lanedo Remastered", "Dedup", "album", &remaster_path);
+	g_assert_true (g_file_test (remaster_path, G_FILE_TEST_IS_SYMLINK));
+
+	media_art_get_path ("Lanedo", "Dedup", "album", &artist_path);
+	g_unlink (remaster_path);
+	g_unlink (artist_path);
+	g_unlink (album_path);
+
+	g_string_free (retagged, TRUE);
+	g_free (remaster_path);
+	g_free (artist_path);
+	g_free (album_path);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+/* An 8x8 grey JPEG */
+static const guchar test_jpeg[] = {
+	0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01,
+	0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43,
+	0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x00, 0x08,
+	0x00, 0x08, 0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x14, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xc4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0xff, 0xda, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00,
+	0x3f, 0xff, 0xd9,
+};
+
+static void
+test_mediaart_process_buffer_truncated (void)
+{
+	MediaArtProcess *process;
+	GFile *file;
+	GError *error = NULL;
+	gchar *path, *contents;
+	gsize length;
+	gboolean success;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	/* Missing its EOI marker, which gets put back */
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    test_jpeg,
+	                                    sizeof (test_jpeg) - 2,
+	                                    "image/jpeg",
+	                                    "Lanedo",    /* artist */
+	                                    "Truncated", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	media_art_get_path ("Lanedo", "Truncated", "album", &path);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (length, ==, sizeof (test_jpeg));
+	g_assert_true (memcmp (contents, test_jpeg, length) == 0);
+	g_free (contents);
+	g_free (path);
+
+	success = media_art_remove ("Lanedo", "Truncated", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	/* Cut before the image data, nothing to salvage */
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    test_jpeg,
+	                                    100,
+	                                    "image/jpeg",
+	                                    "Lanedo",    /* artist */
+	                                    "Truncated", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_nonnull (error);
+	g_assert_false (success);
+	g_clear_error (&error);
+
+	g_assert_false (media_art_exists ("Lanedo", "Truncated", "album"));
+
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+typedef struct {
+	GMainLoop *ml;
+	guint n_batches;
+	guint n_results;
+} BatchTest;
+
+static void
+test_mediaart_process_batch_cb (MediaArtProcess      *process,
+                                const MediaArtResult *results,
+                                guint                 n_results,
+                                gpointer              user_data)
+{
+	BatchTest *test = user_data;
+	guint i;
+
+	test->n_batches++;
+
+	for (i = 0; i < n_results; i++) {
+		g_assert_no_error (results[i].error);
+		g_assert_true (results[i].success);
+
+		/* In the order they completed */
+		g_assert_cmpint (GPOINTER_TO_INT (results[i].user_data), ==, ++test->n_results);
+	}
+
+	if (test->n_results == 5) {
+		g_main_loop_quit (test->ml);
+	}
+}
+
+static void
+test_mediaart_process_batch (void)
+{
+	MediaArtProcess *process;
+	BatchTest test = { NULL, 0, 0 };
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gboolean success;
+	gint i;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	test.ml = g_main_loop_new (NULL, FALSE);
+	media_art_process_set_batch_func (process, 4, 10, test_mediaart_process_batch_cb, &test, NULL);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    (const guchar *) contents,
+	                                    length,
+	                                    "image/png",
+	                                    "Lanedo", /* artist */
+	                                    "Batch",  /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	/* Four cache hits, completed right away but delivered together */
+	for (i = 1; i <= 4; i++) {
+		media_art_process_buffer_async (process,
+		                                MEDIA_ART_ALBUM,
+		                                MEDIA_ART_PROCESS_FLAGS_NONE,
+		                                file,
+		                                (const guchar *) contents,
+		                                length,
+		                                "image/png",
+		                                "Lanedo", /* artist */
+		                                "Batch",  /* title */
+		                                G_PRIORITY_DEFAULT,
+		                                NULL,
+		                                NULL,
+		                                GINT_TO_POINTER (i));
+	}
+
+	/* And one which runs in a worker */
+	media_art_process_buffer_async (process,
+	                                MEDIA_ART_ALBUM,
+	                                MEDIA_ART_PROCESS_FLAGS_FORCE,
+	                                file,
+	                                (const guchar *) contents,
+	                                length,
+	                                "image/png",
+	                                "Lanedo", /* artist */
+	                                "Batch",  /* title */
+	                                G_PRIORITY_DEFAULT,
+	                                NULL,
+	                                NULL,
+	                                GINT_TO_POINTER (5));
+
+	g_main_loop_run (test.ml);
+	g_main_loop_unref (test.ml);
+
+	g_assert_cmpuint (test.n_results, ==, 5);
+	g_assert_cmpuint (test.n_batches, <=, 2);
+
+	success = media_art_remove ("Lanedo", "Batch", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_free (contents);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_buffer_quarantine (void)
+{
+	MediaArtProcess *process;
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gboolean success;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	/* Cut before the image data, which can't be decoded */
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    test_jpeg,
+	                                    100,
+	                                    "image/jpeg",
+	                                    "Lanedo",     /* artist */
+	                                    "Quarantine", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_nonnull (error);
+	g_assert_false (g_error_matches (error, media_art_error_quark (), MEDIA_ART_ERROR_QUARANTINED));
+	g_assert_false (success);
+	g_clear_error (&error);
+
+	/* Not tried again while the related file is unchanged */
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    test_jpeg,
+	                                    100,
+	                                    "image/jpeg",
+	                                    "Lanedo",     /* artist */
+	                                    "Quarantine", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_error (error, media_art_error_quark (), MEDIA_ART_ERROR_QUARANTINED);
+	g_assert_false (success);
+	g_clear_error (&error);
+
+	/* Unless forced, which succeeds with a good buffer and
+	 * clears the failure.
+	 */
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_FORCE,
+	                                    file,
+	                                    test_jpeg,
+	                                    sizeof (test_jpeg),
+	                                    "image/jpeg",
+	                                    "Lanedo",     /* artist */
+	                                    "Quarantine", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Lanedo", "Quarantine", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    test_jpeg,
+	                                    sizeof (test_jpeg),
+	                                    "image/jpeg",
+	                                    "Lanedo",     /* artist */
+	                                    "Quarantine", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Lanedo", "Quarantine", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_file_quarantine (void)
+{
+	MediaArtProcess *process;
+	GFile *file;
+	GError *error = NULL;
+	struct utimbuf times = { 1000, 1000 };
+	gchar *dir, *path, *cover;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gboolean success;
+
+	dir = g_dir_make_tmp ("mediaart-quarantine-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	path = g_build_filename (dir, "01 Track.mp3", NULL);
+	g_file_set_contents (path, "", 0, &error);
+	g_assert_no_error (error);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	cover = g_build_filename (dir, "cover.png", NULL);
+	g_file_set_contents (cover, "not an image", -1, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (g_utime (cover, &times), ==, 0);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	success = media_art_process_file (process,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  file,
+	                                  "Lanedo",     /* artist */
+	                                  "Broken",     /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_nonnull (error);
+	g_assert_false (g_error_matches (error, media_art_error_quark (), MEDIA_ART_ERROR_QUARANTINED));
+	g_assert_false (success);
+	g_clear_error (&error);
+
+	/* The broken cover is not tried again while it is unchanged */
+	success = media_art_process_file (process,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  file,
+	                                  "Lanedo",     /* artist */
+	                                  "Broken",     /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_error (error, media_art_error_quark (), MEDIA_ART_ERROR_QUARANTINED);
+	g_assert_false (success);
+	g_clear_error (&error);
+
+	/* But replacing it lifts the quarantine, although the track
+	 * itself is unchanged.
+	 */
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_free (path);
+
+	g_file_set_contents (cover, contents, length, &error);
+	g_assert_no_error (error);
+
+	success = media_art_process_file (process,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  file,
+	                                  "Lanedo",     /* artist */
+	                                  "Broken",     /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Lanedo", "Broken", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	test_remove_tree (dir);
+
+	g_free (contents);
+	g_free (cover);
+	g_free (dir);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static gboolean
+file_contains (const gchar *path,
+               const gchar *needle)
+{
+	gchar *contents;
+	gsize length, needle_len, i;
+	gboolean found = FALSE;
+
+	g_assert_true (g_file_get_contents (path, &contents, &length, NULL));
+	needle_len = strlen (needle);
+
+	for (i = 0; !found && i + needle_len <= length; i++) {
+		found = memcmp (contents + i, needle, needle_len) == 0;
+	}
+
+	g_free (contents);
+
+	return found;
+}
+
+static const guchar test_icc_segment[] = {
+	0xff, 0xe2, 0x00, 0x20,
+	'I', 'C', 'C', '_', 'P', 'R', 'O', 'F', 'I', 'L', 'E', 0x00,
+	0x01, 0x01,
+	/* Not a real profile, which only means it isn't converted */
+	0x00, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static void
+test_mediaart_process_buffer_srgb (void)
+{
+	MediaArtProcess *process;
+	GByteArray *tagged;
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gboolean success;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	/* test_jpeg with an ICC profile segment after its SOI */
+	tagged = g_byte_array_new ();
+	g_byte_array_append (tagged, test_jpeg, 2);
+	g_byte_array_append (tagged, test_icc_segment, sizeof (test_icc_segment));
+	g_byte_array_append (tagged, test_jpeg + 2, sizeof (test_jpeg) - 2);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	/* Stored as it is by default, profile included */
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    tagged->data,
+	                                    tagged->len,
+	                                    "image/jpeg",
+	                                    "Lanedo",  /* artist */
+	                                    "Profile", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	media_art_get_path ("Lanedo", "Profile", "album", &path);
+	g_assert_true (file_contains (path, "ICC_PROFILE"));
+	g_free (path);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_SRGB,
+	                                    file,
+	                                    tagged->data,
+	                                    tagged->len,
+	                                    "image/jpeg",
+	                                    "Lanedo", /* artist */
+	                                    "Srgb",   /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+#ifdef HAVE_LCMS2
+	/* Re-encoded without it */
+	media_art_get_path ("Lanedo", "Srgb", "album", &path);
+	g_assert_false (file_contains (path, "ICC_PROFILE"));
+	g_free (path);
+#endif
+
+	success = media_art_remove ("Lanedo", "Profile", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Lanedo", "Srgb", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_byte_array_unref (tagged);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_process_file_srgb (void)
+{
+	MediaArtProcess *process;
+	GByteArray *tagged;
+	GFile *file;
+	GError *error = NULL;
+	gchar *dir, *path;
+	gboolean success;
+
+	dir = g_dir_make_tmp ("mediaart-srgb-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	path = g_build_filename (dir, "01 Track.mp3", NULL);
+	g_file_set_contents (path, "", 0, &error);
+	g_assert_no_error (error);
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	/* A folder image tagged with a colour profile */
+	tagged = g_byte_array_new ();
+	g_byte_array_append (tagged, test_jpeg, 2);
+	g_byte_array_append (tagged, test_icc_segment, sizeof (test_icc_segment));
+	g_byte_array_append (tagged, test_jpeg + 2, sizeof (test_jpeg) - 2);
+
+	path = g_build_filename (dir, "cover.jpg", NULL);
+	g_file_set_contents (path, (const gchar *) tagged->data, tagged->len, &error);
+	g_assert_no_error (error);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	/* Copied as it is by default, profile included */
+	success = media_art_process_file (process,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                  file,
+	                                  "Lanedo",         /* artist */
+	                                  "Folder Profile", /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	media_art_get_path ("Lanedo", "Folder Profile", "album", &path);
+	g_assert_true (file_contains (path, "ICC_PROFILE"));
+	g_free (path);
+
+	success = media_art_process_file (process,
+	                                  MEDIA_ART_ALBUM,
+	                                  MEDIA_ART_PROCESS_FLAGS_SRGB,
+	                                  file,
+	                                  "Lanedo",      /* artist */
+	                                  "Folder Srgb", /* title */
+	                                  NULL,
+	                                  &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+#ifdef HAVE_LCMS2
+	/* Re-encoded without it */
+	media_art_get_path ("Lanedo", "Folder Srgb", "album", &path);
+	g_assert_false (file_contains (path, "ICC_PROFILE"));
+	g_free (path);
+#endif
+
+	success = media_art_remove ("Lanedo", "Folder Profile", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Lanedo", "Folder Srgb", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	test_remove_tree (dir);
+
+	g_byte_array_unref (tagged);
+	g_free (dir);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_cache_stats (void)
+{
+	MediaArtProcess *process;
+	MediaArtCacheStats before, during, after;
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gboolean success;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	success = media_art_cache_get_stats (&before, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	/* One file for the album, and a link to it for the artist */
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    (const guchar *) contents,
+	                                    length,
+	                                    "image/png",
+	                                    "Lanedo",    /* artist */
+	                                    "Stats",     /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_cache_get_stats (&during, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (during.entries, ==, before.entries + 1);
+	g_assert_cmpuint (during.links, ==, before.links + 1);
+	g_assert_cmpuint (during.bytes, >, before.bytes);
+
+	success = media_art_remove ("Lanedo", "Stats", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_cache_get_stats (&after, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (after.entries, ==, before.entries);
+	g_assert_cmpuint (after.links, ==, before.links);
+	g_assert_cmpuint (after.bytes, ==, before.bytes);
+	g_assert_cmpuint (after.orphans, ==, before.orphans);
+
+	success = media_art_cache_gc (NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_cache_get_stats (&after, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (after.orphans, ==, 0);
+	g_assert_cmpint (after.last_gc_time, >, 0);
+
+	g_free (contents);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+#define TEST_STATS_THREADS 8
+
+typedef struct {
+	MediaArtProcess *process;
+	GFile *file;
+	const gchar *contents;
+	gsize length;
+	guint n;
+} TestStatsThread;
+
+static gpointer
+test_mediaart_cache_stats_thread (gpointer user_data)
+{
+	TestStatsThread *data = user_data;
+	GError *error = NULL;
+	gchar *artist;
+	gboolean success;
+
+	/* Every thread writes the same album entry */
+	artist = g_strdup_printf ("Lanedo %u", data->n % 2);
+	success = media_art_process_buffer (data->process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_FORCE,
+	                                    data->file,
+	                                    (const guchar *) data->contents,
+	                                    data->length,
+	                                    "image/png",
+	                                    artist,
+	                                    "Threads",   /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+	g_free (artist);
+
+	return NULL;
+}
+
+static void
+test_mediaart_cache_stats_threads (void)
+{
+	MediaArtProcess *process;
+	MediaArtCacheStats before, counted, recounted;
+	TestStatsThread data[TEST_STATS_THREADS];
+	GThread *threads[TEST_STATS_THREADS];
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gboolean success;
+	guint i;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	/* Start from counters which match the directory */
+	success = media_art_cache_gc (NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_cache_get_stats (&before, &error);
+	g_assert_no_error (error);
+
+	for (i = 0; i < TEST_STATS_THREADS; i++) {
+		data[i].process = process;
+		data[i].file = file;
+		data[i].contents = contents;
+		data[i].length = length;
+		data[i].n = i;
+		threads[i] = g_thread_new ("stats", test_mediaart_cache_stats_thread, &data[i]);
+	}
+
+	for (i = 0; i < TEST_STATS_THREADS; i++) {
+		g_thread_join (threads[i]);
+	}
+
+	/* One file for the album, and a link to it for each artist */
+	success = media_art_cache_get_stats (&counted, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (counted.entries, ==, before.entries + 1);
+	g_assert_cmpuint (counted.links, ==, before.links + 2);
+
+	/* And counting from scratch agrees with the counters */
+	success = media_art_cache_gc (NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_cache_get_stats (&recounted, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (counted.entries, ==, recounted.entries);
+	g_assert_cmpuint (counted.links, ==, recounted.links);
+	g_assert_cmpuint (counted.bytes, ==, recounted.bytes);
+	g_assert_cmpuint (counted.orphans, ==, recounted.orphans);
+
+	for (i = 0; i < 2; i++) {
+		gchar *artist;
+
+		artist = g_strdup_printf ("Lanedo %u", i);
+		success = media_art_remove (artist, "Threads", NULL, &error);
+		g_assert_no_error (error);
+		g_assert_true (success);
+		g_free (artist);
+	}
+
+	success = media_art_cache_get_stats (&counted, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (counted.entries, ==, before.entries);
+	g_assert_cmpuint (counted.links, ==, before.links);
+	g_assert_cmpuint (counted.bytes, ==, before.bytes);
+
+	g_free (contents);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_cache_exists (void)
+{
+	MediaArtProcess *process;
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gboolean success;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	g_assert_false (media_art_exists ("Lanedo", "Exists", "album"));
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    (const guchar *) contents,
+	                                    length,
+	                                    "image/png",
+	                                    "Lanedo",    /* artist */
+	                                    "Exists",    /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_assert_true (media_art_exists ("Lanedo", "Exists", "album"));
+	g_assert_true (media_art_exists (NULL, "Exists", "album"));
+	g_assert_false (media_art_exists ("Lanedo", "Exists", "artist"));
+	g_assert_false (media_art_exists ("Lanedo", "Does not exist", "album"));
+
+	/* Removed entries stay in the filter, but not on disk */
+	success = media_art_remove ("Lanedo", "Exists", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_assert_false (media_art_exists ("Lanedo", "Exists", "album"));
+
+	success = media_art_cache_gc (NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_assert_false (media_art_exists ("Lanedo", "Exists", "album"));
+
+	/* Written behind our back right before a change of ours, which
+	 * must not hide it.
+	 */
+	media_art_get_path ("Lanedo", "Elsewhere", "album", &path);
+	g_file_set_contents (path, contents, length, &error);
+	g_assert_no_error (error);
+	g_free (path);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    (const guchar *) contents,
+	                                    length,
+	                                    "image/png",
+	                                    "Lanedo",    /* artist */
+	                                    "Exists",    /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_assert_true (media_art_exists ("Lanedo", "Elsewhere", "album"));
+
+	success = media_art_remove ("Lanedo", "Elsewhere", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	success = media_art_remove ("Lanedo", "Exists", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_free (contents);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
+static void
+test_mediaart_cache_placeholder (void)
+{
+	MediaArtProcess *process;
+	GFile *file;
+	GError *error = NULL;
+	gchar *path;
+	gchar *contents = NULL;
+	gchar *blurhash = NULL;
+	gsize length = 0;
+	guint32 color = 0;
+	gboolean success;
+
+	path = g_test_build_filename (G_TEST_DIST, "cover.png", NULL);
+	g_file_get_contents (path, &contents, &length, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+	g_free (path);
+
+	process = media_art_process_new (&error);
+	g_assert_no_error (error);
+
+	g_assert_false (media_art_get_placeholder ("Lanedo", "Placeholder", "album", &blurhash, &color));
+	g_assert_null (blurhash);
+
+	success = media_art_process_buffer (process,
+	                                    MEDIA_ART_ALBUM,
+	                                    MEDIA_ART_PROCESS_FLAGS_NONE,
+	                                    file,
+	                                    (const guchar *) contents,
+	                                    length,
+	                                    "image/png",
+	                                    "Lanedo",      /* artist */
+	                                    "Placeholder", /* title */
+	                                    NULL,
+	                                    &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_assert_true (media_art_get_placeholder ("Lanedo", "Placeholder", "album", &blurhash, &color));
+	g_assert_nonnull (blurhash);
+	/* 4x3 components */
+	g_assert_cmpuint (strlen (blurhash), ==, 28);
+	g_assert_cmpuint (color, <=, 0xffffff);
+	g_free (blurhash);
+
+	/* The album only entry gets one too */
+	g_assert_true (media_art_get_placeholder (NULL, "Placeholder", "album", NULL, NULL));
+
+	success = media_art_remove ("Lanedo", "Placeholder", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (success);
+
+	g_assert_false (media_art_get_placeholder ("Lanedo", "Placeholder", "album", NULL, NULL));
+
+	g_free (contents);
+	g_object_unref (file);
+	g_object_unref (process);
+}
+
 static void
 test_mediaart_process_uri_cb (GObject      *source_object,
                               GAsyncResult *result,
@@ -535,9 +2279,29 @@ main (int argc, char **argv)
 
 	g_test_add_func ("/mediaart/location_null", test_mediaart_location_null);
 	g_test_add_func ("/mediaart/location_path", test_mediaart_location_path);
+	g_test_add_func ("/mediaart/prefetch", test_mediaart_prefetch);
+	g_test_add_func ("/mediaart/cache/stats", test_mediaart_cache_stats);
+	g_test_add_func ("/mediaart/cache/stats/threads", test_mediaart_cache_stats_threads);
+	g_test_add_func ("/mediaart/cache/exists", test_mediaart_cache_exists);
+	g_test_add_func ("/mediaart/cache/placeholder", test_mediaart_cache_placeholder);
 	g_test_add_func ("/mediaart/process/new", test_mediaart_process_new);
+	g_test_add_func ("/mediaart/process/job_timeout", test_mediaart_process_job_timeout);
+	g_test_add_func ("/mediaart/process/shared_cache", test_mediaart_process_shared_cache);
 	g_test_add_func ("/mediaart/process/file", test_mediaart_process_file);
+	g_test_add_func ("/mediaart/process/file/submit", test_mediaart_process_file_submit);
+	g_test_add_func ("/mediaart/process/file/cache_hit", test_mediaart_process_file_cache_hit);
+	g_test_add_func ("/mediaart/process/file/remote", test_mediaart_process_file_remote);
+	g_test_add_func ("/mediaart/process/tree", test_mediaart_process_tree);
 	g_test_add_func ("/mediaart/process/buffer", test_mediaart_process_buffer);
+	g_test_add_func ("/mediaart/process/buffer/async", test_mediaart_process_buffer_async);
+	g_test_add_func ("/mediaart/process/buffer/cache_hit", test_mediaart_process_buffer_cache_hit);
+	g_test_add_func ("/mediaart/process/buffer/dedup", test_mediaart_process_buffer_dedup);
+	g_test_add_func ("/mediaart/process/buffer/truncated", test_mediaart_process_buffer_truncated);
+	g_test_add_func ("/mediaart/process/buffer/srgb", test_mediaart_process_buffer_srgb);
+	g_test_add_func ("/mediaart/process/file/srgb", test_mediaart_process_file_srgb);
+	g_test_add_func ("/mediaart/process/file/quarantine", test_mediaart_process_file_quarantine);
+	g_test_add_func ("/mediaart/process/buffer/quarantine", test_mediaart_process_buffer_quarantine);
+	g_test_add_func ("/mediaart/process/batch", test_mediaart_process_batch);
 	g_test_add_func ("/mediaart/process/failures", test_mediaart_process_failures);
 	g_test_add_func ("/mediaart/process/failures/subprocess", test_mediaart_process_failures_subprocess);
 